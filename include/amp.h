@@ -668,7 +668,7 @@ public:
      */
     void wait() const {
         if(this->valid())
-          __amp_future.wait();
+          Kalmar::CLAMP::cpu_wait(__amp_future);
     }
 
     template <class _Rep, class _Period>
@@ -1102,30 +1102,46 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
 template <typename Ker, typename Ti>
-void bar_wrapper(Ker *f, Ti *t)
+void bar_wrapper(void *f, void *t)
 {
-    (*f)(*t);
+    (*static_cast<Ker*>(f))(*static_cast<Ti*>(t));
 }
 
+/// Runs the work-items of one tile as fibers on the calling thread
+///
+/// Fiber 0 is the thread driving the tile, fibers 1..n are the work-items.
+/// wait() passes control from fiber idx to fiber idx - 1; once fiber 1
+/// reaches the barrier control returns to the driver which starts the next
+/// round from fiber n again. A finished work-item falls through to its
+/// predecessor the same way.
 struct barrier_t {
-    std::unique_ptr<ucontext_t[]> ctx;
+    std::unique_ptr<void*[]> sp;
+    std::unique_ptr<void*[]> items;
+    void (*call)(void*, void*);
+    void *kernel;
     int idx;
     barrier_t (int a) :
-        ctx(new ucontext_t[a + 1]) {}
+        sp(new void*[a + 1]), items(new void*[a + 1]), call(nullptr), kernel(nullptr) {}
+    static void fiber_main(void *p, void *x) {
+        barrier_t *b = static_cast<barrier_t*>(p);
+        intptr_t id = reinterpret_cast<intptr_t>(x);
+        b->call(b->kernel, b->items[id]);
+        __hcc_cpu_fiber_switch(&b->sp[id], b->sp[id - 1]);
+    }
     template <typename Ti, typename Ker>
     void setctx(int x, char *stack, Ker& f, Ti* tidx, int S) {
-        getcontext(&ctx[x]);
-        ctx[x].uc_stack.ss_sp = stack;
-        ctx[x].uc_stack.ss_size = S;
-        ctx[x].uc_link = &ctx[x - 1];
-        makecontext(&ctx[x], (void (*)(void))bar_wrapper<Ker, Ti>, 2, &f, tidx);
+        call = bar_wrapper<Ker, Ti>;
+        kernel = const_cast<void*>(static_cast<const void*>(&f));
+        items[x] = tidx;
+        sp[x] = Kalmar::CLAMP::cpu_fiber_make(stack, S, fiber_main, this,
+                                              reinterpret_cast<void*>(static_cast<intptr_t>(x)));
     }
     void swap(int a, int b) {
-        swapcontext(&ctx[a], &ctx[b]);
+        __hcc_cpu_fiber_switch(&sp[a], sp[b]);
     }
     void wait() {
         --idx;
-        swapcontext(&ctx[idx + 1], &ctx[idx]);
+        __hcc_cpu_fiber_switch(&sp[idx + 1], sp[idx]);
     }
 };
 #endif
@@ -1426,7 +1442,7 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template<typename K, int D1_, int D2_, int D3_> friend
-        void partitioned_task_tile(K const&, tiled_extent<D1_, D2_, D3_> const&, int);
+        void partitioned_task_tile(K const&, tiled_extent<D1_, D2_, D3_> const&, int, int);
 #endif
 };
 
@@ -1560,7 +1576,7 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template<typename K, int D> friend
-        void partitioned_task_tile(K const&, tiled_extent<D> const&, int);
+        void partitioned_task_tile(K const&, tiled_extent<D> const&, int, int);
 #endif
 };
 
@@ -1697,7 +1713,7 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template<typename K, int D1_, int D2_> friend
-        void partitioned_task_tile(K const&, tiled_extent<D1_, D2_> const&, int);
+        void partitioned_task_tile(K const&, tiled_extent<D1_, D2_> const&, int, int);
 #endif
 };
 
@@ -2035,45 +2051,49 @@ public:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
 #define SSIZE 1024 * 10
-template <int N, typename Kernel,  int K>
-struct cpu_helper
-{
-    static inline void call(const Kernel& k, index<K>& idx, const extent<K>& ext) restrict(amp,cpu) {
-        int i;
-        for (i = 0; i < ext[N]; ++i) {
-            idx[N] = i;
-            cpu_helper<N + 1, Kernel, K>::call(k, idx, ext);
-        }
-    }
-};
-template <typename Kernel, int K>
-struct cpu_helper<K, Kernel, K>
-{
-    static inline void call(const Kernel& k, const index<K>& idx, const extent<K>& ext) restrict(amp,cpu) {
-        (const_cast<Kernel&>(k))(idx);
-    }
-};
-
 template <typename Kernel, int N>
-void partitioned_task(const Kernel& ker, const extent<N>& ext, int part) {
-    index<N> idx;
-    int start = ext[0] * part / Kalmar::NTHREAD;
-    int end = ext[0] * (part + 1) / Kalmar::NTHREAD;
-    for (int i = start; i < end; i++) {
-        idx[0] = i;
-        cpu_helper<1, Kernel, N>::call(ker, idx, ext);
+void partitioned_task(const Kernel& ker, const extent<N>& ext, Kalmar::CPUChunkScheduler& sched) {
+    // a copy private to this part; the kernel's stores cannot reach it, so its
+    // captures are loaded once instead of after every store
+    Kernel k(ker);
+    size_t begin, end;
+    while (sched.next(begin, end)) {
+        // delinearize the first work-item of the chunk
+        index<N> idx;
+        size_t rest = begin;
+        for (int i = N - 1; i >= 0; --i) {
+            idx[i] = rest % ext[i];
+            rest /= ext[i];
+        }
+        // walk the chunk one row segment at a time so the innermost
+        // dimension stays contiguous and can be vectorized
+        size_t pos = begin;
+        while (pos < end) {
+            int last = idx[N - 1] + static_cast<int>(
+                std::min<size_t>(end - pos, ext[N - 1] - idx[N - 1]));
+            pos += last - idx[N - 1];
+            Kalmar::cpu_run_row(k, idx, idx[N - 1], last);
+            idx[N - 1] = 0;
+            for (int i = N - 2; i >= 0; --i) {
+                if (++idx[i] < ext[i])
+                    break;
+                idx[i] = 0;
+            }
+        }
     }
 }
 
 template <typename Kernel, int D0>
-void partitioned_task_tile(Kernel const& f, tiled_extent<D0> const& ext, int part) {
-    int start = (ext[0] / D0) * part / Kalmar::NTHREAD;
-    int end = (ext[0] / D0) * (part + 1) / Kalmar::NTHREAD;
+void partitioned_task_tile(Kernel const& f, tiled_extent<D0> const& ext, int part, int parts) {
+    int start = (ext[0] / D0) * part / parts;
+    int end = (ext[0] / D0) * (part + 1) / parts;
     int stride = end - start;
     if (stride == 0)
         return;
-    char *stk = new char[D0 * SSIZE];
-    tiled_index<D0> *tidx = new tiled_index<D0>[D0];
+    size_t slot;
+    char *stk = Kalmar::CLAMP::cpu_fiber_stacks(D0, SSIZE, &slot);
+    tiled_index<D0> *tidx = static_cast<tiled_index<D0>*>(
+        Kalmar::CLAMP::cpu_tile_scratch(sizeof(tiled_index<D0>) * (D0)));
     tile_barrier::pb_t amp_bar = std::make_shared<barrier_t>(D0);
     tile_barrier tbar(amp_bar);
     for (int tx = start; tx < end; tx++) {
@@ -2083,7 +2103,7 @@ void partitioned_task_tile(Kernel const& f, tiled_extent<D0> const& ext, int par
         for (int x = 0; x < D0; x++) {
             new (tip) tiled_index<D0>(tx * D0 + x, x, tx, tbar);
             amp_bar->setctx(++id, sp, f, tip, SSIZE);
-            sp += SSIZE;
+            sp += slot;
             ++tip;
         }
         amp_bar->idx = 0;
@@ -2091,19 +2111,20 @@ void partitioned_task_tile(Kernel const& f, tiled_extent<D0> const& ext, int par
             amp_bar->idx = id;
             amp_bar->swap(0, id);
         }
+        Kalmar::cpu_destroy_items(tidx, id);
     }
-    delete [] stk;
-    delete [] tidx;
 }
 template <typename Kernel, int D0, int D1>
-void partitioned_task_tile(Kernel const& f, tiled_extent<D0, D1> const& ext, int part) {
-    int start = (ext[0] / D0) * part / Kalmar::NTHREAD;
-    int end = (ext[0] / D0) * (part + 1) / Kalmar::NTHREAD;
+void partitioned_task_tile(Kernel const& f, tiled_extent<D0, D1> const& ext, int part, int parts) {
+    int start = (ext[0] / D0) * part / parts;
+    int end = (ext[0] / D0) * (part + 1) / parts;
     int stride = end - start;
     if (stride == 0)
         return;
-    char *stk = new char[D1 * D0 * SSIZE];
-    tiled_index<D0, D1> *tidx = new tiled_index<D0, D1>[D0 * D1];
+    size_t slot;
+    char *stk = Kalmar::CLAMP::cpu_fiber_stacks(D1 * D0, SSIZE, &slot);
+    tiled_index<D0, D1> *tidx = static_cast<tiled_index<D0, D1>*>(
+        Kalmar::CLAMP::cpu_tile_scratch(sizeof(tiled_index<D0, D1>) * (D0 * D1)));
     tile_barrier::pb_t amp_bar = std::make_shared<barrier_t>(D0 * D1);
     tile_barrier tbar(amp_bar);
 
@@ -2117,27 +2138,28 @@ void partitioned_task_tile(Kernel const& f, tiled_extent<D0, D1> const& ext, int
                     new (tip) tiled_index<D0, D1>(D1 * tx + x, D0 * ty + y, x, y, tx, ty, tbar);
                     amp_bar->setctx(++id, sp, f, tip, SSIZE);
                     ++tip;
-                    sp += SSIZE;
+                    sp += slot;
                 }
             amp_bar->idx = 0;
             while (amp_bar->idx == 0) {
                 amp_bar->idx = id;
                 amp_bar->swap(0, id);
             }
+            Kalmar::cpu_destroy_items(tidx, id);
         }
-    delete [] stk;
-    delete [] tidx;
 }
 
 template <typename Kernel, int D0, int D1, int D2>
-void partitioned_task_tile(Kernel const& f, tiled_extent<D0, D1, D2> const& ext, int part) {
-    int start = (ext[0] / D0) * part / Kalmar::NTHREAD;
-    int end = (ext[0] / D0) * (part + 1) / Kalmar::NTHREAD;
+void partitioned_task_tile(Kernel const& f, tiled_extent<D0, D1, D2> const& ext, int part, int parts) {
+    int start = (ext[0] / D0) * part / parts;
+    int end = (ext[0] / D0) * (part + 1) / parts;
     int stride = end - start;
     if (stride == 0)
         return;
-    char *stk = new char[D2 * D1 * D0 * SSIZE];
-    tiled_index<D0, D1, D2> *tidx = new tiled_index<D0, D1, D2>[D0 * D1 * D2];
+    size_t slot;
+    char *stk = Kalmar::CLAMP::cpu_fiber_stacks(D2 * D1 * D0, SSIZE, &slot);
+    tiled_index<D0, D1, D2> *tidx = static_cast<tiled_index<D0, D1, D2>*>(
+        Kalmar::CLAMP::cpu_tile_scratch(sizeof(tiled_index<D0, D1, D2>) * (D0 * D1 * D2)));
     tile_barrier::pb_t amp_bar = std::make_shared<barrier_t>(D0 * D1 * D2);
     tile_barrier tbar(amp_bar);
 
@@ -2156,55 +2178,60 @@ void partitioned_task_tile(Kernel const& f, tiled_extent<D0, D1, D2> const& ext,
                                                               x, y, z, i, j, k, tbar);
                             amp_bar->setctx(++id, sp, f, tip, SSIZE);
                             ++tip;
-                            sp += SSIZE;
+                            sp += slot;
                         }
                 amp_bar->idx = 0;
                 while (amp_bar->idx == 0) {
                     amp_bar->idx = id;
                     amp_bar->swap(0, id);
                 }
+                Kalmar::cpu_destroy_items(tidx, id);
             }
-    delete [] stk;
-    delete [] tidx;
 }
 
 template <typename Kernel, int N>
 void launch_cpu_task(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
                      extent<N> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task<Kernel, N>, std::cref(f), std::cref(compute_domain), i);
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    Kalmar::CPUChunkScheduler sched(compute_domain.size(), parts);
+    auto part = [&](Kernel const& ker, int) restrict(cpu) {
+        partitioned_task<Kernel, N>(ker, compute_domain, sched);
+    };
+    Kalmar::CLAMP::cpu_wait(*Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part)->getFuture());
 }
 
 template <typename Kernel, int D0>
 void launch_cpu_task(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
                      tiled_extent<D0> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task_tile<Kernel, D0>,
-                             std::cref(f), std::cref(compute_domain), i);
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto part = [&](Kernel const& ker, int i) restrict(cpu) {
+        partitioned_task_tile<Kernel, D0>(ker, compute_domain, i, parts);
+    };
+    Kalmar::CLAMP::cpu_wait(*Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part)->getFuture());
 }
 
 template <typename Kernel, int D0, int D1>
 void launch_cpu_task(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
                      tiled_extent<D0, D1> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task_tile<Kernel, D0, D1>,
-                             std::cref(f), std::cref(compute_domain), i);
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto part = [&](Kernel const& ker, int i) restrict(cpu) {
+        partitioned_task_tile<Kernel, D0, D1>(ker, compute_domain, i, parts);
+    };
+    Kalmar::CLAMP::cpu_wait(*Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part)->getFuture());
 }
 
 template <typename Kernel, int D0, int D1, int D2>
 void launch_cpu_task(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
                      tiled_extent<D0, D1, D2> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task_tile<Kernel, D0, D1, D2>,
-                             std::cref(f), std::cref(compute_domain), i);
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto part = [&](Kernel const& ker, int i) restrict(cpu) {
+        partitioned_task_tile<Kernel, D0, D1, D2>(ker, compute_domain, i, parts);
+    };
+    Kalmar::CLAMP::cpu_wait(*Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part)->getFuture());
 }
 
 #endif
@@ -3981,13 +4008,21 @@ private:
     // used by view_as and reinterpret_as
     array_view(const acc_buffer_t& cache, const Concurrency::extent<N>& ext,
                int offset) restrict(amp,cpu)
-        : cache(cache), extent(ext), extent_base(ext), offset(offset) {}
+        : cache(cache), extent(ext), extent_base(ext), offset(offset) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(offset, Concurrency::index<N>(), ext, ext);
+#endif
+    }
 
     // used by section and projection
     array_view(const acc_buffer_t& cache, const Concurrency::extent<N>& ext_now,
                const Concurrency::extent<N>& ext_b,
                const Concurrency::index<N>& idx_b, int off) restrict(amp,cpu)
-        : cache(cache), extent(ext_now), extent_base(ext_b), index_base(idx_b), offset(off) {}
+        : cache(cache), extent(ext_now), extent_base(ext_b), index_base(idx_b), offset(off) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(off, idx_b, ext_now, ext_b);
+#endif
+    }
   
     acc_buffer_t cache;
     Concurrency::extent<N> extent;
@@ -4549,13 +4584,21 @@ private:
     // used by view_as and reinterpret_as
     array_view(const acc_buffer_t& cache, const Concurrency::extent<N>& ext,
                int offset) restrict(amp,cpu)
-        : cache(cache), extent(ext), extent_base(ext), offset(offset) {}
+        : cache(cache), extent(ext), extent_base(ext), offset(offset) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(offset, Concurrency::index<N>(), ext, ext);
+#endif
+    }
   
     // used by section and projection
     array_view(const acc_buffer_t& cache, const Concurrency::extent<N>& ext_now,
                const Concurrency::extent<N>& ext_b,
                const Concurrency::index<N>& idx_b, int off) restrict(amp,cpu)
-        : cache(cache), extent(ext_now), extent_base(ext_b), index_base(idx_b), offset(off) {}
+        : cache(cache), extent(ext_now), extent_base(ext_b), index_base(idx_b), offset(off) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(off, idx_b, ext_now, ext_b);
+#endif
+    }
   
     acc_buffer_t cache;
     Concurrency::extent<N> extent;
@@ -4782,6 +4825,36 @@ struct copy_bidir<T, N, N>
     }
 };
 
+/**
+ * Copy the section of extent ext at srcIdx within a view of extent srcBase to
+ * the one at dstIdx within a view of extent dstBase. Trivially copyable
+ * elements go through the copy planner of the runtime, which merges rows that
+ * are contiguous on both sides and spreads large copies over threads.
+ */
+template <typename T, int N>
+static inline void copy_section(const T* src, const extent<N>& srcBase, const index<N>& srcIdx,
+                                T* dst, const extent<N>& dstBase, const index<N>& dstIdx,
+                                const extent<N>& ext) {
+    if (!std::is_trivially_copyable<T>::value) {
+        copy_bidir<T, N, 1>()(src, dst, ext, srcBase, srcIdx, dstBase, dstIdx);
+        return;
+    }
+    size_t count[N], srcPitch[N], dstPitch[N];
+    size_t srcStride = sizeof(T), dstStride = sizeof(T);
+    const char* from = reinterpret_cast<const char*>(src);
+    char* to = reinterpret_cast<char*>(dst);
+    for (int i = N - 1; i >= 0; --i) {
+        count[i] = ext[i];
+        srcPitch[i] = srcStride;
+        dstPitch[i] = dstStride;
+        from += srcIdx[i] * srcStride;
+        to += dstIdx[i] * dstStride;
+        srcStride *= srcBase[i];
+        dstStride *= dstBase[i];
+    }
+    Kalmar::CLAMP::copy_strided(from, to, N, count, srcPitch, dstPitch);
+}
+
 template <typename Iter, typename T, int N>
 struct do_copy
 {
@@ -4902,7 +4975,7 @@ void copy(const array<T, N>& src, const array_view<T, N>& dest) {
         T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
         T* p = pSrc;
         T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
-        copy_input<T*, T, N, 1>()(pSrc, pDst, dest.extent, dest.extent_base, dest.index_base);
+        copy_section(pSrc, dest.extent, index<N>(), pDst, dest.extent_base, dest.index_base, dest.extent);
         dest.internal().unmap_ptr(pDst, destModify, destSize, destOffset);
         src.internal().unmap_ptr(p, srcModify, srcSize, srcOffset);
     }
@@ -4944,7 +5017,7 @@ void copy(const array_view<const T, N>& src, array<T, N>& dest) {
         T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
         T* p = pDst;
         const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
-        copy_output<T*, T, N, 1>()(pSrc, pDst, src.extent, src.extent_base, src.index_base);
+        copy_section(pSrc, src.extent_base, src.index_base, pDst, src.extent, index<N>(), src.extent);
         src.internal().unmap_ptr(pSrc, srcModify, srcSize, srcOffset);
         dest.internal().unmap_ptr(p, destModify, destSize, destOffset);
     }
@@ -4993,7 +5066,7 @@ void copy(const array_view<const T, N>& src, const array_view<T, N>& dest) {
             const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
             const T* p = pSrc;
             T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
-            copy_input<const T*, T, N, 1>()(pSrc, pDst, dest.extent, dest.extent_base, dest.index_base);
+            copy_section(pSrc, dest.extent, index<N>(), pDst, dest.extent_base, dest.index_base, dest.extent);
             dest.internal().unmap_ptr(pDst, destModify, destSize, destOffset);
             src.internal().unmap_ptr(p, srcModify, srcSize, srcOffset);
         }
@@ -5010,7 +5083,7 @@ void copy(const array_view<const T, N>& src, const array_view<T, N>& dest) {
             T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
             T* p = pDst;
             const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
-            copy_output<T*, T, N, 1>()(pSrc, pDst, src.extent, src.extent_base, src.index_base);
+            copy_section(pSrc, src.extent_base, src.index_base, pDst, src.extent, index<N>(), src.extent);
             dest.internal().unmap_ptr(p, destModify, destSize, destOffset);
             src.internal().unmap_ptr(pSrc, srcModify, srcSize, srcOffset);
         } else {
@@ -5024,8 +5097,8 @@ void copy(const array_view<const T, N>& src, const array_view<T, N>& dest) {
 
             const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
             T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
-            copy_bidir<T, N, 1>()(pSrc, pDst, src.extent, src.extent_base,
-                                  src.index_base, dest.extent_base, dest.index_base);
+            copy_section(pSrc, src.extent_base, src.index_base,
+                         pDst, dest.extent_base, dest.index_base, src.extent);
             dest.internal().unmap_ptr(pDst, destModify, destSize, destOffset);
             src.internal().unmap_ptr(pSrc, srcModify, srcSize, srcOffset);
         }
@@ -95,6 +95,50 @@ inline uint64_t get_tick_frequency() {
     return Kalmar::getContext()->getSystemTickFrequency();
 }
 
+/**
+ * Counters of the data transfers done to keep the copies of arrays and
+ * array_views on the host and the accelerators coherent.
+ *
+ * The coherence is tracked per chunk of the data, so only the chunks modified
+ * since the last transfer are copied.
+ */
+struct coherence_stats {
+    /// bytes copied to bring stale copies up to date
+    uint64_t bytes_copied;
+    /// bytes of the same copies which were still up to date and not copied
+    uint64_t bytes_skipped;
+    /// number of transfers issued
+    uint64_t transfers;
+    /// bytes of buffers shared by the host and unified accelerators rather
+    /// than allocated for each of them
+    uint64_t bytes_aliased;
+};
+
+/**
+ * Counters of the kernel argument segments used by the dispatches on an
+ * accelerator.
+ *
+ * Each queue keeps pools of segments, recycled once the dispatches using
+ * them have completed.
+ */
+struct kernarg_stats {
+    /// segments reused from a pool
+    uint64_t hits;
+    /// segments the pools were grown by
+    uint64_t grown;
+    /// segments too large for the pools, allocated for a single dispatch
+    uint64_t oversized;
+};
+
+/**
+ * Get the transfers done so far by all arrays and array_views.
+ */
+inline coherence_stats get_coherence_stats() {
+    Kalmar::SyncStats& stats = Kalmar::getContext()->syncStats;
+    return { stats.bytesCopied.load(), stats.bytesSkipped.load(), stats.transfers.load(),
+             stats.bytesAliased.load() };
+}
+
 #define GET_SYMBOL_ADDRESS(acc, symbol) \
     acc.get_symbol_address( #symbol );
 
@@ -228,6 +272,30 @@ public:
      */
     void flush() { pQueue->flush(); }
 
+    /**
+     * Starts a batch of commands on the accelerator view.
+     *
+     * Kernel dispatches and markers inserted into the accelerator view until
+     * the matching end_batch() are held back and sent to the device together,
+     * which saves most of the cost of sending each of them on its own when
+     * many short kernels are launched back to back. The batch is sent early
+     * when it grows large, when flush() is called, and before the host waits
+     * on the accelerator view or on one of the commands in the batch, or
+     * copies data through the accelerator view. Until the batch is sent,
+     * completion_future::is_ready() keeps returning false for its commands.
+     *
+     * Batches may nest, the outermost end_batch() sends the commands. On
+     * accelerator views which do not support batching this function has no
+     * effect.
+     */
+    void begin_batch() { pQueue->beginBatch(); }
+
+    /**
+     * Ends a batch of commands started with begin_batch(), and sends the
+     * commands of the outermost batch to the device.
+     */
+    void end_batch() { pQueue->endBatch(); }
+
     /**
      * This command inserts a marker event into the accelerator_view's command
      * queue. This marker is returned as a completion_future object. When all
@@ -454,7 +522,7 @@ private:
   
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template <typename Kernel, int N> friend
-        completion_future launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>&, Kernel const&, extent<N> const&);
+        std::shared_ptr<Kalmar::KalmarAsyncOp> launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>&, Kernel const&, extent<N> const&);
 #endif
 
     // non-tiled parallel_for_each
@@ -831,15 +899,30 @@ public:
         return pDev->getProfile();
     }
 
+    /**
+     * Returns the kernel argument segments used so far by the dispatches on
+     * the accelerator. Only accelerators based on HSA use them.
+     */
+    kernarg_stats get_kernarg_stats() const {
+        Kalmar::KernargStats& stats = pDev->kernargStats;
+        return { stats.hits.load(), stats.grown.load(), stats.oversized.load() };
+    }
+
+    // kernels are built when first launched, the symbols of the program may
+    // be used before that
+
     void memcpy_symbol(const char* symbolName, void* hostptr, size_t count, size_t offset = 0, hcCommandKind kind = hcMemcpyHostToDevice) {
+        Kalmar::CLAMP::BuildProgram(pDev);
         pDev->memcpySymbol(symbolName, hostptr, count, offset, kind);
     }
 
     void memcpy_symbol(void* symbolAddr, void* hostptr, size_t count, size_t offset = 0, hcCommandKind kind = hcMemcpyHostToDevice) {
+        Kalmar::CLAMP::BuildProgram(pDev);
         pDev->memcpySymbol(symbolAddr, hostptr, count, offset, kind);
     }
 
     void* get_symbol_address(const char* symbolName) {
+        Kalmar::CLAMP::BuildProgram(pDev);
         return pDev->getSymbolAddress(symbolName);
     }
 
@@ -1031,7 +1114,7 @@ public:
                 __asyncOp->setWaitMode(mode);
             }   
             //TODO-ASYNC - need to reclaim older AsyncOps here.
-            __amp_future.wait();
+            Kalmar::CLAMP::cpu_wait(__amp_future);
         }
     }
 
@@ -1211,29 +1294,8 @@ private:
         completion_future parallel_for_each(const accelerator_view&, const tiled_extent<1>&, const Kernel&);
 
     // copy_async
-    template <typename T, int N> friend
-        completion_future copy_async(const array_view<const T, N>& src, const array_view<T, N>& dest);
-    template <typename T, int N> friend
-        completion_future copy_async(const array<T, N>& src, array<T, N>& dest);
-    template <typename T, int N> friend
-        completion_future copy_async(const array<T, N>& src, const array_view<T, N>& dest);
-    template <typename T, int N> friend
-        completion_future copy_async(const array_view<T, N>& src, const array_view<T, N>& dest);
-    template <typename T, int N> friend
-        completion_future copy_async(const array_view<const T, N>& src, array<T, N>& dest);
-
-    template <typename InputIter, typename T, int N> friend
-        completion_future copy_async(InputIter srcBegin, InputIter srcEnd, array<T, N>& dest);
-    template <typename InputIter, typename T, int N> friend
-        completion_future copy_async(InputIter srcBegin, InputIter srcEnd, const array_view<T, N>& dest);
-    template <typename InputIter, typename T, int N> friend
-        completion_future copy_async(InputIter srcBegin, array<T, N>& dest);
-    template <typename InputIter, typename T, int N> friend
-        completion_future copy_async(InputIter srcBegin, const array_view<T, N>& dest);
-    template <typename OutputIter, typename T, int N> friend
-        completion_future copy_async(const array<T, N>& src, OutputIter destBegin);
-    template <typename OutputIter, typename T, int N> friend
-        completion_future copy_async(const array_view<T, N>& src, OutputIter destBegin);
+    template <typename Copy, typename... Buffers> friend
+        completion_future __copy_async(hcCommandKind kind, const Copy& copy, const Buffers&... bufs);
 
     // array_view
     template <typename T, int N> friend class array_view;
@@ -1242,6 +1304,54 @@ private:
     friend class accelerator_view;
 };
 
+/**
+ * Whether the memory of a queue is owned by a device rather than the host.
+ */
+inline bool __on_device(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue) {
+    return pQueue && !pQueue->getDev()->is_emulated();
+}
+
+/**
+ * Whether the memory of a buffer is owned by a device rather than the host.
+ */
+template <typename T>
+inline bool __on_device(const Kalmar::_data_host<T>& buf) {
+    return __on_device(buf.get_av());
+}
+
+/**
+ * Direction of a copy from memory on the host or a device to memory on the
+ * host or a device.
+ */
+inline hcCommandKind __copy_kind(bool srcOnDevice, bool dstOnDevice) {
+    if (srcOnDevice)
+        return dstOnDevice ? hcMemcpyDeviceToDevice : hcMemcpyDeviceToHost;
+    return dstOnDevice ? hcMemcpyHostToDevice : hcMemcpyHostToHost;
+}
+
+/**
+ * Run copy on the copy worker of the runtime. The buffers copied are marked
+ * busy with the copy, so host accesses and kernel launches using them wait
+ * for it; the copy itself starts once the operations which were using them
+ * have completed.
+ *
+ * @param[in] kind The direction of the copy, reported by the operation.
+ * @return A completion_future tracking the copy. It rethrows any exception
+ *         thrown by copy.
+ */
+template <typename Copy, typename... Buffers>
+completion_future __copy_async(hcCommandKind kind, const Copy& copy, const Buffers&... bufs) {
+    auto op = std::make_shared<Kalmar::CPUAsyncOp>(kind);
+    std::vector<std::shared_ptr<Kalmar::KalmarAsyncOp>> deps { bufs.exchange_busy(op)... };
+    Kalmar::CLAMP::enqueue_async_copy(op, [op, deps, copy]() {
+        for (auto& dep : deps)
+            if (dep && dep != op)
+                dep->getFuture()->wait();
+        copy();
+    });
+    return completion_future(op);
+}
+
 // ------------------------------------------------------------------------
 // member function implementations
 // ------------------------------------------------------------------------
@@ -2110,7 +2220,8 @@ tiled_extent<3> extent<N>::tile_with_dynamic(int t0, int t1, int t2, int dynamic
 extern "C" unsigned int __wavesize() __HC__; 
 
 
-#if __hcc_backend__==HCC_BACKEND_AMDGPU
+// the CPU path takes the wavefront size from HCC_CPU_WAVEFRONT_SIZE
+#if __hcc_backend__==HCC_BACKEND_AMDGPU && !(__KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2)
 extern "C" inline unsigned int __wavesize() __HC__ {
   return __HSA_WAVEFRONT_SIZE__;
 }
@@ -3044,30 +3155,53 @@ extern "C" __attribute__((address_space(3))) void* get_dynamic_group_segment_bas
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
 template <typename Ker, typename Ti>
-void bar_wrapper(Ker *f, Ti *t)
+void bar_wrapper(void *f, void *t)
 {
-    (*f)(*t);
+    (*static_cast<Ker*>(f))(*static_cast<Ti*>(t));
 }
 
+/// Runs the work-items of one tile as fibers on the calling thread
+///
+/// Fiber 0 is the thread driving the tile, fibers 1..n are the work-items.
+/// wait() passes control from fiber idx to fiber idx - 1; once fiber 1
+/// reaches the barrier control returns to the driver which starts the next
+/// round from fiber n again. A finished work-item falls through to its
+/// predecessor the same way. Cross-lane functions switch between the fibers
+/// of one wavefront in between, see fibers.
 struct barrier_t {
-    std::unique_ptr<ucontext_t[]> ctx;
+    std::unique_ptr<void*[]> sp;
+    std::unique_ptr<void*[]> items;
+    std::unique_ptr<Kalmar::CLAMP::CPULane[]> lanes;
+    void (*call)(void*, void*);
+    void *kernel;
+    Kalmar::CLAMP::CPUTileFibers fibers;
     int idx;
     barrier_t (int a) :
-        ctx(new ucontext_t[a + 1]) {}
+        sp(new void*[a + 1]), items(new void*[a + 1]), lanes(new Kalmar::CLAMP::CPULane[a + 1]()),
+        call(nullptr), kernel(nullptr), fibers{sp.get(), lanes.get(), a, 0} {}
+    static void fiber_main(void *p, void *x) {
+        barrier_t *b = static_cast<barrier_t*>(p);
+        intptr_t id = reinterpret_cast<intptr_t>(x);
+        b->call(b->kernel, b->items[id]);
+        b->fibers.cur = id - 1;
+        __hcc_cpu_fiber_switch(&b->sp[id], b->sp[id - 1]);
+    }
     template <typename Ti, typename Ker>
     void setctx(int x, char *stack, Ker& f, Ti* tidx, int S) {
-        getcontext(&ctx[x]);
-        ctx[x].uc_stack.ss_sp = stack;
-        ctx[x].uc_stack.ss_size = S;
-        ctx[x].uc_link = &ctx[x - 1];
-        makecontext(&ctx[x], (void (*)(void))bar_wrapper<Ker, Ti>, 2, &f, tidx);
+        call = bar_wrapper<Ker, Ti>;
+        kernel = const_cast<void*>(static_cast<const void*>(&f));
+        items[x] = tidx;
+        sp[x] = Kalmar::CLAMP::cpu_fiber_make(stack, S, fiber_main, this,
+                                              reinterpret_cast<void*>(static_cast<intptr_t>(x)));
     }
     void swap(int a, int b) {
-        swapcontext(&ctx[a], &ctx[b]);
+        fibers.cur = b;
+        __hcc_cpu_fiber_switch(&sp[a], sp[b]);
     }
     void wait() __HC__ {
         --idx;
-        swapcontext(&ctx[idx + 1], &ctx[idx]);
+        fibers.cur = idx;
+        __hcc_cpu_fiber_switch(&sp[idx + 1], sp[idx]);
     }
 };
 #endif
@@ -3321,7 +3455,7 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template<typename K> friend
-        void partitioned_task_tile_3D(K const&, tiled_extent<3> const&, int);
+        void partitioned_task_tile_3D(K const&, tiled_extent<3> const&, int, int);
 #endif
 };
 
@@ -3420,7 +3554,7 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template<typename K> friend
-        void partitioned_task_tile_1D(K const&, tiled_extent<1> const&, int);
+        void partitioned_task_tile_1D(K const&, tiled_extent<1> const&, int, int);
 #endif
 };
 
@@ -3519,54 +3653,59 @@ private:
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     template<typename K> friend
-        void partitioned_task_tile_2D(K const&, tiled_extent<2> const&, int);
+        void partitioned_task_tile_2D(K const&, tiled_extent<2> const&, int, int);
 #endif
 };
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
 #define SSIZE 1024 * 10
-template <int N, typename Kernel,  int K>
-struct cpu_helper
-{
-    static inline void call(const Kernel& k, index<K>& idx, const extent<K>& ext) __CPU__ __HC__ {
-        int i;
-        for (i = 0; i < ext[N]; ++i) {
-            idx[N] = i;
-            cpu_helper<N + 1, Kernel, K>::call(k, idx, ext);
-        }
-    }
-};
-template <typename Kernel, int K>
-struct cpu_helper<K, Kernel, K>
-{
-    static inline void call(const Kernel& k, const index<K>& idx, const extent<K>& ext) __CPU__ __HC__ {
-        (const_cast<Kernel&>(k))(idx);
-    }
-};
-
 template <typename Kernel, int N>
-void partitioned_task(const Kernel& ker, const extent<N>& ext, int part) {
-    index<N> idx;
-    int start = ext[0] * part / Kalmar::NTHREAD;
-    int end = ext[0] * (part + 1) / Kalmar::NTHREAD;
-    for (int i = start; i < end; i++) {
-        idx[0] = i;
-        cpu_helper<1, Kernel, N>::call(ker, idx, ext);
+void partitioned_task(const Kernel& ker, const extent<N>& ext, Kalmar::CPUChunkScheduler& sched) {
+    // a copy private to this part; the kernel's stores cannot reach it, so its
+    // captures are loaded once instead of after every store
+    Kernel k(ker);
+    size_t begin, end;
+    while (sched.next(begin, end)) {
+        // delinearize the first work-item of the chunk
+        index<N> idx;
+        size_t rest = begin;
+        for (int i = N - 1; i >= 0; --i) {
+            idx[i] = rest % ext[i];
+            rest /= ext[i];
+        }
+        // walk the chunk one row segment at a time so the innermost
+        // dimension stays contiguous and can be vectorized
+        size_t pos = begin;
+        while (pos < end) {
+            int last = idx[N - 1] + static_cast<int>(
+                std::min<size_t>(end - pos, ext[N - 1] - idx[N - 1]));
+            pos += last - idx[N - 1];
+            Kalmar::cpu_run_row(k, idx, idx[N - 1], last);
+            idx[N - 1] = 0;
+            for (int i = N - 2; i >= 0; --i) {
+                if (++idx[i] < ext[i])
+                    break;
+                idx[i] = 0;
+            }
+        }
     }
 }
 
 template <typename Kernel>
-void partitioned_task_tile_1D(Kernel const& f, tiled_extent<1> const& ext, int part) {
+void partitioned_task_tile_1D(Kernel const& f, tiled_extent<1> const& ext, int part, int parts) {
     int D0 = ext.tile_dim[0];
-    int start = (ext[0] / D0) * part / Kalmar::NTHREAD;
-    int end = (ext[0] / D0) * (part + 1) / Kalmar::NTHREAD;
+    int start = (ext[0] / D0) * part / parts;
+    int end = (ext[0] / D0) * (part + 1) / parts;
     int stride = end - start;
     if (stride == 0)
         return;
-    char *stk = new char[D0 * SSIZE];
-    tiled_index<1> *tidx = new tiled_index<1>[D0];
+    size_t slot;
+    char *stk = Kalmar::CLAMP::cpu_fiber_stacks(D0, SSIZE, &slot);
+    tiled_index<1> *tidx = static_cast<tiled_index<1>*>(
+        Kalmar::CLAMP::cpu_tile_scratch(sizeof(tiled_index<1>) * (D0)));
     tile_barrier::pb_t hc_bar = std::make_shared<barrier_t>(D0);
     tile_barrier tbar(hc_bar);
+    Kalmar::CLAMP::CPUTileFibers *outer = Kalmar::CLAMP::cpu_enter_tile(&hc_bar->fibers);
     for (int tx = start; tx < end; tx++) {
         int id = 0;
         char *sp = stk;
@@ -3574,7 +3713,7 @@ void partitioned_task_tile_1D(Kernel const& f, tiled_extent<1> const& ext, int p
         for (int x = 0; x < D0; x++) {
             new (tip) tiled_index<1>(tx * D0 + x, x, tx, tbar, D0);
             hc_bar->setctx(++id, sp, f, tip, SSIZE);
-            sp += SSIZE;
+            sp += slot;
             ++tip;
         }
         hc_bar->idx = 0;
@@ -3582,24 +3721,27 @@ void partitioned_task_tile_1D(Kernel const& f, tiled_extent<1> const& ext, int p
             hc_bar->idx = id;
             hc_bar->swap(0, id);
         }
+        Kalmar::cpu_destroy_items(tidx, id);
     }
-    delete [] stk;
-    delete [] tidx;
+    Kalmar::CLAMP::cpu_enter_tile(outer);
 }
 
 template <typename Kernel>
-void partitioned_task_tile_2D(Kernel const& f, tiled_extent<2> const& ext, int part) {
+void partitioned_task_tile_2D(Kernel const& f, tiled_extent<2> const& ext, int part, int parts) {
     int D0 = ext.tile_dim[0];
     int D1 = ext.tile_dim[1];
-    int start = (ext[0] / D0) * part / Kalmar::NTHREAD;
-    int end = (ext[0] / D0) * (part + 1) / Kalmar::NTHREAD;
+    int start = (ext[0] / D0) * part / parts;
+    int end = (ext[0] / D0) * (part + 1) / parts;
     int stride = end - start;
     if (stride == 0)
         return;
-    char *stk = new char[D1 * D0 * SSIZE];
-    tiled_index<2> *tidx = new tiled_index<2>[D0 * D1];
+    size_t slot;
+    char *stk = Kalmar::CLAMP::cpu_fiber_stacks(D1 * D0, SSIZE, &slot);
+    tiled_index<2> *tidx = static_cast<tiled_index<2>*>(
+        Kalmar::CLAMP::cpu_tile_scratch(sizeof(tiled_index<2>) * (D0 * D1)));
     tile_barrier::pb_t hc_bar = std::make_shared<barrier_t>(D0 * D1);
     tile_barrier tbar(hc_bar);
+    Kalmar::CLAMP::CPUTileFibers *outer = Kalmar::CLAMP::cpu_enter_tile(&hc_bar->fibers);
 
     for (int tx = 0; tx < ext[1] / D1; tx++)
         for (int ty = start; ty < end; ty++) {
@@ -3611,32 +3753,35 @@ void partitioned_task_tile_2D(Kernel const& f, tiled_extent<2> const& ext, int p
                     new (tip) tiled_index<2>(D1 * tx + x, D0 * ty + y, x, y, tx, ty, tbar, D0, D1);
                     hc_bar->setctx(++id, sp, f, tip, SSIZE);
                     ++tip;
-                    sp += SSIZE;
+                    sp += slot;
                 }
             hc_bar->idx = 0;
             while (hc_bar->idx == 0) {
                 hc_bar->idx = id;
                 hc_bar->swap(0, id);
             }
+            Kalmar::cpu_destroy_items(tidx, id);
         }
-    delete [] stk;
-    delete [] tidx;
+    Kalmar::CLAMP::cpu_enter_tile(outer);
 }
 
 template <typename Kernel>
-void partitioned_task_tile_3D(Kernel const& f, tiled_extent<3> const& ext, int part) {
+void partitioned_task_tile_3D(Kernel const& f, tiled_extent<3> const& ext, int part, int parts) {
     int D0 = ext.tile_dim[0];
     int D1 = ext.tile_dim[1];
     int D2 = ext.tile_dim[2];
-    int start = (ext[0] / D0) * part / Kalmar::NTHREAD;
-    int end = (ext[0] / D0) * (part + 1) / Kalmar::NTHREAD;
+    int start = (ext[0] / D0) * part / parts;
+    int end = (ext[0] / D0) * (part + 1) / parts;
     int stride = end - start;
     if (stride == 0)
         return;
-    char *stk = new char[D2 * D1 * D0 * SSIZE];
-    tiled_index<3> *tidx = new tiled_index<3>[D0 * D1 * D2];
+    size_t slot;
+    char *stk = Kalmar::CLAMP::cpu_fiber_stacks(D2 * D1 * D0, SSIZE, &slot);
+    tiled_index<3> *tidx = static_cast<tiled_index<3>*>(
+        Kalmar::CLAMP::cpu_tile_scratch(sizeof(tiled_index<3>) * (D0 * D1 * D2)));
     tile_barrier::pb_t hc_bar = std::make_shared<barrier_t>(D0 * D1 * D2);
     tile_barrier tbar(hc_bar);
+    Kalmar::CLAMP::CPUTileFibers *outer = Kalmar::CLAMP::cpu_enter_tile(&hc_bar->fibers);
 
     for (int i = 0; i < ext[2] / D2; i++)
         for (int j = 0; j < ext[1] / D1; j++)
@@ -3653,63 +3798,65 @@ void partitioned_task_tile_3D(Kernel const& f, tiled_extent<3> const& ext, int p
                                                               x, y, z, i, j, k, tbar, D0, D1, D2);
                             hc_bar->setctx(++id, sp, f, tip, SSIZE);
                             ++tip;
-                            sp += SSIZE;
+                            sp += slot;
                         }
                 hc_bar->idx = 0;
                 while (hc_bar->idx == 0) {
                     hc_bar->idx = id;
                     hc_bar->swap(0, id);
                 }
+                Kalmar::cpu_destroy_items(tidx, id);
             }
-    delete [] stk;
-    delete [] tidx;
+    Kalmar::CLAMP::cpu_enter_tile(outer);
 }
 
 template <typename Kernel, int N>
-completion_future launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
-                     extent<N> const& compute_domain)
+std::shared_ptr<Kalmar::KalmarAsyncOp>
+launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
+                      extent<N> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task<Kernel, N>, std::cref(f), std::cref(compute_domain), i);
-    // FIXME wrap the above operation into the completion_future object
-    return completion_future();
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto sched = std::make_shared<Kalmar::CPUChunkScheduler>(compute_domain.size(), parts);
+    auto part = [compute_domain, sched](Kernel const& ker, int) __CPU__ {
+        partitioned_task<Kernel, N>(ker, compute_domain, *sched);
+    };
+    return Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part);
 }
 
 template <typename Kernel>
-completion_future launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
-                     tiled_extent<1> const& compute_domain)
+std::shared_ptr<Kalmar::KalmarAsyncOp>
+launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
+                      tiled_extent<1> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task_tile_1D<Kernel>,
-                             std::cref(f), std::cref(compute_domain), i);
-    // FIXME wrap the above operation into the completion_future object
-    return completion_future();
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto part = [compute_domain, parts](Kernel const& ker, int i) __CPU__ {
+        partitioned_task_tile_1D<Kernel>(ker, compute_domain, i, parts);
+    };
+    return Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part);
 }
 
 template <typename Kernel>
-completion_future launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
-                     tiled_extent<2> const& compute_domain)
+std::shared_ptr<Kalmar::KalmarAsyncOp>
+launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
+                      tiled_extent<2> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task_tile_2D<Kernel>,
-                             std::cref(f), std::cref(compute_domain), i);
-    // FIXME wrap the above operation into the completion_future object
-    return completion_future();
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto part = [compute_domain, parts](Kernel const& ker, int i) __CPU__ {
+        partitioned_task_tile_2D<Kernel>(ker, compute_domain, i, parts);
+    };
+    return Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part);
 }
 
 template <typename Kernel>
-completion_future launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
-                     tiled_extent<3> const& compute_domain)
+std::shared_ptr<Kalmar::KalmarAsyncOp>
+launch_cpu_task_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, Kernel const& f,
+                      tiled_extent<3> const& compute_domain)
 {
-    Kalmar::CPUKernelRAII<Kernel> obj(pQueue, f);
-    for (int i = 0; i < Kalmar::NTHREAD; ++i)
-        obj[i] = std::thread(partitioned_task_tile_3D<Kernel>,
-                             std::cref(f), std::cref(compute_domain), i);
-    // FIXME wrap the above operation into the completion_future object
-    return completion_future();
+    int parts = Kalmar::cpu_launch_parts(pQueue);
+    auto part = [compute_domain, parts](Kernel const& ker, int i) __CPU__ {
+        partitioned_task_tile_3D<Kernel>(ker, compute_domain, i, parts);
+    };
+    return Kalmar::launch_cpu_kernel_async(pQueue, f, parts, part);
 }
 
 #endif
@@ -5216,8 +5363,9 @@ public:
      */
     // FIXME: type parameter is not implemented
     completion_future synchronize_async() const {
-        std::future<void> fut = std::async([&]() mutable { synchronize(); });
-        return completion_future(fut.share());
+        array_view view(*this);
+        return __copy_async(__copy_kind(__on_device(cache.get_curr()), __on_device(cache)),
+                            [view]() { view.synchronize(); }, cache);
     }
 
     /**
@@ -5524,14 +5672,22 @@ private:
     // used by view_as and reinterpret_as
     array_view(const acc_buffer_t& cache, const hc::extent<N>& ext,
                int offset) __CPU__ __HC__
-        : cache(cache), extent(ext), extent_base(ext), offset(offset) {}
+        : cache(cache), extent(ext), extent_base(ext), offset(offset) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(offset, index<N>(), ext, ext);
+#endif
+    }
 
     // used by section and projection
     array_view(const acc_buffer_t& cache, const hc::extent<N>& ext_now,
                const hc::extent<N>& ext_b,
                const index<N>& idx_b, int off) __CPU__ __HC__
         : cache(cache), extent(ext_now), extent_base(ext_b), index_base(idx_b),
-        offset(off) {}
+        offset(off) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(off, idx_b, ext_now, ext_b);
+#endif
+    }
   
     acc_buffer_t cache;
     hc::extent<N> extent;
@@ -5831,8 +5987,9 @@ public:
      *         completion of the asynchronous operation.
      */
     completion_future synchronize_async() const {
-        std::future<void> fut = std::async([&]() mutable { synchronize(); });
-        return completion_future(fut.share());
+        array_view view(*this);
+        return __copy_async(__copy_kind(__on_device(cache.get_curr()), __on_device(cache)),
+                            [view]() { view.synchronize(); }, cache);
     }
 
     /**
@@ -6103,14 +6260,22 @@ private:
     // used by view_as and reinterpret_as
     array_view(const acc_buffer_t& cache, const hc::extent<N>& ext,
                int offset) __CPU__ __HC__
-        : cache(cache), extent(ext), extent_base(ext), offset(offset) {}
+        : cache(cache), extent(ext), extent_base(ext), offset(offset) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(offset, index<N>(), ext, ext);
+#endif
+    }
   
     // used by section and projection
     array_view(const acc_buffer_t& cache, const hc::extent<N>& ext_now,
                const extent<N>& ext_b,
                const index<N>& idx_b, int off) __CPU__ __HC__
         : cache(cache), extent(ext_now), extent_base(ext_b), index_base(idx_b),
-        offset(off) {}
+        offset(off) {
+#if __KALMAR_ACCELERATOR__ != 1
+        this->cache.set_range(off, idx_b, ext_now, ext_b);
+#endif
+    }
   
     acc_buffer_t cache;
     hc::extent<N> extent;
@@ -6227,6 +6392,36 @@ struct copy_bidir<T, N, N>
     }
 };
 
+/**
+ * Copy the section of extent ext at srcIdx within a view of extent srcBase to
+ * the one at dstIdx within a view of extent dstBase. Trivially copyable
+ * elements go through the copy planner of the runtime, which merges rows that
+ * are contiguous on both sides and spreads large copies over threads.
+ */
+template <typename T, int N>
+static inline void copy_section(const T* src, const extent<N>& srcBase, const index<N>& srcIdx,
+                                T* dst, const extent<N>& dstBase, const index<N>& dstIdx,
+                                const extent<N>& ext) {
+    if (!std::is_trivially_copyable<T>::value) {
+        copy_bidir<T, N, 1>()(src, dst, ext, srcBase, srcIdx, dstBase, dstIdx);
+        return;
+    }
+    size_t count[N], srcPitch[N], dstPitch[N];
+    size_t srcStride = sizeof(T), dstStride = sizeof(T);
+    const char* from = reinterpret_cast<const char*>(src);
+    char* to = reinterpret_cast<char*>(dst);
+    for (int i = N - 1; i >= 0; --i) {
+        count[i] = ext[i];
+        srcPitch[i] = srcStride;
+        dstPitch[i] = dstStride;
+        from += srcIdx[i] * srcStride;
+        to += dstIdx[i] * dstStride;
+        srcStride *= srcBase[i];
+        dstStride *= dstBase[i];
+    }
+    Kalmar::CLAMP::copy_strided(from, to, N, count, srcPitch, dstPitch);
+}
+
 template <typename Iter, typename T, int N>
 struct do_copy
 {
@@ -6347,7 +6542,7 @@ void copy(const array<T, N>& src, const array_view<T, N>& dest) {
         T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
         T* p = pSrc;
         T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
-        copy_input<T*, T, N, 1>()(pSrc, pDst, dest.extent, dest.extent_base, dest.index_base);
+        copy_section(pSrc, dest.extent, index<N>(), pDst, dest.extent_base, dest.index_base, dest.extent);
         dest.internal().unmap_ptr(pDst, destModify, destSize, destOffset);
         src.internal().unmap_ptr(p, srcModify, srcSize, srcOffset);
     }
@@ -6389,7 +6584,7 @@ void copy(const array_view<const T, N>& src, array<T, N>& dest) {
         T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
         T* p = pDst;
         const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
-        copy_output<T*, T, N, 1>()(pSrc, pDst, src.extent, src.extent_base, src.index_base);
+        copy_section(pSrc, src.extent_base, src.index_base, pDst, src.extent, index<N>(), src.extent);
         src.internal().unmap_ptr(pSrc, srcModify, srcSize, srcOffset);
         dest.internal().unmap_ptr(p, destModify, destSize, destOffset);
     }
@@ -6438,7 +6633,7 @@ void copy(const array_view<const T, N>& src, const array_view<T, N>& dest) {
             const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
             const T* p = pSrc;
             T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
-            copy_input<const T*, T, N, 1>()(pSrc, pDst, dest.extent, dest.extent_base, dest.index_base);
+            copy_section(pSrc, dest.extent, index<N>(), pDst, dest.extent_base, dest.index_base, dest.extent);
             dest.internal().unmap_ptr(pDst, destModify, destSize, destOffset);
             src.internal().unmap_ptr(p, srcModify, srcSize, srcOffset);
         }
@@ -6455,7 +6650,7 @@ void copy(const array_view<const T, N>& src, const array_view<T, N>& dest) {
             T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
             T* p = pDst;
             const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
-            copy_output<T*, T, N, 1>()(pSrc, pDst, src.extent, src.extent_base, src.index_base);
+            copy_section(pSrc, src.extent_base, src.index_base, pDst, src.extent, index<N>(), src.extent);
             dest.internal().unmap_ptr(p, destModify, destSize, destOffset);
             src.internal().unmap_ptr(pSrc, srcModify, srcSize, srcOffset);
         } else {
@@ -6469,8 +6664,8 @@ void copy(const array_view<const T, N>& src, const array_view<T, N>& dest) {
 
             const T* pSrc = src.internal().map_ptr(srcModify, srcSize, srcOffset);
             T* pDst = dest.internal().map_ptr(destModify, destSize, destOffset);
-            copy_bidir<T, N, 1>()(pSrc, pDst, src.extent, src.extent_base,
-                                  src.index_base, dest.extent_base, dest.index_base);
+            copy_section(pSrc, src.extent_base, src.index_base,
+                         pDst, dest.extent_base, dest.index_base, src.extent);
             dest.internal().unmap_ptr(pDst, destModify, destSize, destOffset);
             src.internal().unmap_ptr(pSrc, srcModify, srcSize, srcOffset);
         }
@@ -6607,6 +6802,16 @@ void copy(const array_view<T, N> &src, OutputIter destBegin) {
 // utility function for copy_async
 // ------------------------------------------------------------------------
 
+/**
+ * A view of the whole of an array, captured by the copies of copy_async in
+ * place of the array itself. The copy runs after copy_async returned, and the
+ * view keeps the buffer of the array alive until then.
+ */
+template <typename T, int N>
+array_view<T, N> __copy_view(const array<T, N>& src) {
+    return array_view<T, N>(const_cast<array<T, N>&>(src));
+}
+
 
 // ------------------------------------------------------------------------
 // copy_async
@@ -6622,8 +6827,10 @@ void copy(const array_view<T, N> &src, OutputIter destBegin) {
  */
 template <typename T, int N>
 completion_future copy_async(const array<T, N>& src, array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> srcView = __copy_view(src);
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [srcView, destView]() { copy(srcView, destView); }, src.internal(), dest.internal());
 }
 
 /**
@@ -6635,8 +6842,9 @@ completion_future copy_async(const array<T, N>& src, array<T, N>& dest) {
  */
 template <typename T, int N>
 completion_future copy_async(const array<T, N>& src, const array_view<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> srcView = __copy_view(src);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [srcView, dest]() { copy(srcView, dest); }, src.internal(), dest.internal());
 }
 
 /** @{ */
@@ -6650,14 +6858,16 @@ completion_future copy_async(const array<T, N>& src, const array_view<T, N>& des
  */
 template <typename T, int N>
 completion_future copy_async(const array_view<const T, N>& src, array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [src, destView]() { copy(src, destView); }, src.internal(), dest.internal());
 }
 
 template <typename T, int N>
 completion_future copy_async(const array_view<T, N>& src, array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [src, destView]() { copy(src, destView); }, src.internal(), dest.internal());
 }
 
 /** @} */
@@ -6673,14 +6883,14 @@ completion_future copy_async(const array_view<T, N>& src, array<T, N>& dest) {
  */
 template <typename T, int N>
 completion_future copy_async(const array_view<const T, N>& src, const array_view<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [src, dest]() { copy(src, dest); }, src.internal(), dest.internal());
 }
 
 template <typename T, int N>
 completion_future copy_async(const array_view<T, N>& src, const array_view<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [src, dest]() { copy(src, dest); }, src.internal(), dest.internal());
 }
 
 /** @} */
@@ -6701,14 +6911,16 @@ completion_future copy_async(const array_view<T, N>& src, const array_view<T, N>
  */
 template <typename InputIter, typename T, int N>
 completion_future copy_async(InputIter srcBegin, InputIter srcEnd, array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&, srcBegin, srcEnd]() mutable { copy(srcBegin, srcEnd, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(false, __on_device(dest.internal())),
+                        [srcBegin, srcEnd, destView]() { copy(srcBegin, srcEnd, destView); }, dest.internal());
 }
 
 template <typename InputIter, typename T, int N>
 completion_future copy_async(InputIter srcBegin, array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&, srcBegin]() mutable { copy(srcBegin, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(false, __on_device(dest.internal())),
+                        [srcBegin, destView]() { copy(srcBegin, destView); }, dest.internal());
 }
 
 /** @} */
@@ -6729,14 +6941,14 @@ completion_future copy_async(InputIter srcBegin, array<T, N>& dest) {
  */
 template <typename InputIter, typename T, int N>
 completion_future copy_async(InputIter srcBegin, InputIter srcEnd, const array_view<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&, srcBegin, srcEnd]() mutable { copy(srcBegin, srcEnd, dest); });
-    return completion_future(fut.share());
+    return __copy_async(__copy_kind(false, __on_device(dest.internal())),
+                        [srcBegin, srcEnd, dest]() { copy(srcBegin, srcEnd, dest); }, dest.internal());
 }
 
 template <typename InputIter, typename T, int N>
 completion_future copy_async(InputIter srcBegin, const array_view<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&, srcBegin]() mutable { copy(srcBegin, dest); });
-    return completion_future(fut.share());
+    return __copy_async(__copy_kind(false, __on_device(dest.internal())),
+                        [srcBegin, dest]() { copy(srcBegin, dest); }, dest.internal());
 }
 
 /** @} */
@@ -6753,8 +6965,9 @@ completion_future copy_async(InputIter srcBegin, const array_view<T, N>& dest) {
  */
 template <typename OutputIter, typename T, int N>
 completion_future copy_async(const array<T, N>& src, OutputIter destBegin) {
-    std::future<void> fut = std::async(std::launch::deferred, [&, destBegin]() mutable { copy(src, destBegin); });
-    return completion_future(fut.share());
+    array_view<T, N> srcView = __copy_view(src);
+    return __copy_async(__copy_kind(__on_device(src.internal()), false),
+                        [srcView, destBegin]() { copy(srcView, destBegin); }, src.internal());
 }
 
 /**
@@ -6769,28 +6982,32 @@ completion_future copy_async(const array<T, N>& src, OutputIter destBegin) {
  */
 template <typename OutputIter, typename T, int N>
 completion_future copy_async(const array_view<T, N>& src, OutputIter destBegin) {
-    std::future<void> fut = std::async(std::launch::deferred, [&, destBegin]() mutable { copy(src, destBegin); });
-    return completion_future(fut.share());
+    return __copy_async(__copy_kind(__on_device(src.internal()), false),
+                        [src, destBegin]() { copy(src, destBegin); }, src.internal());
 }
 
 
 // FIXME: consider remove these functions
 template <typename T, int N>
 completion_future copy_async(const array<T, N>& src, const array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> srcView = __copy_view(src);
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [srcView, destView]() { copy(srcView, destView); }, src.internal(), dest.internal());
 }
 
 template <typename T, int N>
 completion_future copy_async(const array_view<const T, N>& src, const array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [src, destView]() { copy(src, destView); }, src.internal(), dest.internal());
 }
 
 template <typename T, int N>
 completion_future copy_async(const array_view<T, N>& src, const array<T, N>& dest) {
-    std::future<void> fut = std::async(std::launch::deferred, [&]() mutable { copy(src, dest); });
-    return completion_future(fut.share());
+    array_view<T, N> destView = __copy_view(dest);
+    return __copy_async(__copy_kind(__on_device(src.internal()), __on_device(dest.internal())),
+                        [src, destView]() { copy(src, destView); }, src.internal(), dest.internal());
 }
 
 // ------------------------------------------------------------------------
@@ -7356,6 +7573,71 @@ private:
         friend struct pfe_helper;
 };
 
+/// The rows [row, row + ext[0]) of a launch over a larger extent
+template <int N, typename Kernel>
+class pfe_offset_wrapper
+{
+public:
+    pfe_offset_wrapper(int row, const Kernel& f) __CPU__ __HC__
+        : row(row), k(f) {}
+    void operator() (index<N> idx) const __CPU__ __HC__ {
+        idx[0] += row;
+        k(idx);
+    }
+private:
+    const int row;
+    const Kernel k;
+};
+
+#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+/// Split a non-tiled launch on pQueue between the CPU and its accelerator
+///
+/// The leading rows run on the CPU queue, the others on pQueue, both at once.
+/// Returns nullptr if the launch is not split: co-execution is off, the extent
+/// is too small, pQueue is on the host itself, or its accelerator does not
+/// share its memory with the host.
+template <int N, typename Kernel>
+std::shared_ptr<Kalmar::KalmarAsyncOp>
+coexec_launch_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue,
+                    const extent<N>& compute_domain, const Kernel& f)
+{
+    static_assert(N <= 3, "only launches of up to 3 dimensions are split");
+    if (!Kalmar::CLAMP::coexec_enabled() || Kalmar::CLAMP::in_cpu_kernel() ||
+        compute_domain[0] < 2 || compute_domain.size() < COEXEC_MIN_SIZE ||
+        Kalmar::is_cpu_queue(pQueue) || !pQueue->getDev()->is_unified())
+        return nullptr;
+
+    // learned separately for every kernel
+    static Kalmar::CoexecRatio ratio;
+    const int cpuRows = ratio.split(compute_domain[0]);
+    extent<N> cpuDomain(compute_domain);
+    extent<N> accDomain(compute_domain);
+    cpuDomain[0] = cpuRows;
+    accDomain[0] = compute_domain[0] - cpuRows;
+    auto launch = std::make_shared<Kalmar::CoexecLaunch<Kernel>>(f, ratio, cpuDomain[0], accDomain[0]);
+
+    // the CPU half goes first: the accelerator half then finds the buffers
+    // on the CPU, whose launches it does not have to wait for
+    launch->start(true);
+    std::shared_ptr<Kalmar::KalmarAsyncOp> cpuHalf =
+        launch_cpu_task_async(Kalmar::get_cpu_queue(), f, cpuDomain);
+    launch->unmark_busy();
+
+    const pfe_offset_wrapper<N, Kernel> _pf(cpuRows, f);
+    std::shared_ptr<Kalmar::KalmarAsyncOp> accHalf;
+    launch->start(false);
+    if (is_cpu()) {
+        accHalf = launch_cpu_task_async(pQueue, _pf, accDomain);
+    } else {
+        size_t ext[3];
+        for (int i = 0; i < N; ++i)
+            ext[i] = static_cast<size_t>(accDomain[N - 1 - i]);
+        accHalf = Kalmar::mcw_cxxamp_launch_kernel_async<pfe_offset_wrapper<N, Kernel>, N>(pQueue, ext, NULL, _pf);
+    }
+    return Kalmar::CoexecLaunch<Kernel>::join(launch, cpuHalf, accHalf, is_cpu());
+}
+#endif
+
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wreturn-type"
 #pragma clang diagnostic ignored "-Wunused-variable"
@@ -7380,7 +7662,7 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
         static_cast<size_t>(compute_domain[N - 3])};
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
     if (is_cpu()) {
-        return launch_cpu_task_async(av.pQueue, f, compute_domain);
+        return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
     }
 #endif
     if (av.get_accelerator().get_device_path() == L"cpu") {
@@ -7416,8 +7698,12 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   if (static_cast<size_t>(compute_domain[0]) > 4294967295L)
     throw invalid_compute_domain("Extent size too large.");
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+    std::shared_ptr<Kalmar::KalmarAsyncOp> coexec = coexec_launch_async(av.pQueue, compute_domain, f);
+    if (coexec) {
+        return completion_future(coexec);
+    }
     if (is_cpu()) {
-        return launch_cpu_task_async(av.pQueue, f, compute_domain);
+        return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
     }
 #endif
   size_t ext = compute_domain[0];
@@ -7430,6 +7716,10 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   //this triggers the trampoline code being emitted
   auto foo = &Kernel::__cxxamp_trampoline;
   auto bar = &Kernel::operator();
+#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+  // the accelerator half of a launch split with the CPU
+  auto qq = &pfe_offset_wrapper<1, Kernel>::__cxxamp_trampoline;
+#endif
 #endif
 }
 #pragma clang diagnostic pop
@@ -7453,8 +7743,12 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   if (static_cast<size_t>(compute_domain[1]) > 4294967295L)
     throw invalid_compute_domain("Extent size too large.");
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+    std::shared_ptr<Kalmar::KalmarAsyncOp> coexec = coexec_launch_async(av.pQueue, compute_domain, f);
+    if (coexec) {
+        return completion_future(coexec);
+    }
     if (is_cpu()) {
-        return launch_cpu_task_async(av.pQueue, f, compute_domain);
+        return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
     }
 #endif
   size_t ext[2] = {static_cast<size_t>(compute_domain[1]),
@@ -7468,6 +7762,10 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   //this triggers the trampoline code being emitted
   auto foo = &Kernel::__cxxamp_trampoline;
   auto bar = &Kernel::operator();
+#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+  // the accelerator half of a launch split with the CPU
+  auto qq = &pfe_offset_wrapper<2, Kernel>::__cxxamp_trampoline;
+#endif
 #endif
 }
 #pragma clang diagnostic pop
@@ -7493,8 +7791,12 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   if (static_cast<size_t>(compute_domain[2]) > 4294967295L)
     throw invalid_compute_domain("Extent size too large.");
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+    std::shared_ptr<Kalmar::KalmarAsyncOp> coexec = coexec_launch_async(av.pQueue, compute_domain, f);
+    if (coexec) {
+        return completion_future(coexec);
+    }
     if (is_cpu()) {
-        return launch_cpu_task_async(av.pQueue, f, compute_domain);
+        return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
     }
 #endif
   size_t ext[3] = {static_cast<size_t>(compute_domain[2]),
@@ -7509,6 +7811,10 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   //this triggers the trampoline code being emitted
   auto foo = &Kernel::__cxxamp_trampoline;
   auto bar = &Kernel::operator();
+#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+  // the accelerator half of a launch split with the CPU
+  auto qq = &pfe_offset_wrapper<3, Kernel>::__cxxamp_trampoline;
+#endif
 #endif
 }
 #pragma clang diagnostic pop
@@ -7533,7 +7839,7 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
   size_t tile = compute_domain.tile_dim[0];
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
   if (is_cpu()) {
-      return launch_cpu_task_async(av.pQueue, f, compute_domain);
+      return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
   } else
 #endif
   if (av.get_accelerator().get_device_path() == L"cpu") {
@@ -7575,7 +7881,7 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
                      static_cast<size_t>(compute_domain.tile_dim[0]) };
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
   if (is_cpu()) {
-      return launch_cpu_task_async(av.pQueue, f, compute_domain);
+      return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
   } else
 #endif
   if (av.get_accelerator().get_device_path() == L"cpu") {
@@ -7621,7 +7927,7 @@ __attribute__((noinline,used)) completion_future parallel_for_each(
                      static_cast<size_t>(compute_domain.tile_dim[0]) };
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
   if (is_cpu()) {
-      return launch_cpu_task_async(av.pQueue, f, compute_domain);
+      return completion_future(launch_cpu_task_async(av.pQueue, f, compute_domain));
   } else
 #endif
   if (av.get_accelerator().get_device_path() == L"cpu") {
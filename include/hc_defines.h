@@ -2,15 +2,19 @@
 
 // C++ headers
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
+#include <functional>
 #include <future>
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <thread>
@@ -18,11 +22,6 @@
 #include <utility>
 #include <vector>
 
-// CPU execution path
-#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
-#include <ucontext.h>
-#endif
-
 namespace hc {
   typedef __fp16 half;
 }
@@ -42,6 +42,8 @@ public:
     void read(T*, int , int offset = 0) const {}
     void refresh() const {}
     void set_const() const {}
+    template <typename Index, typename Extent>
+    void set_range(int offset, const Index& idx, const Extent& ext, const Extent& base) {}
     access_type get_access() const { return access_type_auto; }
     std::shared_ptr<KalmarQueue> get_stage() const { return nullptr; }
 
@@ -53,24 +55,47 @@ template <typename T>
 class _data_host {
     mutable std::shared_ptr<rw_info> mm;
     bool isArray;
+    /// bytes of the buffer the view holding this can access
+    size_t rangeOffset;
+    size_t rangeSize;
     template <typename U> friend class _data_host;
 public:
     _data_host(size_t count, const void* src = nullptr)
         : mm(std::make_shared<rw_info>(count*sizeof(T), const_cast<void*>(src))),
-        isArray(false) {}
+        isArray(false), rangeOffset(0), rangeSize(SIZE_MAX) {}
 
     _data_host(std::shared_ptr<KalmarQueue> av, std::shared_ptr<KalmarQueue> stage, int count,
                access_type mode)
-        : mm(std::make_shared<rw_info>(av, stage, count*sizeof(T), mode)), isArray(true) {}
+        : mm(std::make_shared<rw_info>(av, stage, count*sizeof(T), mode)), isArray(true),
+        rangeOffset(0), rangeSize(SIZE_MAX) {}
 
     _data_host(std::shared_ptr<KalmarQueue> av, std::shared_ptr<KalmarQueue> stage, int count,
                void* device_pointer, access_type mode)
-        : mm(std::make_shared<rw_info>(av, stage, count*sizeof(T), device_pointer, mode)), isArray(true) {}
+        : mm(std::make_shared<rw_info>(av, stage, count*sizeof(T), device_pointer, mode)), isArray(true),
+        rangeOffset(0), rangeSize(SIZE_MAX) {}
 
-    _data_host(const _data_host& other) : mm(other.mm), isArray(false) {}
+    _data_host(const _data_host& other)
+        : mm(other.mm), isArray(false), rangeOffset(other.rangeOffset), rangeSize(other.rangeSize) {}
 
     template <typename U>
-        _data_host(const _data_host<U>& other) : mm(other.mm), isArray(false) {}
+        _data_host(const _data_host<U>& other)
+        : mm(other.mm), isArray(false), rangeOffset(other.rangeOffset), rangeSize(other.rangeSize) {}
+
+    /// limit the range to the elements a view of extent ext at idx within a
+    /// view of extent base starting at element offset can access, i.e. the
+    /// ones from its first to its last element
+    template <typename Index, typename Extent>
+    void set_range(int offset, const Index& idx, const Extent& ext, const Extent& base) {
+        if (ext.size() == 0)
+            return;
+        Index last = idx;
+        for (int i = 0; i < Index::rank; ++i)
+            last[i] += ext[i] - 1;
+        size_t first = offset + amp_helper<Index::rank, Index, Extent>::flatten(idx, base);
+        size_t end = offset + amp_helper<Index::rank, Index, Extent>::flatten(last, base) + 1;
+        rangeOffset = first * sizeof(T);
+        rangeSize = (end - first) * sizeof(T);
+    }
 
     T *get() const { return static_cast<T*>(mm->data); }
     T* get_device_pointer() const { return static_cast<T*>(mm->get_device_pointer()); }
@@ -79,9 +104,10 @@ public:
     void refresh() const {}
     size_t size() const { return mm->count; }
     void reset() const { mm.reset(); }
-    void get_cpu_access(bool modify = false) const { mm->get_cpu_access(modify); }
+    void get_cpu_access(bool modify = false) const { mm->get_cpu_access(modify, rangeOffset, rangeSize); }
     std::shared_ptr<KalmarQueue> get_av() const { return mm->master; }
     std::shared_ptr<KalmarQueue> get_stage() const { return mm->stage; }
+    std::shared_ptr<KalmarQueue> get_curr() const { return mm->curr; }
     access_type get_access() const { return mm->mode; }
     void copy(_data_host<T> other, int src_offset, int dst_offset, int size) const {
         mm->copy(other.mm.get(), src_offset * sizeof(T), dst_offset * sizeof(T), size * sizeof(T));
@@ -97,10 +123,13 @@ public:
     }
     void unmap_ptr(const void* addr, bool modify, size_t count, size_t offset) const { return mm->unmap(const_cast<void*>(addr), count * sizeof(T), offset * sizeof(T), modify); }
     void sync_to(std::shared_ptr<KalmarQueue> pQueue) const { mm->sync(pQueue, false); }
+    std::shared_ptr<KalmarAsyncOp> exchange_busy(const std::shared_ptr<KalmarAsyncOp>& op) const {
+        return mm->exchange_busy(op);
+    }
 
     __attribute__((annotate("serialize")))
         void __cxxamp_serialize(Serialize& s) const {
-            s.visit_buffer(mm.get(), !std::is_const<T>::value, isArray);
+            s.visit_buffer(mm.get(), !std::is_const<T>::value, isArray, rangeOffset, rangeSize);
         }
     __attribute__((annotate("user_deserialize")))
         explicit _data_host(typename std::remove_const<T>::type* t) {}
@@ -11,35 +11,361 @@
 #include "kalmar_runtime.h"
 #include "kalmar_serialize.h"
 
+#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+/// save the current fiber into *save_sp and resume the one saved at load_sp
+extern "C" void __hcc_cpu_fiber_switch(void** save_sp, void* load_sp);
+#endif
+
 namespace Kalmar {
 template <int D0, int D1=0, int D2=0> class tiled_extent;
+template <int N> class index;
+
+namespace CLAMP {
+/// What a work-item last handed to the other lanes of its wavefront
+///
+/// Cross-lane operations alternate between two slots, so a lane may already
+/// publish the operand of its next operation while slower lanes of the same
+/// wavefront still read the current one.
+struct CPULane
+{
+    int value[2];
+    int index[2];
+    unsigned int phase;
+};
+
+/// The work-items of a tile running on the CPU path
+///
+/// sp[0] is the thread driving the tile, sp[1] ... sp[count] the fibers of
+/// the work-items in flattened local index order, lanes[1] ... lanes[count]
+/// their cross-lane slots. cur is the fiber running right now.
+struct CPUTileFibers
+{
+    void** sp;
+    CPULane* lanes;
+    int count;
+    int cur;
+};
+} // namespace CLAMP
 
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
-static const unsigned int NTHREAD = std::thread::hardware_concurrency();
+namespace CLAMP {
+/// prepare a fiber on the given stack which runs entry(arg0, arg1) when first
+/// switched to, returns its initial stack pointer
+extern void* cpu_fiber_make(char* stack, size_t size,
+                            void (*entry)(void*, void*), void* arg0, void* arg1);
 
-template <typename Kernel>
-class CPUKernelRAII
+/// make tile the one the cross-lane functions of the calling thread work on,
+/// returns the previous one
+extern CPUTileFibers* cpu_enter_tile(CPUTileFibers* tile);
+} // namespace CLAMP
+
+/// minimum number of work-items in one chunk of a non-tiled CPU kernel
+#define CPU_CHUNK_GRAIN (64)
+
+/// Hands out contiguous ranges of a row-major flattened index space
+///
+/// Chunks are scheduled in a guided fashion: they start large and shrink as
+/// the index space drains, so skewed per-item work is balanced across the
+/// workers. Every chunk is a multiple of CPU_CHUNK_GRAIN work-items, hence
+/// every chunk also starts on a multiple of it.
+class CPUChunkScheduler
+{
+    std::atomic<size_t> cursor;
+    const size_t total;
+    const size_t parts;
+public:
+    CPUChunkScheduler(size_t total, int parts)
+        : cursor(0), total(total), parts(parts > 0 ? parts : 1) {}
+
+    /// grab the next chunk [begin, end), returns false once the space is drained
+    bool next(size_t& begin, size_t& end) {
+        size_t cur = cursor.load(std::memory_order_relaxed);
+        while (cur < total) {
+            size_t chunk = (total - cur) / (2 * parts);
+            chunk = (chunk + CPU_CHUNK_GRAIN - 1) / CPU_CHUNK_GRAIN * CPU_CHUNK_GRAIN;
+            if (chunk == 0)
+                chunk = CPU_CHUNK_GRAIN;
+            if (cursor.compare_exchange_weak(cur, cur + chunk, std::memory_order_relaxed)) {
+                begin = cur;
+                end = std::min(total, cur + chunk);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/// destroy the n objects constructed in place at items
+template <typename T>
+static inline void cpu_destroy_items(T* items, int n)
+{
+    for (int i = 0; i < n; ++i)
+        items[i].~T();
+}
+
+/// Run the work-items row[N - 1] = first ... last - 1 of one row
+///
+/// The kernel is taken by a private copy of the caller and every iteration
+/// builds its own index, so after inlining the loop carries no dependency
+/// other than the innermost coordinate. The copy is local, so the kernel's
+/// stores cannot modify its captures and they can be kept in registers. The
+/// captured pointers are the same as in the launch's copy and may still
+/// alias each other; the vectorizer checks that at run time. This lets it
+/// turn element-wise kernels into SIMD code, running several consecutive
+/// work-items per instruction.
+template <typename Kernel, int N>
+static inline void cpu_run_row(Kernel& ker, const index<N>& row, int first, int last)
+{
+#pragma clang loop vectorize(enable) interleave(enable)
+    for (int i = first; i < last; ++i) {
+        index<N> lane(row);
+        lane[N - 1] = i;
+        ker(lane);
+    }
+}
+
+/// One in-flight CPU kernel launch
+///
+/// The launch owns a copy of the kernel so it outlives the parallel_for_each
+/// call. Buffers are synchronized to the CPU when the launch is created, on
+/// the launching thread; the parts then run on the thread pool once the
+/// operations queued before it on pQueue have completed, and the thread
+/// finishing the last part restores the buffers and completes op.
+template <typename Kernel, typename Part>
+class CPUKernelLaunch
 {
     const std::shared_ptr<Kalmar::KalmarQueue> pQueue;
-    const Kernel& f;
-    std::vector<std::thread> th;
+    const Kernel f;
+    /// part(f, i) executes part i of the launch
+    const Part part;
+    const int parts;
+    const std::shared_ptr<CPUAsyncOp> op;
+
+    static void run_part(void* launch, int i) {
+        CPUKernelLaunch* self = static_cast<CPUKernelLaunch*>(launch);
+        CLAMP::enter_kernel();
+        self->part(self->f, i);
+        CLAMP::leave_kernel();
+    }
+
+    static void finish(void* launch) {
+        CPUKernelLaunch* self = static_cast<CPUKernelLaunch*>(launch);
+        std::shared_ptr<CPUAsyncOp> done = self->op;
+        CLAMP::enter_kernel();
+        {
+            CPUVisitor vis(self->pQueue);
+            Serialize s(&vis);
+            self->f.__cxxamp_serialize(s);
+            vis.release_busy(done);
+        }
+        CLAMP::leave_kernel();
+        // drop the references the kernel copy holds before reporting completion
+        delete self;
+        done->complete();
+    }
+
 public:
-    CPUKernelRAII(const std::shared_ptr<Kalmar::KalmarQueue> pQueue, const Kernel& f)
-        : pQueue(pQueue), f(f), th(NTHREAD) {
+    CPUKernelLaunch(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue, const Kernel& f,
+                    const Part& part, int parts)
+        : pQueue(pQueue), f(f), part(part), parts(parts),
+          op(std::make_shared<CPUAsyncOp>(hcCommandKernel)) {
         CPUVisitor vis(pQueue);
         Serialize s(&vis);
-        f.__cxxamp_serialize(s);
-        CLAMP::enter_kernel();
+        this->f.__cxxamp_serialize(s);
+        vis.mark_busy(op);
     }
-    std::thread& operator[](int i) { return th[i]; }
-    ~CPUKernelRAII() {
-        for (auto& t : th)
-            if (t.joinable())
-                t.join();
-        CPUVisitor vis(pQueue);
-        Serialize ss(&vis);
-        f.__cxxamp_serialize(ss);
-        CLAMP::leave_kernel();
+
+    /// queue the launch on pQueue, the launch deletes itself once completed
+    std::shared_ptr<KalmarAsyncOp> submit() {
+        std::shared_ptr<KalmarAsyncOp> ret = op;
+        CPUKernelLaunch* self = this;
+        pQueue->EnqueueCPUOp(op, [self]() {
+            CLAMP::cpu_parallel_launch(self->pQueue->getDev()->get_numa_node(),
+                                       self->parts, run_part, finish, self);
+        });
+        return ret;
+    }
+};
+
+/// number of parts a launch on pQueue is split into, one per worker of the
+/// thread pool serving the NUMA node of its device
+static inline int cpu_launch_parts(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue)
+{
+    return CLAMP::cpu_thread_count(pQueue->getDev()->get_numa_node());
+}
+
+/// run part(f, 0) ... part(f, parts - 1) asynchronously on the CPU thread pool
+template <typename Kernel, typename Part>
+std::shared_ptr<KalmarAsyncOp> launch_cpu_kernel_async(const std::shared_ptr<Kalmar::KalmarQueue>& pQueue,
+                                                       const Kernel& f, int parts, const Part& part)
+{
+    return (new CPUKernelLaunch<Kernel, Part>(pQueue, f, part, parts))->submit();
+}
+
+/// work-items a non-tiled launch needs before it is split between the CPU and
+/// its accelerator
+#define COEXEC_MIN_SIZE (1 << 16)
+/// bounds of the share of a split launch given to the CPU
+#define COEXEC_MIN_SHARE (1.0f / 16)
+#define COEXEC_MAX_SHARE (15.0f / 16)
+
+/// Share of the rows of a split launch given to the CPU
+///
+/// There is one per kernel type. Every split launch measures the rows per
+/// second each side achieved, and the share moves halfway towards the one at
+/// which both sides would have finished at the same time.
+class CoexecRatio
+{
+    std::atomic<float> share;
+public:
+    CoexecRatio() : share(0.5f) {}
+
+    /// split rows in two non-empty halves, return the rows of the CPU one
+    size_t split(size_t rows) const {
+        size_t cpuRows = static_cast<size_t>(rows * share.load(std::memory_order_relaxed) + 0.5f);
+        return std::min(std::max(cpuRows, size_t(1)), rows - 1);
+    }
+
+    void update(size_t cpuRows, double cpuTime, size_t accRows, double accTime) {
+        if (cpuTime <= 0 || accTime <= 0)
+            return;
+        double cpuRate = cpuRows / cpuTime;
+        double accRate = accRows / accTime;
+        float target = static_cast<float>(cpuRate / (cpuRate + accRate));
+        float next = (share.load(std::memory_order_relaxed) + target) / 2;
+        share.store(std::min(std::max(next, COEXEC_MIN_SHARE), COEXEC_MAX_SHARE),
+                    std::memory_order_relaxed);
+    }
+};
+
+/// Collect the buffers used by a kernel without synchronizing them
+class BufferCollector : public FunctorBufferWalker
+{
+public:
+    std::vector<struct rw_info*> bufs;
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                      size_t offset, size_t size) override {
+        if (std::find(bufs.begin(), bufs.end(), rw) == bufs.end())
+            bufs.push_back(rw);
+    }
+};
+
+/// One launch split between the CPU and an accelerator
+///
+/// Both halves run at once on the same memory, which is why the accelerator
+/// has to be unified: the rows each half writes are already where the other
+/// half and the host look for them, and merging the halves only leaves the
+/// state of the buffers as the second half's synchronization set it. Until
+/// both halves have completed, the buffers are marked busy with the operation
+/// of the whole launch, and the launch keeps a copy of the kernel, and with it
+/// the buffers, alive.
+template <typename Kernel>
+class CoexecLaunch
+{
+    typedef std::chrono::high_resolution_clock clock;
+
+    std::unique_ptr<const Kernel> f;
+    CoexecRatio& ratio;
+    const size_t cpuRows;
+    const size_t accRows;
+    /// when each half was submitted
+    clock::time_point cpuStart;
+    clock::time_point accStart;
+    /// seconds each half took, written by the thread completing that half
+    double cpuTime;
+    double accTime;
+    std::atomic<int> pending;
+    std::mutex mtx;
+    std::exception_ptr error;
+    std::vector<struct rw_info*> bufs;
+    const std::shared_ptr<CPUAsyncOp> op;
+
+    void arrive(bool cpu, const std::shared_ptr<KalmarAsyncOp>& half, double elapsed) {
+        (cpu ? cpuTime : accTime) = elapsed;
+        try {
+            half->getFuture()->get();
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (!error)
+                error = std::current_exception();
+        }
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        if (!error)
+            ratio.update(cpuRows, cpuTime, accRows, accTime);
+        for (auto rw : bufs)
+            rw->release_busy(op);
+        // drop the references the kernel copy holds before reporting completion
+        f.reset();
+        op->complete(error);
+    }
+
+    /// seconds since start
+    static double since(clock::time_point start) {
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        return elapsed.count();
+    }
+
+    /// seconds half ran on the device by its own timestamps, or since start
+    /// if it has none
+    static double device_time(const std::shared_ptr<KalmarAsyncOp>& half, clock::time_point start) {
+        uint64_t freq = half->getTimestampFrequency();
+        uint64_t begin = half->getBeginTimestamp();
+        uint64_t end = half->getEndTimestamp();
+        if (freq == 0 || end <= begin)
+            return since(start);
+        return static_cast<double>(end - begin) / freq;
+    }
+
+public:
+    CoexecLaunch(const Kernel& f, CoexecRatio& ratio, size_t cpuRows, size_t accRows)
+        : f(new Kernel(f)), ratio(ratio), cpuRows(cpuRows), accRows(accRows),
+          cpuStart(), accStart(), cpuTime(0), accTime(0),
+          pending(2), mtx(), error(), bufs(), op(std::make_shared<CPUAsyncOp>(hcCommandKernel)) {
+        BufferCollector collector;
+        Serialize s(&collector);
+        this->f->__cxxamp_serialize(s);
+        bufs.swap(collector.bufs);
+    }
+
+    /// the half is about to be submitted, its time is measured from now
+    void start(bool cpu) {
+        (cpu ? cpuStart : accStart) = clock::now();
+    }
+
+    /// the half launched first no longer keeps the buffers busy, so the
+    /// second one does not wait for it
+    void unmark_busy() {
+        for (auto rw : bufs)
+            rw->set_busy(nullptr);
+    }
+
+    /// join the halves of the launch, accHalf runs on a CPU queue if accOnCPU
+    /// is set; returns the operation of the whole launch
+    ///
+    /// Completion is chained on the CPU operations. An accelerator half that
+    /// is not one is waited for inline by the thread completing the CPU half,
+    /// and timed by its own timestamps where it has them.
+    static std::shared_ptr<KalmarAsyncOp> join(const std::shared_ptr<CoexecLaunch>& self,
+                                               const std::shared_ptr<KalmarAsyncOp>& cpuHalf,
+                                               const std::shared_ptr<KalmarAsyncOp>& accHalf,
+                                               bool accOnCPU) {
+        std::shared_ptr<KalmarAsyncOp> ret = self->op;
+        for (auto rw : self->bufs)
+            rw->set_busy(ret);
+        if (accOnCPU) {
+            std::static_pointer_cast<CPUAsyncOp>(accHalf)->notify([self, accHalf]() {
+                self->arrive(false, accHalf, since(self->accStart));
+            });
+        }
+        std::static_pointer_cast<CPUAsyncOp>(cpuHalf)->notify([self, cpuHalf, accHalf, accOnCPU]() {
+            self->arrive(true, cpuHalf, since(self->cpuStart));
+            if (!accOnCPU) {
+                accHalf->getFuture()->wait();
+                self->arrive(false, accHalf, device_time(accHalf, self->accStart));
+            }
+        });
+        return ret;
     }
 };
 
@@ -30,12 +30,115 @@ static inline std::string mcw_cxxamp_fixnames(char *f) restrict(cpu) {
     return out;
 }
 
+/// devices whose kernel handles are cached for each kernel type
+#define KERNEL_CACHE_DEVICES (8)
+
+/// Handles of one kernel type on the devices it was launched on
+///
+/// Resolving a kernel by name mangles the name and searches the programs of
+/// the device, so it is done once per device; later launches create their
+/// kernel straight from the handle. Entries are published by count and never
+/// change afterwards, so lookups do not lock.
+class KernelHandleCache
+{
+  struct Entry {
+    KalmarDevice* dev;
+    void* handle;
+  };
+  Entry entries[KERNEL_CACHE_DEVICES];
+  std::atomic<int> count;
+  std::mutex mtx;
+
+  const Entry* find(KalmarDevice* pDev, int n) const {
+    for (int i = 0; i < n; ++i)
+      if (entries[i].dev == pDev)
+        return &entries[i];
+    return nullptr;
+  }
+public:
+  KernelHandleCache() : count(0) {}
+
+  /// set handle to the one of pDev, false if pDev was not looked up yet
+  bool find(KalmarDevice* pDev, void** handle) const {
+    const Entry* entry = find(pDev, count.load(std::memory_order_acquire));
+    if (entry)
+      *handle = entry->handle;
+    return entry != nullptr;
+  }
+
+  /// handles past KERNEL_CACHE_DEVICES devices are not kept
+  void insert(KalmarDevice* pDev, void* handle) {
+    std::lock_guard<std::mutex> lk(mtx);
+    int n = count.load(std::memory_order_relaxed);
+    if (n == KERNEL_CACHE_DEVICES || find(pDev, n))
+      return;
+    entries[n].dev = pDev;
+    entries[n].handle = handle;
+    count.store(n + 1, std::memory_order_release);
+  }
+};
+
+template <typename Kernel>
+static inline void* create_kernel(const std::shared_ptr<KalmarQueue>& pQueue, const Kernel& f)
+{
+  static KernelHandleCache cache;
+  KalmarDevice* pDev = pQueue->getDev();
+  void* handle = nullptr;
+  if (!cache.find(pDev, &handle)) {
+    handle = CLAMP::LookupKernel(mcw_cxxamp_fixnames(f.__cxxamp_trampoline_name()), pQueue.get());
+    cache.insert(pDev, handle);
+  }
+  if (handle)
+    return pDev->CreateKernelFromHandle(handle);
+  // the device creates its kernels by name only
+  return CLAMP::CreateKernel(mcw_cxxamp_fixnames(f.__cxxamp_trampoline_name()), pQueue.get());
+}
+
 template <typename Kernel>
 static void append_kernel(const std::shared_ptr<KalmarQueue>& pQueue, const Kernel& f, void* kernel)
 {
-  Kalmar::BufferArgumentsAppender vis(pQueue, kernel);
-  Kalmar::Serialize s(&vis);
-  f.__cxxamp_serialize(s);
+  // the layout of the arguments only depends on the type of the kernel
+  static const Kalmar::KernargLayout layout(f);
+  // reused by every launch of this kernel type from the thread
+  static thread_local std::vector<char> blob;
+  static thread_local std::vector<void*> modified;
+  blob.resize(layout.size);
+  modified.clear();
+
+  // the runs of the functor are copied right away, a direct kernel needs
+  // nothing else
+  Kalmar::KernargWriter vis(pQueue, layout, f, blob.data(), modified);
+  if (!layout.direct) {
+    Kalmar::Serialize s(&vis);
+    f.__cxxamp_serialize(s);
+    if (!vis.valid()) {
+      // the functor did not serialize as recorded, push what it does now
+      Kalmar::BufferArgumentsAppender vis(pQueue, kernel);
+      Kalmar::Serialize s(&vis);
+      f.__cxxamp_serialize(s);
+      return;
+    }
+  }
+  if (pQueue->PushArgs(kernel, blob.data(), layout.size, layout.slots.size(),
+                       modified.data(), modified.size()))
+    return;
+  for (size_t i = 0; i < layout.slots.size(); ++i) {
+    const Kalmar::KernargLayout::Slot& slot = layout.slots[i];
+    void* ptr = nullptr;
+    if (slot.kind != Kalmar::KernargLayout::Value)
+      memcpy(&ptr, blob.data() + slot.offset, sizeof(void*));
+    switch (slot.kind) {
+      case Kalmar::KernargLayout::Value:
+        CLAMP::PushArg(kernel, i, slot.size, blob.data() + slot.offset);
+        break;
+      case Kalmar::KernargLayout::Pointer:
+        CLAMP::PushArgPtr(kernel, i, slot.size, ptr);
+        break;
+      case Kalmar::KernargLayout::Buffer:
+        pQueue->Push(kernel, i, ptr, slot.modify);
+        break;
+    }
+  }
 }
 
 template <typename Kernel>
@@ -52,7 +155,6 @@ static inline std::shared_ptr<KalmarQueue> get_availabe_que(const Kernel& f)
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-variable"
-static std::set<std::string> __mcw_cxxamp_kernels;
 template<typename Kernel, int dim_ext>
 inline std::shared_ptr<KalmarAsyncOp>
 mcw_cxxamp_launch_kernel_async(const std::shared_ptr<KalmarQueue>& pQueue, size_t *ext,
@@ -63,12 +165,7 @@ mcw_cxxamp_launch_kernel_async(const std::shared_ptr<KalmarQueue>& pQueue, size_
   //this triggers the trampoline code being emitted
   // FIXME: implicitly casting to avoid pointer to int error
   int* foo = reinterpret_cast<int*>(&Kernel::__cxxamp_trampoline);
-  void *kernel = NULL;
-  {
-      std::string transformed_kernel_name =
-          mcw_cxxamp_fixnames(f.__cxxamp_trampoline_name());
-      kernel = CLAMP::CreateKernel(transformed_kernel_name, pQueue.get());
-  }
+  void *kernel = create_kernel(pQueue, f);
   append_kernel(pQueue, f, kernel);
   return pQueue->LaunchKernelAsync(kernel, dim_ext, ext, local_size);
 #endif
@@ -87,12 +184,7 @@ void mcw_cxxamp_launch_kernel(const std::shared_ptr<KalmarQueue>& pQueue, size_t
   //this triggers the trampoline code being emitted
   // FIXME: implicitly casting to avoid pointer to int error
   int* foo = reinterpret_cast<int*>(&Kernel::__cxxamp_trampoline);
-  void *kernel = NULL;
-  {
-      std::string transformed_kernel_name =
-          mcw_cxxamp_fixnames(f.__cxxamp_trampoline_name());
-      kernel = CLAMP::CreateKernel(transformed_kernel_name, pQueue.get());
-  }
+  void *kernel = create_kernel(pQueue, f);
   append_kernel(pQueue, f, kernel);
   pQueue->LaunchKernel(kernel, dim_ext, ext, local_size);
 #endif // __KALMAR_ACCELERATOR__
@@ -109,11 +201,7 @@ inline void* mcw_cxxamp_get_kernel(const std::shared_ptr<KalmarQueue>& pQueue, c
   //this triggers the trampoline code being emitted
   // FIXME: implicitly casting to avoid pointer to int error
   int* foo = reinterpret_cast<int*>(&Kernel::__cxxamp_trampoline);
-  void *kernel = NULL;
-  std::string transformed_kernel_name =
-      mcw_cxxamp_fixnames(f.__cxxamp_trampoline_name());
-  kernel = CLAMP::CreateKernel(transformed_kernel_name, pQueue.get());
-  return kernel;
+  return create_kernel(pQueue, f);
 #else
   return NULL;
 #endif
@@ -145,6 +145,60 @@ private:
 
 };
 
+/// CPUAsyncOp
+///
+/// An operation executed by the CPU path. It is completed by whichever
+/// thread finishes the work; callbacks registered with notify() run on that
+/// thread right after the future becomes ready.
+class CPUAsyncOp final : public KalmarAsyncOp {
+public:
+  CPUAsyncOp(hcCommandKind xCommandKind)
+      : KalmarAsyncOp(xCommandKind), promise(), future(promise.get_future().share()),
+        mtx(), done(false), callbacks() {}
+
+  std::shared_future<void>* getFuture() override { return &future; }
+
+  bool isReady() override {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  /// mark the operation as completed, must be called exactly once; an
+  /// error is rethrown by the future
+  void complete(std::exception_ptr error = nullptr) {
+    if (error)
+      promise.set_exception(error);
+    else
+      promise.set_value();
+    std::vector<std::function<void()>> pending;
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      done = true;
+      pending.swap(callbacks);
+    }
+    for (auto& cb : pending)
+      cb();
+  }
+
+  /// run cb once the operation has completed, right away if it already has
+  void notify(std::function<void()> cb) {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      if (!done) {
+        callbacks.push_back(std::move(cb));
+        return;
+      }
+    }
+    cb();
+  }
+
+private:
+  std::promise<void> promise;
+  std::shared_future<void> future;
+  std::mutex mtx;
+  bool done;
+  std::vector<std::function<void()>> callbacks;
+};
+
 /// KalmarQueue
 /// This is the implementation of accelerator_view
 /// KalamrQueue is responsible for data operations and launch kernel
@@ -160,6 +214,11 @@ public:
   virtual void flush() {}
   virtual void wait(hcWaitMode mode = hcWaitModeBlocked) {}
 
+  /// hold back the commands launched from now on until endBatch(), so they
+  /// can be sent to the device at once; calls may nest
+  virtual void beginBatch() {}
+  virtual void endBatch() {}
+
   // sync kernel launch with dynamic group memory
   virtual void LaunchKernelWithDynamicGroupMemory(void *kernel, size_t dim_ext, size_t *ext, size_t *local_size, size_t dynamic_group_size) {}
 
@@ -189,9 +248,20 @@ public:
   /// unmap host accessible pointer
   virtual void unmap(void* device, void* addr, size_t count, size_t offset, bool modify) = 0;
 
+  /// block until the commands of this queue using device have completed,
+  /// before the memory is accessed without going through this queue
+  virtual void waitForDependentAsyncOps(void* device) {}
+
   /// push device pointer to kernel argument list
   virtual void Push(void *kernel, int idx, void* device, bool modify) = 0;
 
+  /// set all the count arguments of kernel at once from a blob of size bytes,
+  /// laid out by KernargLayout; modified lists the device pointers of the
+  /// buffers the kernel writes. Returns false if the arguments have to be
+  /// pushed one by one instead
+  virtual bool PushArgs(void *kernel, const void* blob, size_t size, int count,
+                        void* const* modified, int modifiedCount) { return false; }
+
   virtual uint32_t GetGroupSegmentSize(void *kernel) { return 0; }
 
   KalmarDevice* getDev() { return pDev; }
@@ -231,6 +301,10 @@ public:
   /// copy src to dst asynchronously
   virtual std::shared_ptr<KalmarAsyncOp> EnqueueAsyncCopy(const void* src, void* dst, size_t size_bytes) { return nullptr; }
 
+  /// append op, executed by the CPU path, to the queue
+  /// start is called once the operations enqueued before op have completed
+  virtual void EnqueueCPUOp(std::shared_ptr<CPUAsyncOp> op, std::function<void()> start) { start(); }
+
   // Copy src to dst synchronously
   virtual void copy(const void *src, void *dst, size_t size_bytes) { }
 
@@ -254,6 +328,19 @@ private:
   execute_order order;
 };
 
+/// Kernel argument segments handed out for the dispatches on a device
+struct KernargStats
+{
+    /// segments reused from the pools of the queues
+    std::atomic<uint64_t> hits;
+    /// segments the pools were grown by
+    std::atomic<uint64_t> grown;
+    /// segments too large for the pools, allocated for a single dispatch
+    std::atomic<uint64_t> oversized;
+
+    KernargStats() : hits(0), grown(0), oversized(0) {}
+};
+
 /// KalmarDevice
 /// This is the base implementation of accelerator
 /// KalmarDevice is responsible for create/release memory on device
@@ -318,6 +405,13 @@ public:
     /// create kernel
     virtual void* CreateKernel(const char* fun, void* size, void* source, bool needsCompilation = true) { return nullptr; }
 
+    /// find or build kernel fun, returns a handle which stays valid as long as
+    /// the device, or nullptr if kernels have to be created by name
+    virtual void* LookupKernel(const char* fun, void* size, void* source, bool needsCompilation = true) { return nullptr; }
+
+    /// create kernel from a handle returned by LookupKernel
+    virtual void* CreateKernelFromHandle(void* handle) { return nullptr; }
+
     /// check if a given kernel is compatible with the device
     virtual bool IsCompatibleKernel(void* size, void* source) { return true; }
 
@@ -335,6 +429,20 @@ public:
         });
         return def;
 #else
+        // each thread remembers the default queues it got, the map shared by
+        // the threads is only searched the first time it asks this device
+        struct TLSQueue {
+            KalmarDevice* dev;
+            std::weak_ptr<KalmarQueue> queue;
+        };
+        static thread_local std::vector<TLSQueue> tlsQueues;
+        for (auto& entry : tlsQueues) {
+            if (entry.dev == this) {
+                if (auto result = entry.queue.lock())
+                    return result;
+            }
+        }
+
         std::thread::id tid = std::this_thread::get_id();
         tlsDefaultQueueMap_mutex.lock();
         if (tlsDefaultQueueMap.find(tid) == tlsDefaultQueueMap.end()) {
@@ -342,6 +450,13 @@ public:
         }
         std::shared_ptr<KalmarQueue> result = tlsDefaultQueueMap[tid];
         tlsDefaultQueueMap_mutex.unlock();
+
+        auto entry = std::find_if(std::begin(tlsQueues), std::end(tlsQueues),
+                                  [&] (const TLSQueue& e) { return e.dev == this; });
+        if (entry != std::end(tlsQueues))
+            entry->queue = result;
+        else
+            tlsQueues.push_back({this, result});
         return result;
 #endif
     }
@@ -370,15 +485,142 @@ public:
     /// get device's compute unit count
     virtual unsigned int get_compute_unit_count() {return 0;}
 
+    /// NUMA node a CPU device is bound to, -1 if it is not bound to any
+    virtual int get_numa_node() const { return -1; }
+
     virtual bool has_cpu_accessible_am() {return false;}
 
+    /// kernel argument segments handed out by the device
+    KernargStats kernargStats;
 };
 
-class CPUQueue final : public KalmarQueue
+namespace CLAMP {
+/// run fn once on a worker of the CPU thread pool and return right away
+extern void cpu_run_async(std::function<void()> fn);
+
+/// on a worker of the CPU thread pool, run queued tasks until ready() holds
+/// and return true; return false right away on any other thread, or in a
+/// work-item of a tiled kernel
+extern bool cpu_help_until(const std::function<bool()>& ready);
+
+/// block until future is ready; a worker of the CPU thread pool runs queued
+/// tasks meanwhile, so a kernel waiting on a launch it made does not keep the
+/// parts of that launch from running
+static inline void cpu_wait(const std::shared_future<void>& future) {
+  cpu_help_until([&future]() {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  });
+  future.wait();
+}
+
+/// run copy on the copy worker of the runtime, op is completed once it
+/// returned; copies run one at a time in submission order
+extern void enqueue_async_copy(std::shared_ptr<CPUAsyncOp> op, std::function<void()> copy);
+extern bool in_async_copy();
+} // namespace CLAMP
+
+class CPUQueue : public KalmarQueue
 {
+  std::mutex opsMutex;
+  /// operations which may still be in flight, in submission order
+  std::vector<std::shared_ptr<CPUAsyncOp>> asyncOps;
+
+  /// drop completed operations, opsMutex must be held
+  void pruneAsyncOps() {
+      asyncOps.erase(std::remove_if(std::begin(asyncOps), std::end(asyncOps),
+                                    [](const std::shared_ptr<CPUAsyncOp>& op) { return op->isReady(); }),
+                     std::end(asyncOps));
+  }
+
 public:
 
-  CPUQueue(KalmarDevice* pDev) : KalmarQueue(pDev) {}
+  CPUQueue(KalmarDevice* pDev) : KalmarQueue(pDev), opsMutex(), asyncOps() {}
+
+  void wait(hcWaitMode mode = hcWaitModeBlocked) override {
+      std::vector<std::shared_ptr<CPUAsyncOp>> ops;
+      {
+          std::lock_guard<std::mutex> lk(opsMutex);
+          ops = asyncOps;
+      }
+      for (auto& op : ops)
+          CLAMP::cpu_wait(*op->getFuture());
+  }
+
+  int getPendingAsyncOps() override {
+      std::lock_guard<std::mutex> lk(opsMutex);
+      pruneAsyncOps();
+      return asyncOps.size();
+  }
+
+  /// operations start in submission order, a CPU queue is always in-order
+  void EnqueueCPUOp(std::shared_ptr<CPUAsyncOp> op, std::function<void()> start) override {
+      std::shared_ptr<CPUAsyncOp> prev;
+      {
+          std::lock_guard<std::mutex> lk(opsMutex);
+          pruneAsyncOps();
+          if (!asyncOps.empty())
+              prev = asyncOps.back();
+          asyncOps.push_back(op);
+      }
+      if (prev)
+          prev->notify(std::move(start));
+      else
+          start();
+  }
+
+  std::shared_ptr<KalmarAsyncOp> EnqueueMarker() override {
+      return EnqueueMarkerWithDependency(0, nullptr);
+  }
+
+  /// the copy runs on the copy worker once the operations queued before it
+  /// have completed; all memory of a CPU queue is host memory
+  std::shared_ptr<KalmarAsyncOp> EnqueueAsyncCopy(const void* src, void* dst, size_t size_bytes) override {
+      auto op = std::make_shared<CPUAsyncOp>(hcMemcpyHostToHost);
+      EnqueueCPUOp(op, [op, src, dst, size_bytes]() {
+          CLAMP::enqueue_async_copy(op, [src, dst, size_bytes]() {
+              memmove(dst, src, size_bytes);
+          });
+      });
+      return op;
+  }
+
+  using KalmarQueue::EnqueueMarkerWithDependency;
+  std::shared_ptr<KalmarAsyncOp> EnqueueMarkerWithDependency(int count, std::shared_ptr<KalmarAsyncOp> *depOps) override {
+      std::vector<std::shared_ptr<KalmarAsyncOp>> deps;
+      for (int i = 0; i < count; ++i)
+          if (depOps[i] && depOps[i]->getFuture() && !depOps[i]->isReady())
+              deps.push_back(depOps[i]);
+      auto marker = std::make_shared<CPUAsyncOp>(hcCommandMarker);
+      EnqueueCPUOp(marker, [marker, deps]() {
+          // CPU operations complete the marker through notify(), the others
+          // are waited for in one task on the CPU thread pool; the last of
+          // them to finish completes the marker
+          std::vector<std::shared_ptr<KalmarAsyncOp>> others;
+          auto remaining = std::make_shared<std::atomic<int>>(1);
+          auto release = [marker, remaining]() {
+              if (remaining->fetch_sub(1) == 1)
+                  marker->complete();
+          };
+          for (auto& dep : deps) {
+              if (auto cpuOp = std::dynamic_pointer_cast<CPUAsyncOp>(dep)) {
+                  ++*remaining;
+                  cpuOp->notify(release);
+              } else {
+                  others.push_back(dep);
+              }
+          }
+          if (others.empty()) {
+              release();
+              return;
+          }
+          CLAMP::cpu_run_async([others, release]() {
+              for (auto& dep : others)
+                  CLAMP::cpu_wait(*dep->getFuture());
+              release();
+          });
+      });
+      return marker;
+  }
 
   void read(void* device, void* dst, size_t count, size_t offset) override {
       if (dst != device)
@@ -423,6 +665,21 @@ public:
     void* CreateKernel(const char* fun, void* size, void* source, bool needsCompilation = true) { return nullptr; }
 };
 
+/// Transfers done by rw_info to keep the copies of a buffer coherent
+struct SyncStats
+{
+    /// bytes copied to bring stale copies up to date
+    std::atomic<uint64_t> bytesCopied;
+    /// bytes of the same copies which were still valid and not transferred
+    std::atomic<uint64_t> bytesSkipped;
+    /// number of transfers issued
+    std::atomic<uint64_t> transfers;
+    /// bytes of buffers shared with the host instead of being allocated
+    std::atomic<uint64_t> bytesAliased;
+
+    SyncStats() : bytesCopied(0), bytesSkipped(0), transfers(0), bytesAliased(0) {}
+};
+
 /// KalmarContext
 /// This is responsible for managing all devices
 /// User will need to add their customize devices
@@ -432,6 +689,7 @@ private:
     //TODO: Think about a system which has multiple CPU socket, e.g. server. In this case,
     //We might be able to assume that only the first device is CPU, or we only mimic one cpu
     //device when constructing KalmarContext.
+    //The CPU runtime adds one device per NUMA node after it, the host device stays unique.
     KalmarDevice* get_default_dev() {
         if (!def) {
             if (Devices.size() <= 1) {
@@ -488,6 +746,9 @@ public:
 
     /// get tick frequency
     virtual uint64_t getSystemTickFrequency() { return 0L; };
+
+    /// transfers done by all rw_info
+    SyncStats syncStats;
 };
 
 KalmarContext *getContext();
@@ -499,9 +760,28 @@ extern bool is_cpu();
 extern bool in_cpu_kernel();
 extern void enter_kernel();
 extern void leave_kernel();
+extern unsigned int cpu_thread_count(int node);
+extern void cpu_parallel_launch(int node, int parts, void (*task)(void*, int),
+                                void (*done)(void*), void* arg);
+extern char* cpu_fiber_stacks(int count, size_t size, size_t* stride);
+extern void* cpu_tile_scratch(size_t size);
+extern void* cpu_kernel_alloc(size_t size);
+extern void cpu_kernel_free(void* ptr, size_t size);
+/// whether large launches are split between the CPU and their accelerator
+extern bool coexec_enabled();
 #endif
 
+
+/// copy a strided region of rank dimensions, with ext[i] elements along
+/// dimension i placed src_pitch[i] and dst_pitch[i] bytes apart; the pitches
+/// of the last dimension are the size of an element
+extern void copy_strided(const void* src, void* dst, int rank, const size_t* ext,
+                         const size_t* src_pitch, const size_t* dst_pitch);
+
 extern void *CreateKernel(std::string, KalmarQueue*);
+extern void *LookupKernel(std::string, KalmarQueue*);
+/// build the kernels of the program on pDev, if they are not built yet
+extern void BuildProgram(KalmarDevice* pDev);
 
 extern void PushArg(void *, int, size_t, const void *);
 extern void PushArgPtr(void *, int, size_t, const void *);
@@ -548,16 +828,112 @@ enum states
     invalid
 };
 
+/// granularity of the coherence tracking in rw_info, in bytes
+#define RW_INFO_CHUNK_SIZE (64 * 1024)
+
+/// A set of the chunks of a buffer, one bit per chunk
+class chunk_set
+{
+    std::vector<uint64_t> bits;
+public:
+    chunk_set() : bits() {}
+    chunk_set(size_t chunks, bool value) : bits((chunks + 63) / 64, value ? ~uint64_t(0) : 0) {}
+
+    bool test(size_t i) const { return (bits[i / 64] >> (i % 64)) & 1; }
+
+    /// set chunks [first, last) to value
+    void assign(size_t first, size_t last, bool value) {
+        for (size_t i = first; i < last; ++i) {
+            if (value)
+                bits[i / 64] |= uint64_t(1) << (i % 64);
+            else
+                bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+        }
+    }
+};
+
 /// buffer information
 /// Used in rw_info, represent cached data for each device
 /// Whenever rw_info is going to be used on device, it will create a buffer at
 /// that device.
 /// @data: device data pointer
-/// @state: used to implement MSI protocol
+/// @valid: used to implement MSI protocol per chunk of RW_INFO_CHUNK_SIZE
+///         bytes, a chunk not in valid is in invalid state on this device,
+///         otherwise it is shared, or modified if no other device holds it
 struct dev_info
 {
     void* data; /// pointer to device data
-    states state; /// state of the data on current device
+    chunk_set valid; /// chunks holding the latest data on current device
+    bool alias; /// data is owned by another device sharing the same memory
+};
+
+/// entries a dev_map holds without allocating
+#define DEV_MAP_INLINE_SIZE (4)
+
+/// The devices a buffer is cached on, with their dev_info
+///
+/// A buffer lives on one to three devices in practice, so the entries are
+/// kept in a flat array which is searched linearly. The first
+/// DEV_MAP_INLINE_SIZE entries are stored inline. Inserting an entry may move
+/// the others.
+class dev_map
+{
+public:
+    typedef std::pair<KalmarDevice*, dev_info> value_type;
+    typedef value_type* iterator;
+
+    dev_map() : entries(inline_entries), n(0), capacity(DEV_MAP_INLINE_SIZE) {}
+    ~dev_map() {
+        if (entries != inline_entries)
+            delete[] entries;
+    }
+    dev_map(const dev_map&) = delete;
+    dev_map& operator=(const dev_map&) = delete;
+
+    iterator begin() { return entries; }
+    iterator end() { return entries + n; }
+
+    iterator find(KalmarDevice* pDev) {
+        for (size_t i = 0; i < n; ++i)
+            if (entries[i].first == pDev)
+                return entries + i;
+        return end();
+    }
+
+    /// the entry of pDev, created empty if there is none
+    dev_info& operator[](KalmarDevice* pDev) {
+        iterator it = find(pDev);
+        if (it != end())
+            return it->second;
+        if (n == capacity)
+            grow();
+        entries[n].first = pDev;
+        return entries[n++].second;
+    }
+
+    void erase(KalmarDevice* pDev) {
+        iterator it = find(pDev);
+        if (it == end())
+            return;
+        if (it != end() - 1)
+            *it = std::move(entries[n - 1]);
+        entries[--n] = value_type();
+    }
+
+private:
+    void grow() {
+        value_type* bigger = new value_type[capacity * 2];
+        std::move(entries, entries + n, bigger);
+        if (entries != inline_entries)
+            delete[] entries;
+        entries = bigger;
+        capacity *= 2;
+    }
+
+    value_type inline_entries[DEV_MAP_INLINE_SIZE];
+    value_type* entries;
+    size_t n;
+    size_t capacity;
 };
 
 /// rw_info is modeled as multiprocessor without shared cache
@@ -587,7 +963,7 @@ struct rw_info
     /// This is used as cache for device buffer
     /// When this rw_info is going to be used(computed) on device,
     /// rw_info will allocate buffer for the device
-    std::map<KalmarDevice*, dev_info> devs;
+    dev_map devs;
     access_type mode;
     /// This will be set if this rw_info is constructed with host pointer
     /// because rw_info cannot free host pointer
@@ -598,6 +974,11 @@ struct rw_info
     /// constructed with a given device pointer.
     bool toReleaseDevPointer;
 
+    /// Completion of the CPU kernel launch or asynchronous copy that is still
+    /// using this buffer, if any. Host side accesses wait for it before
+    /// touching the data.
+    std::shared_ptr<KalmarAsyncOp> busy;
+
 
     /// consruct array_view
     /// According to standard, array_view will be constructed by size, or size with
@@ -606,19 +987,19 @@ struct rw_info
     /// device, set the HostPtr flag to prevent destructor to release it
     rw_info(const size_t count, void* ptr)
         : data(ptr), count(count), curr(nullptr), master(nullptr), stage(nullptr),
-        devs(), mode(access_type_none), HostPtr(ptr != nullptr), toReleaseDevPointer(true) {
+        devs(), mode(access_type_none), HostPtr(ptr != nullptr), toReleaseDevPointer(true), busy() {
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
             /// if array_view is constructed in cpu path kernel
             /// allocate memory for it and do nothing
             if (CLAMP::in_cpu_kernel() && ptr == nullptr) {
-                data = kalmar_aligned_alloc(0x1000, count);
+                data = CLAMP::cpu_kernel_alloc(count);
                 return;
             }
 #endif
             if (ptr) {
                 mode = access_type_read_write;
                 curr = master = get_cpu_queue();
-                devs[curr->getDev()] = {ptr, modified};
+                devs[curr->getDev()] = {ptr, chunks(true)};
             }
         }
 
@@ -630,16 +1011,16 @@ struct rw_info
     ///    If it is not, ignore the stage one, fallback to case 1.
     rw_info(const std::shared_ptr<KalmarQueue>& Queue, const std::shared_ptr<KalmarQueue>& Stage,
             const size_t count, access_type mode_) : data(nullptr), count(count),
-    curr(Queue), master(Queue), stage(nullptr), devs(), mode(mode_), HostPtr(false), toReleaseDevPointer(true) {
+    curr(Queue), master(Queue), stage(nullptr), devs(), mode(mode_), HostPtr(false), toReleaseDevPointer(true), busy() {
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
         if (CLAMP::in_cpu_kernel() && data == nullptr) {
-            data = kalmar_aligned_alloc(0x1000, count);
+            data = CLAMP::cpu_kernel_alloc(count);
             return;
         }
 #endif
         if (mode == access_type_auto)
             mode = curr->getDev()->get_access();
-        devs[curr->getDev()] = {curr->getDev()->create(count, this), modified};
+        devs[curr->getDev()] = {curr->getDev()->create(count, this), chunks(true)};
 
         /// set data pointer, if it is accessible from cpu
         if (is_cpu_queue(curr) || (curr->getDev()->is_unified() && mode != access_type_none))
@@ -647,7 +1028,7 @@ struct rw_info
         if (is_cpu_queue(curr)) {
             stage = Stage;
             if (Stage != curr)
-                devs[stage->getDev()] = {stage->getDev()->create(count, this), invalid};
+                devs[stage->getDev()] = alloc(stage->getDev(), false);
         } else
             /// if curr is not cpu, ignore the stage one
             stage = curr;
@@ -661,10 +1042,10 @@ struct rw_info
     rw_info(const std::shared_ptr<KalmarQueue>& Queue, const std::shared_ptr<KalmarQueue>& Stage,
             const size_t count,
             void* device_pointer,
-            access_type mode_) : data(nullptr), count(count), curr(Queue), master(Queue), stage(nullptr), devs(), mode(mode_), HostPtr(false), toReleaseDevPointer(false) {
+            access_type mode_) : data(nullptr), count(count), curr(Queue), master(Queue), stage(nullptr), devs(), mode(mode_), HostPtr(false), toReleaseDevPointer(false), busy() {
          if (mode == access_type_auto)
              mode = curr->getDev()->get_access();
-         devs[curr->getDev()] = { device_pointer, modified };
+         devs[curr->getDev()] = { device_pointer, chunks(true) };
 
          /// set data pointer, if it is accessible from cpu
          if (is_cpu_queue(curr) || (curr->getDev()->is_unified() && mode != access_type_none))
@@ -672,30 +1053,105 @@ struct rw_info
          if (is_cpu_queue(curr)) {
              stage = Stage;
              if (Stage != curr)
-                 devs[stage->getDev()] = {stage->getDev()->create(count, this), invalid};
+                 devs[stage->getDev()] = alloc(stage->getDev(), false);
          } else
              /// if curr is not cpu, ignore the stage one
              stage = curr;
     }
 
+    /// block until the operation using this buffer has completed
+    /// the copy worker never waits, the copy it runs is the one marked busy
+    void wait_busy() {
+#if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
+        if (CLAMP::in_cpu_kernel())
+            return;
+#endif
+        if (CLAMP::in_async_copy())
+            return;
+        std::shared_ptr<KalmarAsyncOp> op = std::atomic_load(&busy);
+        if (op)
+            op->getFuture()->wait();
+    }
+
+    void set_busy(const std::shared_ptr<KalmarAsyncOp>& op) { std::atomic_store(&busy, op); }
+
+    /// mark the buffer busy with op, return the operation it was busy with
+    std::shared_ptr<KalmarAsyncOp> exchange_busy(const std::shared_ptr<KalmarAsyncOp>& op) {
+        return std::atomic_exchange(&busy, op);
+    }
+
+    /// op no longer uses the buffer, unless another operation marked it busy since
+    void release_busy(std::shared_ptr<KalmarAsyncOp> op) {
+        std::atomic_compare_exchange_strong(&busy, &op, std::shared_ptr<KalmarAsyncOp>());
+    }
+
     void* get_device_pointer() {
+        wait_busy();
         return devs[curr->getDev()].data;
     }
 
+    /// a chunk_set covering this buffer, with every chunk set to value
+    chunk_set chunks(bool value) const {
+        return chunk_set((count + RW_INFO_CHUNK_SIZE - 1) / RW_INFO_CHUNK_SIZE, value);
+    }
+
+    /// buffer for pDev, whose chunks are all set to valid if it is allocated
+    ///
+    /// The CPU and unified devices access the same memory: the first of them
+    /// which needs the buffer allocates it, the others alias its allocation
+    /// and only track their own state.
+    dev_info alloc(KalmarDevice* pDev, bool valid) {
+        if (pDev->is_unified()) {
+            for (auto& it : devs) {
+                if (it.first != pDev && !it.second.alias && it.first->is_unified()) {
+                    getContext()->syncStats.bytesAliased += count;
+                    return {it.second.data, it.second.valid, true};
+                }
+            }
+        }
+        return {pDev->create(count, this), chunks(valid), false};
+    }
+
     void construct(std::shared_ptr<KalmarQueue> pQueue) {
         curr = pQueue;
-        devs[pQueue->getDev()] = {pQueue->getDev()->create(count, this), invalid};
+        devs[pQueue->getDev()] = alloc(pQueue->getDev(), false);
         if (is_cpu_queue(pQueue))
             data = devs[pQueue->getDev()].data;
     }
 
     void disc() {
         for (auto& it : devs)
-            it.second.state = invalid;
+            it.second.valid = chunks(false);
     }
 
-    /// optimization: Before performing copy, if the state of cpu accelerator is
-    /// shared, it implies that the data on cpu is the same on device where
+    /// the bytes [offset, offset + size) of the buffer on pDev are going to be
+    /// modified, invalidate the chunks holding them on every device which does
+    /// not share its memory
+    void disc(KalmarDevice* pDev, size_t offset, size_t size) {
+        if (offset >= count || size == 0)
+            return;
+        size_t first = offset / RW_INFO_CHUNK_SIZE;
+        size_t last = (std::min(count, offset + std::min(size, count)) + RW_INFO_CHUNK_SIZE - 1) / RW_INFO_CHUNK_SIZE;
+        void* mem = devs[pDev].data;
+        for (auto& it : devs)
+            it.second.valid.assign(first, last, it.second.data == mem);
+    }
+
+    /// The chunks valid on curr are valid on every device sharing its memory
+    /// as soon as a command is queued to modify them, and are not copied to
+    /// those devices. If pDev is one of them, wait until the commands of curr
+    /// using the buffer have completed. CPU queues mark the buffer busy
+    /// instead, see wait_busy.
+    void wait_shared(KalmarDevice* pDev) {
+        auto it = devs.find(pDev);
+        if (it == std::end(devs) || is_cpu_queue(curr) ||
+            it->second.data != devs[curr->getDev()].data)
+            return;
+        curr->waitForDependentAsyncOps(it->second.data);
+    }
+
+    /// optimization: Before performing copy, if every chunk on cpu accelerator
+    /// is valid, it implies that the data on cpu is the same on device where
     /// curr located, use data on cpu to perform the later operation
     /// For example, if data on device a is going to be copied to device b
     /// and the data on device a and cpu is the same, it is okay to copy data 
@@ -704,9 +1160,45 @@ struct rw_info
         if (is_cpu_queue(curr))
             return;
         auto cpu_queue = get_cpu_queue();
-        if (devs.find(cpu_queue->getDev()) != std::end(devs))
-            if (devs[cpu_queue->getDev()].state == shared)
-                curr = cpu_queue;
+        auto it = devs.find(cpu_queue->getDev());
+        if (it == std::end(devs))
+            return;
+        const size_t n = (count + RW_INFO_CHUNK_SIZE - 1) / RW_INFO_CHUNK_SIZE;
+        for (size_t i = 0; i < n; ++i)
+            if (!it->second.valid.test(i))
+                return;
+        curr = cpu_queue;
+    }
+
+    /// copy the chunks which are invalid on the device of pQueue but valid on
+    /// the one of curr, consecutive chunks are copied at once
+    void fetch(std::shared_ptr<KalmarQueue> pQueue, bool block) {
+        dev_info& dst = devs[pQueue->getDev()];
+        dev_info& src = devs[curr->getDev()];
+        const size_t n = (count + RW_INFO_CHUNK_SIZE - 1) / RW_INFO_CHUNK_SIZE;
+        size_t copied = 0;
+        size_t i = 0;
+        while (i < n) {
+            if (dst.valid.test(i) || !src.valid.test(i)) {
+                ++i;
+                continue;
+            }
+            size_t first = i;
+            while (i < n && !dst.valid.test(i) && src.valid.test(i))
+                ++i;
+            size_t offset = first * RW_INFO_CHUNK_SIZE;
+            size_t cnt = std::min(count, i * RW_INFO_CHUNK_SIZE) - offset;
+            copy_helper(curr, src.data, pQueue, dst.data, cnt, block, offset, offset);
+            for (auto& it : devs)
+                if (it.second.data == dst.data)
+                    it.second.valid.assign(first, i, true);
+            copied += cnt;
+            getContext()->syncStats.transfers++;
+        }
+        if (copied) {
+            getContext()->syncStats.bytesCopied += copied;
+            getContext()->syncStats.bytesSkipped += count - copied;
+        }
     }
 
     /// synchronize data to device pQueue belongs to by using pQuquq
@@ -714,16 +1206,19 @@ struct rw_info
     /// @modify: the data will be modified or not
     /// @blcok: this call will be blocking or not
     ///         none blocking occurs in serialization stage
-    void sync(std::shared_ptr<KalmarQueue> pQueue, bool modify, bool block = true) {
+    /// @offset, @size: the bytes going to be modified, only those are
+    ///                 invalidated on other devices
+    void sync(std::shared_ptr<KalmarQueue> pQueue, bool modify, bool block = true,
+              size_t offset = 0, size_t size = SIZE_MAX) {
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
         if (CLAMP::in_cpu_kernel())
             return;
 #endif
+        wait_busy();
         if (!curr) {
             /// This can only happen if array_view is constructed with size and
             /// is not accessed before
-            dev_info dev = {pQueue->getDev()->create(count, this),
-                modify ? modified : shared};
+            dev_info dev = alloc(pQueue->getDev(), true);
             devs[pQueue->getDev()] = dev;
             if (is_cpu_queue(pQueue))
                 data = dev.data;
@@ -731,44 +1226,25 @@ struct rw_info
             return;
         }
 
-        if (curr == pQueue)
-            return;
-
         /// If both queues are from the same device, upadte state only
-        if (curr->getDev() == pQueue->getDev()) {
-            // curr->wait();
-            curr = pQueue;
-            if (modify) {
-                disc();
-                devs[curr->getDev()].state = modified;
+        if (curr->getDev() != pQueue->getDev()) {
+            /// If the buffer on device is not allocated, allocate space for it
+            if (devs.find(pQueue->getDev()) == std::end(devs)) {
+                dev_info dev = alloc(pQueue->getDev(), false);
+                devs[pQueue->getDev()] = dev;
+                if (is_cpu_queue(pQueue))
+                    data = dev.data;
             }
-            return;
-        }
 
-        /// If the buffer on device is not allocated, allocate space for it
-        if (devs.find(pQueue->getDev()) == std::end(devs)) {
-            dev_info dev = {pQueue->getDev()->create(count, this), invalid};
-            devs[pQueue->getDev()] = dev;
-            if (is_cpu_queue(pQueue))
-                data = dev.data;
+            wait_shared(pQueue->getDev());
+            try_switch_to_cpu();
+            fetch(pQueue, block);
         }
-
-        try_switch_to_cpu();
-        dev_info& dst = devs[pQueue->getDev()];
-        dev_info& src = devs[curr->getDev()];
-        if (dst.state == invalid && src.state != invalid)
-            copy_helper(curr, src.data, pQueue, dst.data, count, block);
-        /// if the data on current device is going to be modified
-        /// changed the state of current device as modified
         curr = pQueue;
-        if (modify) {
-            disc();
-            dst.state = modified;
-        } else {
-            dst.state = shared;
-            if (src.state == modified)
-                src.state = shared;
-        }
+        /// if the data on current device is going to be modified
+        /// the chunks modified are only valid on the current device
+        if (modify)
+            disc(curr->getDev(), offset, size);
     }
 
     /// return a host accessible pointer from device
@@ -776,25 +1252,28 @@ struct rw_info
     /// @offset: offset to map
     /// @modify: change state if it is going to be modified
     void* map(size_t cnt, size_t offset, bool modify) {
+        wait_busy();
         if (cnt == 0)
             cnt = count;
         /// This can only happen if this rw_info is constructed only with size
         /// and not accessed on any device
         if (!curr) {
             curr = getContext()->auto_select();
-            devs[curr->getDev()] = {curr->getDev()->create(count, this), modify ? modified : shared};
+            devs[curr->getDev()] = {curr->getDev()->create(count, this), chunks(true)};
             return curr->map(data, cnt, offset, modify);
         }
+        wait_shared(get_cpu_queue()->getDev());
         try_switch_to_cpu();
         dev_info& info = devs[curr->getDev()];
-        if (info.state == shared && modify) {
-            disc();
-            info.state = modified;
-        }
+        if (modify)
+            disc(curr->getDev(), offset, cnt);
         return curr->map(info.data, cnt, offset, modify);
     }
 
-    void unmap(void* addr, size_t cnt, size_t offset, bool modify) { curr->unmap(devs[curr->getDev()].data, addr, cnt, offset, modify); }
+    void unmap(void* addr, size_t cnt, size_t offset, bool modify) {
+        wait_busy();
+        curr->unmap(devs[curr->getDev()].data, addr, cnt, offset, modify);
+    }
 
     /// synchronize data to master accelerator
     /// used in array
@@ -803,26 +1282,29 @@ struct rw_info
 
     /// synchronize data to cpu accelerator
     /// used in array_view
-    void get_cpu_access(bool modify) { sync(get_cpu_queue(), modify); }
+    /// @offset, @size: the bytes going to be modified if modify is set
+    void get_cpu_access(bool modify, size_t offset = 0, size_t size = SIZE_MAX) {
+        sync(get_cpu_queue(), modify, true, offset, size);
+    }
 
     /// Write data from host source pointer to device
-    /// Change state to modified, because the device has exclusive copy of data
+    /// The written chunks are only valid on the device
     void write(const void* src, int cnt, int offset, bool blocking) {
+        wait_busy();
         curr->write(devs[curr->getDev()].data, src, cnt, offset, blocking);
-        dev_info& dev = devs[curr->getDev()];
-        if (dev.state != modified) {
-            disc();
-            dev.state = modified;
-        }
+        disc(curr->getDev(), offset, cnt);
     }
 
     /// Read data to host pointer from device
     void read(void* dst, int cnt, int offset) {
+        wait_busy();
         curr->read(devs[curr->getDev()].data, dst, cnt, offset);
     }
 
     /// copy data from "this" to other
     void copy(rw_info* other, int src_offset, int dst_offset, int cnt) {
+        wait_busy();
+        other->wait_busy();
         if (cnt == 0)
             cnt = count;
         if (!curr) {
@@ -836,9 +1318,12 @@ struct rw_info
         }
         dev_info& dst = other->devs[other->curr->getDev()];
         dev_info& src = devs[curr->getDev()];
-        /// If src.state is invalid, zero the data on it
-        if (src.state == invalid) {
-            src.state = shared;
+        /// If no chunk of the source range holds data, zero the data on it
+        bool empty = true;
+        for (size_t i = src_offset / RW_INFO_CHUNK_SIZE; i * RW_INFO_CHUNK_SIZE < size_t(src_offset + cnt); ++i)
+            empty &= !src.valid.test(i);
+        if (empty) {
+            disc(curr->getDev(), src_offset, cnt);
             if (is_cpu_queue(curr))
                 memset((char*)src.data + src_offset, 0, cnt);
             else {
@@ -849,15 +1334,14 @@ struct rw_info
             }
         }
         copy_helper(curr, src.data, other->curr, dst.data, cnt, true, src_offset, dst_offset);
-        other->disc();
-        dst.state = modified;
+        other->disc(other->curr->getDev(), dst_offset, cnt);
     }
 
     ~rw_info() {
 #if __KALMAR_ACCELERATOR__ == 2 || __KALMAR_CPU__ == 2
         if (CLAMP::in_cpu_kernel()) {
-            if (data && !HostPtr)
-                kalmar_aligned_free(data);
+            if (!HostPtr)
+                CLAMP::cpu_kernel_free(data, count);
             return;
         }
 #endif
@@ -868,16 +1352,13 @@ struct rw_info
             synchronize(false);
         auto cpu_dev = get_cpu_queue()->getDev();
         if (devs.find(cpu_dev) != std::end(devs)) {
-            if (!HostPtr)
+            if (!HostPtr && !devs[cpu_dev].alias)
                 cpu_dev->release(devs[cpu_dev].data, this);
             devs.erase(cpu_dev);
         }
-        KalmarDevice* pDev;
-        dev_info info;
-        for (const auto it : devs) {
-            std::tie(pDev, info) = it;
-            if (toReleaseDevPointer)
-                pDev->release(info.data, this);
+        for (const auto& it : devs) {
+            if (toReleaseDevPointer && !it.second.alias)
+                it.first->release(it.second.data, this);
         }
     }
 };
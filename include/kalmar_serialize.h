@@ -2,6 +2,10 @@
 
 #include "kalmar_exception.h"
 
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
 /** \cond HIDDEN_SYMBOLS */
 namespace Kalmar
 {
@@ -11,7 +15,10 @@ class FunctorBufferWalker {
 public:
     virtual void Append(size_t sz, const void* s) {}
     virtual void AppendPtr(size_t sz, const void* s) {}
-    virtual void visit_buffer(struct rw_info* rw, bool modify, bool isArray) = 0;
+    /// rw is going to be accessed by a kernel, which modifies the bytes
+    /// [offset, offset + size) if modify is set
+    virtual void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                              size_t offset, size_t size) = 0;
 };
 
 /// This is used to avoid incorrect compiler error
@@ -21,8 +28,8 @@ public:
     Serialize(FunctorBufferWalker* vis) : vis(vis) {}
     void Append(size_t sz, const void* s) { vis->Append(sz, s); }
     void AppendPtr(size_t sz, const void* s) { vis->AppendPtr(sz, s); }
-    void visit_buffer(struct rw_info* rw, bool modify, bool isArray) {
-        vis->visit_buffer(rw, modify, isArray);
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray, size_t offset, size_t size) {
+        vis->visit_buffer(rw, modify, isArray, offset, size);
     }
 };
 
@@ -34,7 +41,8 @@ class CPUVisitor : public FunctorBufferWalker
     std::set<struct rw_info*> bufs;
 public:
     CPUVisitor(std::shared_ptr<KalmarQueue> pQueue) : pQueue(pQueue) {}
-    void visit_buffer(struct rw_info* rw, bool modify, bool isArray) override {
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                      size_t offset, size_t size) override {
         if (isArray) {
             auto curr = pQueue->getDev()->get_path();
             auto path = rw->master->getDev()->get_path();
@@ -44,7 +52,7 @@ public:
                     throw runtime_exception(__errorMsg_UnsupportedAccelerator, E_FAIL);
             }
         }
-        rw->sync(pQueue, modify, false);
+        rw->sync(pQueue, modify, false, offset, size);
         if (bufs.find(rw) == std::end(bufs)) {
             void*& device = rw->devs[pQueue->getDev()].data;
             void*& data = rw->data;
@@ -52,6 +60,16 @@ public:
             std::swap(device, data);
         }
     }
+    /// record op as the launch using every visited buffer
+    void mark_busy(const std::shared_ptr<KalmarAsyncOp>& op) {
+        for (auto rw : bufs)
+            rw->set_busy(op);
+    }
+    /// release the visited buffers still marked busy with op
+    void release_busy(const std::shared_ptr<KalmarAsyncOp>& op) {
+        for (auto rw : bufs)
+            rw->release_busy(op);
+    }
 };
 
 /// Append kernel argument to kernel
@@ -69,7 +87,8 @@ public:
     void AppendPtr(size_t sz, const void *s) override {
         CLAMP::PushArgPtr(k_, current_idx_++, sz, s);
     }
-    void visit_buffer(struct rw_info* rw, bool modify, bool isArray) override {
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                      size_t offset, size_t size) override {
         if (isArray) {
             auto curr = pQueue->getDev()->get_path();
             auto path = rw->master->getDev()->get_path();
@@ -79,11 +98,159 @@ public:
                     throw runtime_exception(__errorMsg_UnsupportedAccelerator, E_FAIL);
             }
         }
-        rw->sync(pQueue, modify, false);
+        rw->sync(pQueue, modify, false, offset, size);
         pQueue->Push(k_, current_idx_++, rw->devs[pQueue->getDev()].data, modify);
     }
 };
 
+/// Layout of the kernel arguments of a functor type
+///
+/// Recorded once per kernel type from a walk over the functor. Arguments are
+/// packed into a blob the way the HSA runtime lays out its kernarg, each one
+/// aligned to its own size. Arguments which are bytes of the functor itself
+/// are copied as runs, so the captures of most kernels are moved with a single
+/// memcpy; buffers and pointers are patched in on every launch.
+///
+/// A kernel type is direct if all of its arguments are such bytes. Its blob is
+/// then made by the runs alone, without walking the functor again; any other
+/// kernel is walked on every launch, since that walk synchronizes its buffers
+/// to the device and finds their device pointers, which change between
+/// launches.
+class KernargLayout : public FunctorBufferWalker
+{
+public:
+    enum SlotKind { Value, Pointer, Buffer };
+    struct Slot {
+        SlotKind kind;
+        /// offset in the blob
+        size_t offset;
+        /// size given to PushArg / PushArgPtr
+        size_t size;
+        /// offset of the value in the functor, -1 if it lies outside of it
+        ptrdiff_t src;
+        bool modify;
+    };
+    /// bytes [src, src + size) of the functor go to [offset, offset + size)
+    struct Run {
+        size_t src;
+        size_t offset;
+        size_t size;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<Run> runs;
+    size_t size;
+    /// whether the runs make up the whole blob
+    bool direct;
+
+    template <typename Kernel>
+    explicit KernargLayout(const Kernel& f)
+        : slots(), runs(), size(0), direct(true),
+          base(reinterpret_cast<uintptr_t>(&f)), length(sizeof(Kernel)) {
+        Serialize s(this);
+        f.__cxxamp_serialize(s);
+    }
+    void Append(size_t sz, const void* s) override {
+        add(Value, sz, sz, s, false);
+    }
+    void AppendPtr(size_t sz, const void* s) override {
+        add(Pointer, sz, sizeof(void*), nullptr, false);
+    }
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                      size_t offset, size_t size) override {
+        add(Buffer, sizeof(void*), sizeof(void*), nullptr, modify);
+    }
+
+private:
+    uintptr_t base;
+    size_t length;
+
+    void add(SlotKind kind, size_t sz, size_t width, const void* s, bool modify) {
+        size_t align = (width && width <= 8 && !(width & (width - 1))) ? width : 1;
+        size_t offset = (size + align - 1) / align * align;
+        ptrdiff_t src = -1;
+        uintptr_t p = reinterpret_cast<uintptr_t>(s);
+        if (kind == Value && p >= base && p + sz <= base + length) {
+            src = p - base;
+            // extend the last run if the value keeps its distance to it, the
+            // bytes in between are overwritten by the slots they belong to
+            if (!runs.empty() && runs.back().src + runs.back().size <= size_t(src) &&
+                size_t(src) - runs.back().src == offset - runs.back().offset)
+                runs.back().size = offset + sz - runs.back().offset;
+            else
+                runs.push_back({size_t(src), offset, sz});
+        }
+        if (src < 0)
+            direct = false;
+        slots.push_back({kind, offset, sz, src, modify});
+        size = offset + width;
+    }
+};
+
+/// Fill the kernarg blob of a launch following the layout of its kernel type
+class KernargWriter : public FunctorBufferWalker
+{
+    const std::shared_ptr<KalmarQueue>& pQueue;
+    const KernargLayout& layout;
+    char* blob;
+    std::vector<void*>& modified;
+    size_t current_idx_;
+    bool valid_;
+
+    const KernargLayout::Slot* next(KernargLayout::SlotKind kind, size_t sz) {
+        if (!valid_ || current_idx_ >= layout.slots.size() ||
+            layout.slots[current_idx_].kind != kind || layout.slots[current_idx_].size != sz) {
+            valid_ = false;
+            return nullptr;
+        }
+        return &layout.slots[current_idx_++];
+    }
+public:
+    /// copy the runs of f into blob, the walk over f fills in the rest
+    template <typename Kernel>
+    KernargWriter(const std::shared_ptr<KalmarQueue>& pQueue, const KernargLayout& layout,
+                  const Kernel& f, char* blob, std::vector<void*>& modified)
+        : pQueue(pQueue), layout(layout), blob(blob), modified(modified),
+          current_idx_(0), valid_(true) {
+        const char* src = reinterpret_cast<const char*>(&f);
+        for (const auto& run : layout.runs)
+            memcpy(blob + run.offset, src + run.src, run.size);
+    }
+    /// whether the walk matched the layout
+    bool valid() const { return valid_ && current_idx_ == layout.slots.size(); }
+
+    void Append(size_t sz, const void *s) override {
+        const KernargLayout::Slot* slot = next(KernargLayout::Value, sz);
+        if (slot && slot->src < 0)
+            memcpy(blob + slot->offset, s, sz);
+    }
+    void AppendPtr(size_t sz, const void *s) override {
+        const KernargLayout::Slot* slot = next(KernargLayout::Pointer, sz);
+        if (slot)
+            memcpy(blob + slot->offset, &s, sizeof(void*));
+    }
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                      size_t offset, size_t size) override {
+        if (isArray) {
+            auto curr = pQueue->getDev()->get_path();
+            auto path = rw->master->getDev()->get_path();
+            if (path == L"cpu") {
+                auto asoc = rw->stage->getDev()->get_path();
+                if (asoc == L"cpu" || path != curr)
+                    throw runtime_exception(__errorMsg_UnsupportedAccelerator, E_FAIL);
+            }
+        }
+        rw->sync(pQueue, modify, false, offset, size);
+        const KernargLayout::Slot* slot = next(KernargLayout::Buffer, sizeof(void*));
+        if (slot) {
+            void* device = rw->devs[pQueue->getDev()].data;
+            memcpy(blob + slot->offset, &device, sizeof(void*));
+            if (modify)
+                modified.push_back(device);
+        }
+    }
+};
+
 /// In C++AMP Standard V1.2 Line 3014
 /// If pfe is launched without explicitly specified view, the target accelerator
 /// and the view using which work is submitted to the accelerator, is chosen
@@ -95,7 +262,8 @@ class QueueSearcher : public FunctorBufferWalker
     std::shared_ptr<KalmarQueue> pQueue;
 public:
     QueueSearcher() = default;
-    void visit_buffer(struct rw_info* rw, bool modify, bool isArray) override {
+    void visit_buffer(struct rw_info* rw, bool modify, bool isArray,
+                      size_t offset, size_t size) override {
         if (isArray && !pQueue) {
             if (rw->master->getDev()->get_path() != L"cpu")
                 pQueue = rw->master;
@@ -5,65 +5,86 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <vector>
 
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <kalmar_runtime.h>
 #include <kalmar_aligned_alloc.h>
 
+#include "../mcwamp_cpu_topology.hpp"
+
 extern "C" void PushArgImpl(void *ker, int idx, size_t sz, const void *v) {}
 
 namespace Kalmar {
 
-class CPUFallbackQueue final : public KalmarQueue
+class CPUFallbackQueue final : public CPUQueue
 {
 public:
 
-  CPUFallbackQueue(KalmarDevice* pDev) : KalmarQueue(pDev) {}
-
-  void read(void* device, void* dst, size_t count, size_t offset) override {
-      if (dst != device)
-          memmove(dst, (char*)device + offset, count);
-  }
-
-  void write(void* device, const void* src, size_t count, size_t offset, bool blocking) override {
-      if (src != device)
-          memmove((char*)device + offset, src, count);
-  }
-
-  void copy(void* src, void* dst, size_t count, size_t src_offset, size_t dst_offset, bool blocking) override {
-      if (src != dst)
-          memmove((char*)dst + dst_offset, (char*)src + src_offset, count);
-  }
-
-  void* map(void* device, size_t count, size_t offset, bool modify) override {
-      return (char*)device + offset;
-  }
-
-  void unmap(void* device, void* addr, size_t count, size_t offset, bool modify) override {}
-
-  void Push(void *kernel, int idx, void* device, bool isConst) override {}
+  CPUFallbackQueue(KalmarDevice* pDev) : CPUQueue(pDev) {}
 };
 
+/// CPU device executing kernels on the thread pool of one NUMA node
+///
+/// On a multi-node system there is one device per node. Buffers created on
+/// it prefer memory of its node, and its kernels run on workers pinned to
+/// the CPUs of the node.
 class CPUFallbackDevice final : public KalmarDevice
 {
+    /// NUMA node, -1 if the device is not bound to any
+    const int node;
+    const unsigned int cpus;
 public:
-    CPUFallbackDevice() : KalmarDevice() {}
+    CPUFallbackDevice(int node = -1, unsigned int cpus = 0)
+        : KalmarDevice(), node(node), cpus(cpus) {}
 
-    std::wstring get_path() const override { return L"fallback"; }
-    std::wstring get_description() const override { return L"CPU Fallback"; }
+    std::wstring get_path() const override {
+        return node < 0 ? L"fallback" : L"fallback" + std::to_wstring(node);
+    }
+    std::wstring get_description() const override {
+        return node < 0 ? L"CPU Fallback" : L"CPU Fallback (NUMA node " + std::to_wstring(node) + L")";
+    }
     size_t get_mem() const override { return 0; }
     bool is_double() const override { return true; }
     bool is_lim_double() const override { return true; }
     bool is_unified() const override { return true; }
     bool is_emulated() const override { return true; }
     uint32_t get_version() const override { return 0; }
+    unsigned int get_compute_unit_count() override { return cpus; }
+    int get_numa_node() const override { return node; }
 
     void* create(size_t count, struct rw_info* /* not used */) override {
-        return kalmar_aligned_alloc(0x1000, count);
+        if (node < 0)
+            return kalmar_aligned_alloc(0x1000, count);
+        // the buffer takes whole pages of its own, so the policy set on them
+        // does not reach memory of other allocations; the pages are not
+        // touched yet so they get placed on first use
+        static const size_t page = sysconf(_SC_PAGESIZE) > 0 ? sysconf(_SC_PAGESIZE) : 0x1000;
+        size_t len = (count + page - 1) & ~(page - 1);
+        void* ptr = kalmar_aligned_alloc(page, len);
+        unsigned long mask[16] = {};
+        if (ptr && len > 0 && node < static_cast<int>(sizeof(mask) * 8)) {
+            mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+            if (syscall(SYS_mbind, ptr, len, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+                // only a placement hint, the buffer is still usable
+                static std::once_flag warned;
+                int err = errno;
+                std::call_once(warned, [err] {
+                    std::cerr << "Can't bind CPU buffers to their NUMA node: " << strerror(err) << std::endl;
+                });
+            }
+        }
+        return ptr;
     }
     void release(void *device, struct rw_info* /* not used */ ) override { 
         kalmar_aligned_free(device);
@@ -78,7 +99,15 @@ template <typename T> inline void deleter(T* ptr) { delete ptr; }
 class CPUContext final : public KalmarContext
 {
 public:
-    CPUContext() { Devices.push_back(new CPUFallbackDevice); }
+    CPUContext() {
+        std::vector<CPUNumaNode> nodes = get_cpu_numa_nodes();
+        if (nodes.size() == 1) {
+            Devices.push_back(new CPUFallbackDevice);
+            return;
+        }
+        for (auto& n : nodes)
+            Devices.push_back(new CPUFallbackDevice(n.id, n.cpus.size()));
+    }
     ~CPUContext() { std::for_each(std::begin(Devices), std::end(Devices), deleter<KalmarDevice>); }
 };
 
@@ -0,0 +1,78 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <hcc/kalmar_runtime.h>
+
+namespace Kalmar {
+
+/// The commands of a queue still using each buffer
+///
+/// A kernel dispatch records itself as a user of each of its buffers. The
+/// next dispatch using one of them collects the users still in flight and
+/// the queue makes the packet processor wait for them with barrier-AND
+/// packets, so the launch path never blocks the host. The collected users are
+/// forgotten: the packets of a queue are processed in order, once the new
+/// dispatch has completed so have they. Host accesses to a buffer still wait
+/// for its users.
+///
+/// Only KalmarAsyncOp::isReady() and getFuture() are used, so the bookkeeping
+/// runs just as well on operations which are not HSA commands.
+class BufferDependencies
+{
+    std::map<void*, std::vector<std::weak_ptr<KalmarAsyncOp>>> users;
+
+public:
+    /// the operations still in flight using any of buffers, each one once
+    std::vector<std::shared_ptr<KalmarAsyncOp>> collect(const std::vector<void*>& buffers) {
+        std::vector<std::shared_ptr<KalmarAsyncOp>> deps;
+        for (void* buffer : buffers) {
+            auto it = users.find(buffer);
+            if (it == users.end())
+                continue;
+            for (auto& user : it->second) {
+                // an operation is only destroyed once it has completed
+                std::shared_ptr<KalmarAsyncOp> op = user.lock();
+                if (op && !op->isReady() &&
+                    std::find(deps.begin(), deps.end(), op) == deps.end())
+                    deps.push_back(op);
+            }
+            users.erase(it);
+        }
+        return deps;
+    }
+
+    /// op uses every buffer of buffers
+    void record(const std::vector<void*>& buffers, const std::shared_ptr<KalmarAsyncOp>& op) {
+        for (void* buffer : buffers)
+            users[buffer].push_back(op);
+    }
+
+    /// block until the operations using buffer have completed
+    void wait(void* buffer) {
+        auto it = users.find(buffer);
+        if (it == users.end())
+            return;
+        for (auto& user : it->second) {
+            std::shared_ptr<KalmarAsyncOp> op = user.lock();
+            // wait on valid futures only
+            if (op && op->getFuture()->valid())
+                op->getFuture()->wait();
+        }
+        users.erase(it);
+    }
+
+    void clear() { users.clear(); }
+};
+
+} // namespace Kalmar
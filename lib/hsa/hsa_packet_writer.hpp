@@ -0,0 +1,105 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+/// size of every AQL packet and of the slots of an AQL ring
+#define AQL_PACKET_SIZE (64)
+
+namespace Kalmar {
+
+/// An AQL packet of any type, as kept by a batch until it is written to a ring
+struct AqlPacket
+{
+    unsigned char bytes[AQL_PACKET_SIZE];
+
+    AqlPacket() {}
+
+    template <typename Packet>
+    explicit AqlPacket(const Packet& packet) {
+        static_assert(sizeof(Packet) == AQL_PACKET_SIZE, "not an AQL packet");
+        memcpy(bytes, &packet, AQL_PACKET_SIZE);
+    }
+};
+
+/// Writes AQL packets into the slots of a ring
+///
+/// reserve() claims a number of consecutive slots at once by moving the write
+/// index past them with a compare-and-swap, write() fills them one after another and commit() rings
+/// the doorbell once for all of them. The packet processor stops at a slot
+/// whose header is still invalid, so each packet is written body first and
+/// its header and setup last, with a single release store.
+///
+/// Ring is anything providing
+///   void* base();                       the slots
+///   uint32_t size();                    the number of slots, a power of 2
+///   uint64_t loadReadIndex();
+///   uint64_t loadWriteIndex();
+///   uint64_t casWriteIndex(uint64_t expected, uint64_t index);
+///                                       returns the write index observed
+///   void ringDoorbell(uint64_t index);  index is the last packet written
+/// so the writer runs on an hsa_queue_t as well as on a ring in host memory.
+/// Writers on several threads may share a ring, each claims its own slots.
+template <typename Ring>
+class AqlPacketWriter
+{
+    Ring& ring;
+    /// the reserved slots, and the next one to write
+    uint64_t first;
+    uint64_t end;
+    uint64_t next;
+
+public:
+    explicit AqlPacketWriter(Ring& ring) : ring(ring), first(0), end(0), next(0) {}
+
+    /// reserve count slots, false if the ring lacks room for them
+    bool reserve(uint32_t count) {
+        uint64_t index = ring.loadWriteIndex();
+        for (;;) {
+            if (index + count - ring.loadReadIndex() > ring.size())
+                return false;
+            const uint64_t observed = ring.casWriteIndex(index, index + count);
+            if (observed == index)
+                break;
+            index = observed;
+        }
+        first = next = index;
+        end = index + count;
+        return true;
+    }
+
+    /// write packet to the next reserved slot
+    void write(const AqlPacket& packet) {
+        assert(next < end);
+        unsigned char* slot = static_cast<unsigned char*>(ring.base()) +
+                              (next & (ring.size() - 1)) * AQL_PACKET_SIZE;
+        memcpy(slot + sizeof(uint32_t), packet.bytes + sizeof(uint32_t),
+               AQL_PACKET_SIZE - sizeof(uint32_t));
+        uint32_t headerAndSetup;
+        memcpy(&headerAndSetup, packet.bytes, sizeof(uint32_t));
+        __atomic_store_n(reinterpret_cast<uint32_t*>(slot), headerAndSetup, __ATOMIC_RELEASE);
+        ++next;
+    }
+
+    template <typename Packet>
+    void write(const Packet& packet) {
+        write(AqlPacket(packet));
+    }
+
+    /// let the packet processor know about the packets written
+    void commit() {
+        assert(next == end);
+        if (end != first)
+            ring.ringDoorbell(end - 1);
+    }
+};
+
+} // namespace Kalmar
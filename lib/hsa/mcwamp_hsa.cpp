@@ -34,6 +34,8 @@
 #include <hc_am.hpp>
 
 #include "unpinned_copy_engine.h"
+#include "hsa_dependencies.hpp"
+#include "hsa_packet_writer.hpp"
 
 #include <time.h>
 #include <iomanip>
@@ -50,20 +52,28 @@
 // kernel dispatch speed optimization flags
 /////////////////////////////////////////////////
 
-// size of default kernarg buffer in the kernarg pool in HSAContext
+// size of the smallest class of kernarg segments in the pools of a queue
 // default set as 128
 #define KERNARG_BUFFER_SIZE (128)
 
-// number of pre-allocated kernarg buffers in HSAContext
-// default set as 64 (pre-allocating 64 of kernarg buffers in the pool)
+// number of size classes of kernarg segments, class c holds segments of
+// KERNARG_BUFFER_SIZE << c bytes; larger kernargs are allocated per dispatch
+#define KERNARG_CLASS_COUNT (4)
+
+// number of kernarg segments a size class of a queue grows by at once
+// default set as 64 (allocating 64 segments of the class at once)
 #define KERNARG_POOL_SIZE (64)
 
-// number of pre-allocated HSA signals in HSAContext
+// number of pre-allocated HSA signals in HSAContext, also the number of
+// signals a pool grows by once all of its signals are in use
 // default set as 64 (pre-allocating 64 HSA signals)
 #define SIGNAL_POOL_SIZE (64) //
 
-// Maximum number of inflight commands sent to a single queue.
-// If limit is exceeded, HCC will force a queue wait to reclaim
+// maximum number of times a signal pool may grow by SIGNAL_POOL_SIZE
+#define SIGNAL_POOL_MAX_CHUNKS (4096)
+
+// Maximum number of inflight commands sent to a single queue, a power of 2.
+// If limit is exceeded, HCC will wait for the oldest command to reclaim
 // resources (signals, kernarg)
 #define MAX_INFLIGHT_COMMANDS_PER_QUEUE  512
 
@@ -75,10 +85,6 @@
 // default set as 0 (NOT print out kernel dispatch time)
 #define KALMAR_DISPATCH_TIME_PRINTOUT (0)
 
-// threshold to clean up finished kernel in HSAQueue.asyncOps
-// default set as 1024
-#define ASYNCOPS_VECTOR_GC_SIZE (1024)
-
 
 // These parameters change the thresholds used to select the unpinned copy algorithm:
 #define MEMCPY_D2H_STAGING_VS_PININPLACE_COPY_THRESHOLD    4194304
@@ -89,6 +95,11 @@
 
 #define HSA_BARRIER_DEP_SIGNAL_CNT (5)
 
+// maximum number of AQL packets a batch holds before they are submitted,
+// must stay below MAX_INFLIGHT_COMMANDS_PER_QUEUE
+// default set as 128
+#define AQL_BATCH_SIZE (128)
+
 
 // synchronization for copy commands in the same stream, regardless of command type.
 // Add a signal dependencies between async copies - 
@@ -246,6 +257,8 @@ extern "C" void PushArgPtrImpl(void *ker, int idx, size_t sz, const void *v);
 namespace Kalmar {
 class HSAQueue;
 class HSADevice;
+struct KernargSegment;
+class KernargSlabs;
 } // namespace Kalmar
 
 ///
@@ -332,7 +345,10 @@ private:
     bool isSubmitted;
     hsa_wait_state_t waitMode;
 
-    std::shared_future<void>* future;
+    // created the first time somebody asks for it, the runtime itself waits
+    // on the completion signal
+    std::shared_future<void> future;
+    std::once_flag futureOnce;
 
 
     // If copy is dependent on another operation, record reference here.
@@ -358,7 +374,12 @@ private:
     void setCopyAgents(Kalmar::hcCommandKind copyDir, hsa_agent_t *srcAgent, hsa_agent_t *dstAgent);
 
 public:
-    std::shared_future<void>* getFuture() override { return future; }
+    std::shared_future<void>* getFuture() override {
+        std::call_once(futureOnce, [this] {
+            future = std::async(std::launch::deferred, [this] { waitComplete(); }).share();
+        });
+        return &future;
+    }
 
     void* getNativeHandle() override { return &signal; }
 
@@ -380,7 +401,7 @@ public:
     // Copy mode will be set later on.
     // HSA signals would be waited in HSA_WAIT_STATE_ACTIVE by default for HSACopy instances
     HSACopy(const void* src_, void* dst_, size_t sizeBytes_) : KalmarAsyncOp(Kalmar::hcCommandInvalid),
-        isSubmitted(false), future(nullptr), depAsyncOp(nullptr), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_ACTIVE),
+        isSubmitted(false), depAsyncOp(nullptr), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_ACTIVE),
         src(src_), dst(dst_), sizeBytes(sizeBytes_),
         signalIndex(-1) {
 #if KALMAR_DEBUG
@@ -429,9 +450,14 @@ private:
     hsa_signal_t signal;
     int signalIndex;
     bool isDispatched;
+    // whether the packet was held back in a batch of the queue
+    bool isBatched;
     hsa_wait_state_t waitMode;
 
-    std::shared_future<void>* future;
+    // created the first time somebody asks for it, the runtime itself waits
+    // on the completion signal
+    std::shared_future<void> future;
+    std::once_flag futureOnce;
 
     Kalmar::HSAQueue* hsaQueue;
 
@@ -445,7 +471,12 @@ private:
     std::shared_ptr<KalmarAsyncOp> depAsyncOps [HSA_BARRIER_DEP_SIGNAL_CNT];
 
 public:
-    std::shared_future<void>* getFuture() override { return future; }
+    std::shared_future<void>* getFuture() override {
+        std::call_once(futureOnce, [this] {
+            future = std::async(std::launch::deferred, [this] { waitComplete(); }).share();
+        });
+        return &future;
+    }
 
     void* getNativeHandle() override { return &signal; }
 
@@ -466,15 +497,15 @@ public:
 
     // default constructor
     // 0 prior dependency
-    HSABarrier() : KalmarAsyncOp(Kalmar::hcCommandMarker), isDispatched(false), future(nullptr), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_BLOCKED), depCount(0) {}
+    HSABarrier() : KalmarAsyncOp(Kalmar::hcCommandMarker), signalIndex(-1), isDispatched(false), isBatched(false), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_BLOCKED), depCount(0) {}
 
     // constructor with 1 prior depedency
-    HSABarrier(std::shared_ptr <Kalmar::KalmarAsyncOp> dependent_op) : KalmarAsyncOp(Kalmar::hcCommandMarker), isDispatched(false), future(nullptr), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_BLOCKED), depCount(1) {
+    HSABarrier(std::shared_ptr <Kalmar::KalmarAsyncOp> dependent_op) : KalmarAsyncOp(Kalmar::hcCommandMarker), signalIndex(-1), isDispatched(false), isBatched(false), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_BLOCKED), depCount(1) {
         depAsyncOps[0] = dependent_op;
     }
 
     // constructor with at most 5 prior dependencies
-    HSABarrier(int count, std::shared_ptr <Kalmar::KalmarAsyncOp> *dependent_op_array) : KalmarAsyncOp(Kalmar::hcCommandMarker), isDispatched(false), future(nullptr), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_BLOCKED), depCount(count) {
+    HSABarrier(int count, std::shared_ptr <Kalmar::KalmarAsyncOp> *dependent_op_array) : KalmarAsyncOp(Kalmar::hcCommandMarker), signalIndex(-1), isDispatched(false), isBatched(false), hsaQueue(nullptr), waitMode(HSA_WAIT_STATE_BLOCKED), depCount(count) {
         if ((count > 0) && (count <= 5)) {
             for (int i = 0; i < count; ++i) {
                 depAsyncOps[i] = dependent_op_array[i];
@@ -529,7 +560,11 @@ private:
     uint32_t arg_count;
     size_t prevArgVecCapacity;
     void* kernargMemory;
-    int kernargMemoryIndex;
+    // segment of the queue holding kernargMemory, nullptr if it was
+    // allocated for this dispatch alone
+    Kalmar::KernargSegment* kernargSegment;
+    uint64_t kernargGeneration;
+    Kalmar::KernargSlabs* kernargSlabs;
 
     int launchDimensions;
     uint32_t workgroup_size[3];
@@ -539,16 +574,26 @@ private:
     int signalIndex;
     hsa_kernel_dispatch_packet_t aql;
     bool isDispatched;
+    // whether the packet was held back in a batch of the queue
+    bool isBatched;
     hsa_wait_state_t waitMode;
 
     size_t dynamicGroupSize;
 
-    std::shared_future<void>* future;
+    // created the first time somebody asks for it, the runtime itself waits
+    // on the completion signal
+    std::shared_future<void> future;
+    std::once_flag futureOnce;
 
     Kalmar::HSAQueue* hsaQueue;
 
 public:
-    std::shared_future<void>* getFuture() override { return future; }
+    std::shared_future<void>* getFuture() override {
+        std::call_once(futureOnce, [this] {
+            future = std::async(std::launch::deferred, [this] { waitComplete(); }).share();
+        });
+        return &future;
+    }
 
     void* getNativeHandle() override { return &signal; }
 
@@ -596,6 +641,15 @@ public:
     hsa_status_t pushShortArg(short s) { return pushArgPrivate(s); }
     hsa_status_t pushPointerArg(void *addr) { return pushArgPrivate(addr); }
 
+    // append count arguments already packed the way pushArgPrivate does
+    hsa_status_t pushArgBlock(const void* blob, size_t size, int count) {
+        assert(arg_vec.empty() && "argument block must start the kernarg");
+        const uint8_t* ptr = static_cast<const uint8_t*>(blob);
+        arg_vec.insert(arg_vec.end(), ptr, ptr + size);
+        arg_count += count;
+        return HSA_STATUS_SUCCESS;
+    }
+
     hsa_status_t clearArgs() {
         arg_count = 0;
         arg_vec.clear();
@@ -624,6 +678,9 @@ public:
     // wait for the kernel to finish execution
     hsa_status_t waitComplete();
 
+    // hand the kernarg memory back once the dispatch has completed
+    void releaseKernarg();
+
     void dispose();
 
     uint64_t getTimestampFrequency() override {
@@ -724,6 +781,181 @@ pool_iterator::pool_iterator()
 ///
 namespace Kalmar {
 
+/// A kernarg segment handed out by KernargSlabs
+struct KernargSegment
+{
+    void* ptr;
+    /// links of the free list, or of the list of segments in use
+    KernargSegment* prev;
+    KernargSegment* next;
+    int sizeClass;
+    /// the completion signal of the dispatch using the segment
+    hsa_signal_t signal;
+    /// bumped every time the segment is handed out
+    uint64_t generation;
+    bool inUse;
+};
+
+/// Kernarg segments of a queue
+///
+/// Segments are grouped in size classes. Each class keeps a free list and a
+/// list of the segments in use, along with the completion signal of the
+/// dispatch using each. A segment goes back to the free list when its
+/// dispatch is waited for or disposed of, or once its class runs dry and its
+/// completion signal shows the dispatch has completed, so launches nobody
+/// waits for do not grow the pool. Only when no segment can be reused does
+/// the class grow, by a slab of KERNARG_POOL_SIZE segments carved out of a
+/// single allocation of the kernarg region.
+///
+/// Any thread dispatching on the queue may take a segment, and any thread
+/// observing a completion may give one back, so the lists are guarded by a
+/// mutex of their own; no lock is shared with other queues.
+///
+/// The device owns the slabs and hands them to the next queue created once
+/// their queue is gone; dispatches outliving their queue may still return
+/// their segments.
+class KernargSlabs
+{
+    struct SizeClass {
+        KernargSegment* free;
+        KernargSegment* used;
+    };
+
+    hsa_amd_memory_pool_t region;
+    hsa_agent_t agent;
+    KernargStats& stats;
+    SizeClass classes[KERNARG_CLASS_COUNT];
+    /// allocations of the kernarg region and the segments carved out of them
+    std::vector<std::pair<void*, KernargSegment*>> slabs;
+    std::mutex mutex;
+
+    static void unlink(KernargSegment*& list, KernargSegment* segment) {
+        if (segment->prev != nullptr)
+            segment->prev->next = segment->next;
+        else
+            list = segment->next;
+        if (segment->next != nullptr)
+            segment->next->prev = segment->prev;
+    }
+
+    static void link(KernargSegment*& list, KernargSegment* segment) {
+        segment->prev = nullptr;
+        segment->next = list;
+        if (list != nullptr)
+            list->prev = segment;
+        list = segment;
+    }
+
+    /// move the segments of completed dispatches to the free list, mutex held
+    void reclaim(SizeClass& c) {
+        KernargSegment* segment = c.used;
+        while (segment != nullptr) {
+            KernargSegment* next = segment->next;
+            // signals start at 1 and are only reused once their dispatch
+            // completed, so a value below 1 means the dispatch is done
+            if (hsa_signal_load_acquire(segment->signal) < 1) {
+                unlink(c.used, segment);
+                segment->inUse = false;
+                link(c.free, segment);
+            }
+            segment = next;
+        }
+    }
+
+    void grow(int sizeClass) {
+        const size_t size = KERNARG_BUFFER_SIZE << sizeClass;
+        void* memory = nullptr;
+        hsa_status_t status = hsa_amd_memory_pool_allocate(region, size * KERNARG_POOL_SIZE, 0, &memory);
+        STATUS_CHECK(status, __LINE__);
+
+        // Allow device to access to it once it is allocated. Normally, this memory pool is on system memory.
+        status = hsa_amd_agents_allow_access(1, &agent, NULL, memory);
+        STATUS_CHECK(status, __LINE__);
+
+        KernargSegment* segments = new KernargSegment[KERNARG_POOL_SIZE];
+        for (int i = 0; i < KERNARG_POOL_SIZE; ++i) {
+            segments[i].ptr = static_cast<char*>(memory) + i * size;
+            segments[i].sizeClass = sizeClass;
+            segments[i].generation = 0;
+            segments[i].inUse = false;
+            link(classes[sizeClass].free, &segments[i]);
+        }
+        slabs.push_back(std::make_pair(memory, segments));
+        stats.grown += KERNARG_POOL_SIZE;
+    }
+
+public:
+    /// whether a queue uses the slabs right now, set under the queues mutex
+    /// of the device and cleared by the queue when it is disposed
+    std::atomic<bool> inUse;
+
+    KernargSlabs(hsa_amd_memory_pool_t region, hsa_agent_t agent, KernargStats& stats)
+        : region(region), agent(agent), stats(stats), classes(), slabs(), mutex(), inUse(false) {
+        for (auto& c : classes) {
+            c.free = nullptr;
+            c.used = nullptr;
+        }
+    }
+
+    ~KernargSlabs() {
+        for (auto& slab : slabs) {
+            hsa_amd_memory_pool_free(slab.first);
+            delete[] slab.second;
+        }
+    }
+
+    /// a segment of at least size bytes for the dispatch completing on
+    /// signal, nullptr if size is beyond every class
+    KernargSegment* get(size_t size, hsa_signal_t signal) {
+        int sizeClass = 0;
+        while ((KERNARG_BUFFER_SIZE << sizeClass) < size)
+            if (++sizeClass == KERNARG_CLASS_COUNT)
+                return nullptr;
+        std::lock_guard<std::mutex> lock(mutex);
+        SizeClass& c = classes[sizeClass];
+        if (c.free == nullptr)
+            reclaim(c);
+        if (c.free == nullptr)
+            grow(sizeClass);
+        else
+            ++stats.hits;
+        KernargSegment* segment = c.free;
+        unlink(c.free, segment);
+        segment->signal = signal;
+        ++segment->generation;
+        segment->inUse = true;
+        link(c.used, segment);
+        return segment;
+    }
+
+    /// segment, handed out as the given generation, may be handed out again;
+    /// called from any thread, does nothing if it was reclaimed already
+    void release(KernargSegment* segment, uint64_t generation) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!segment->inUse || segment->generation != generation)
+            return;
+        SizeClass& c = classes[segment->sizeClass];
+        unlink(c.used, segment);
+        segment->inUse = false;
+        link(c.free, segment);
+    }
+};
+
+/// The ring of an HSA queue, as written by AqlPacketWriter
+struct HSAQueueRing
+{
+    hsa_queue_t* queue;
+
+    void* base() { return queue->base_address; }
+    uint32_t size() { return queue->size; }
+    uint64_t loadReadIndex() { return hsa_queue_load_read_index_acquire(queue); }
+    uint64_t loadWriteIndex() { return hsa_queue_load_write_index_relaxed(queue); }
+    uint64_t casWriteIndex(uint64_t expected, uint64_t index) {
+        return hsa_queue_cas_write_index_relaxed(queue, expected, index);
+    }
+    void ringDoorbell(uint64_t index) { hsa_signal_store_relaxed(queue->doorbell_signal, index); }
+};
+
 class HSAQueue final : public KalmarQueue
 {
 private:
@@ -731,17 +963,24 @@ private:
     hsa_queue_t* commandQueue;
 
     //
-    // kernel dispatches and barriers associated with this HSAQueue instance
+    // kernel dispatches, barriers and copies in flight on this HSAQueue
     //
-    // When a kernel k is dispatched, we'll get a KalmarAsyncOp f.
-    // This vector would hold f.  acccelerator_view::wait() would trigger
-    // HSAQueue::wait(), and all future objects in the KalmarAsyncOp objects
-    // will be waited on.
+    // When a command is sent, we'll get a KalmarAsyncOp f with the next
+    // sequence number n, and f is stored at asyncOps[n % capacity]. The
+    // commands oldestSeqNum ... opSeqNums are the ones in flight, older ones
+    // have completed and their slots are free. Completion is observed
+    // through the completion signals only, so commands finishing never touch
+    // the ring; the threads sending commands sweep the completed ones off
+    // its old end. acccelerator_view::wait() would trigger HSAQueue::wait(),
+    // which waits for the commands in flight.
     //
-    std::vector< std::shared_ptr<KalmarAsyncOp> > asyncOps;
+    std::shared_ptr<KalmarAsyncOp> asyncOps[MAX_INFLIGHT_COMMANDS_PER_QUEUE];
 
     uint64_t                                      opSeqNums;
 
+    // sequence number of the oldest command which may be in flight
+    uint64_t                                      oldestSeqNum;
+
 
     // Kind of the youngest command in the queue.
     // Used to detect and enforce dependencies between commands.
@@ -749,30 +988,25 @@ private:
 
 
     //
-    // kernelBufferMap and bufferKernelMap forms the dependency graph of
+    // kernelBufferMap and bufferDeps form the dependency graph of
     // kernel / kernel dispatches / buffers
     //
     // For a particular kernel k, kernelBufferMap[k] holds a vector of
     // host buffers used by k. The vector is filled at HSAQueue::Push(),
     // when kernel arguments are prepared.
     //
-    // When a kenrel k is to be dispatched, kernelBufferMap[k] will be traversed
-    // to figure out if there is any previous kernel dispatch associated for
-    // each buffer b used by k.  This is done by checking bufferKernelMap[b].
-    // If there are previous kernel dispatches which use b, then we wait on
-    // them before dispatch kernel k. bufferKernelMap[b] will be cleared then.
+    // When a kernel k is to be dispatched, bufferDeps collects the previous
+    // kernel dispatches still using the buffers of k, and barrier-AND
+    // packets make the dispatch of k wait for them on the device.
     //
-    // After kernel k is dispatched, we'll get a KalmarAsync object f, we then
-    // walk through each buffer b used by k and mark the association as:
-    // bufferKernelMap[b] = f
+    // After kernel k is dispatched, we'll get a KalmarAsync object f, which
+    // bufferDeps records as the user of each buffer of k.
     //
     // Finally kernelBufferMap[k] will be cleared.
     //
 
     // association between buffers and kernel dispatches
-    // key: buffer address
-    // value: a vector of kernel dispatches
-    std::map<void*, std::vector< std::weak_ptr<KalmarAsyncOp> > > bufferKernelMap;
+    BufferDependencies bufferDeps;
 
     // association between a kernel and buffers used by it
     // key: kernel
@@ -782,8 +1016,46 @@ private:
     // signal used by sync copy only
     hsa_signal_t  sync_copy_signal;
 
+    // kernarg segments of the dispatches, nullptr if kernargs are not placed
+    // in the kernarg region
+    KernargSlabs* kernargSlabs;
+
+    //
+    // batch of AQL packets
+    //
+    // Between beginBatch() and endBatch() the packets of kernel dispatches
+    // and barriers are kept in batchPackets instead of being written to the
+    // HSA queue one by one. flush() reserves the slots for all of them at
+    // once, writes them and rings the doorbell a single time. The batch is
+    // flushed when it is full, when it ends, and before the host waits on a
+    // command of the queue or copies data through it. Any thread using the
+    // queue may open, fill, end or flush the batch, so batchPackets and
+    // batchDepth are guarded by batchMutex.
+    //
+    std::vector<AqlPacket> batchPackets;
+
+    // number of beginBatch() not matched by endBatch() yet
+    int batchDepth;
+
+    std::mutex batchMutex;
+
+    // write the packets of the batch to the HSA queue, batchMutex held
+    void submitBatch() {
+        if (batchPackets.empty())
+            return;
+        HSAQueueRing ring = { commandQueue };
+        AqlPacketWriter<HSAQueueRing> writer(ring);
+        if (!writer.reserve(batchPackets.size())) {
+            checkHCCRuntimeStatus(Kalmar::HCCRuntimeStatus::HCCRT_STATUS_ERROR_COMMAND_QUEUE_OVERFLOW, __LINE__, commandQueue);
+        }
+        for (auto& packet : batchPackets)
+            writer.write(packet);
+        writer.commit();
+        batchPackets.clear();
+    }
+
 public:
-    HSAQueue(KalmarDevice* pDev, hsa_agent_t agent, execute_order order) : KalmarQueue(pDev, queuing_mode_automatic, order), commandQueue(nullptr), asyncOps(), opSeqNums(0), bufferKernelMap(), kernelBufferMap() {
+    HSAQueue(KalmarDevice* pDev, hsa_agent_t agent, execute_order order, KernargSlabs* kernargSlabs) : KalmarQueue(pDev, queuing_mode_automatic, order), commandQueue(nullptr), asyncOps(), opSeqNums(0), oldestSeqNum(1), bufferDeps(), kernelBufferMap(), kernargSlabs(kernargSlabs), batchPackets(), batchDepth(0), batchMutex() {
         hsa_status_t status;
 
         /// Query the maximum size of the queue.
@@ -815,14 +1087,16 @@ public:
         std::cerr << "HSAQueue::dispose() in\n";
 #endif
 
-        // wait on all existing kernel dispatches and barriers to complete
+        // submit the open batch, if any, and wait on all existing kernel
+        // dispatches and barriers to complete
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batchDepth = 0;
+        }
         wait();
 
-        // clear bufferKernelMap
-        for (auto iter = bufferKernelMap.begin(); iter != bufferKernelMap.end(); ++iter) {
-           iter->second.clear();
-        }
-        bufferKernelMap.clear();
+        // clear bufferDeps
+        bufferDeps.clear();
 
         // clear kernelBufferMap
         for (auto iter = kernelBufferMap.begin(); iter != kernelBufferMap.end(); ++iter) {
@@ -840,6 +1114,12 @@ public:
         status = hsa_signal_destroy(sync_copy_signal);
         STATUS_CHECK(status, __LINE__);
 
+        // let the next queue of the device use the kernarg segments
+        if (kernargSlabs != nullptr) {
+            kernargSlabs->inUse.store(false, std::memory_order_release);
+            kernargSlabs = nullptr;
+        }
+
 #if KALMAR_DEBUG
         std::cerr << "HSAQueue::dispose() out\n";
 #endif
@@ -859,14 +1139,52 @@ public:
 #endif
     }
 
-    // FIXME: implement flush
-    //
+    void flush() override {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        submitBatch();
+    }
+
+    void beginBatch() override {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (batchDepth++ == 0)
+            batchPackets.reserve(AQL_BATCH_SIZE);
+    }
+
+    void endBatch() override {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (batchDepth > 0 && --batchDepth == 0)
+            submitBatch();
+    }
+
+    // send packet to the packet processor, or add it to the open batch
+    // returns true if packet was added to the batch
+    template <typename Packet>
+    bool submitPacket(const Packet& packet) {
+        std::unique_lock<std::mutex> lock(batchMutex);
+        if (batchDepth > 0) {
+            batchPackets.push_back(AqlPacket(packet));
+            if (batchPackets.size() == AQL_BATCH_SIZE)
+                submitBatch();
+            return true;
+        }
+        lock.unlock();
+
+        HSAQueueRing ring = { commandQueue };
+        AqlPacketWriter<HSAQueueRing> writer(ring);
+        if (!writer.reserve(1)) {
+            checkHCCRuntimeStatus(Kalmar::HCCRuntimeStatus::HCCRT_STATUS_ERROR_COMMAND_QUEUE_OVERFLOW, __LINE__, commandQueue);
+        }
+        writer.write(packet);
+        writer.commit();
+        return false;
+    }
+
     void printAsyncOps(std::ostream &s = std::cerr)
     {
         hsa_signal_value_t oldv=0;
-        s << "Queue: " << this << "  : " << asyncOps.size() << " op entries\n";
-        for (int i=0; i<asyncOps.size(); i++) {
-            const std::shared_ptr<KalmarAsyncOp::KalmarAsyncOp> &op = asyncOps[i];
+        s << "Queue: " << this << "  : " << (opSeqNums + 1 - oldestSeqNum) << " op entries\n";
+        for (uint64_t i = oldestSeqNum; i <= opSeqNums; i++) {
+            const std::shared_ptr<KalmarAsyncOp::KalmarAsyncOp> &op = slot(i);
             s << "index:" << std::setw(4) << i ;
             if (op != nullptr) {
                 s << " op#"<< op->getSeqNum() ;
@@ -887,26 +1205,50 @@ public:
         }
     }
 
+    std::shared_ptr<KalmarAsyncOp>& slot(uint64_t seqNum) {
+        return asyncOps[seqNum & (MAX_INFLIGHT_COMMANDS_PER_QUEUE - 1)];
+    }
+
+    // block until the command op has completed
+    static void waitSignal(const std::shared_ptr<KalmarAsyncOp>& op, hcWaitMode mode) {
+        hsa_signal_t signal = *static_cast<hsa_signal_t*>(op->getNativeHandle());
+        hsa_signal_wait_acquire(signal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX,
+                                mode == hcWaitModeActive ? HSA_WAIT_STATE_ACTIVE : HSA_WAIT_STATE_BLOCKED);
+    }
+
+    // free the slots of the completed commands at the old end of the ring
+    void sweepAsyncOps() {
+        while (oldestSeqNum <= opSeqNums) {
+            std::shared_ptr<KalmarAsyncOp>& op = slot(oldestSeqNum);
+            if (op != nullptr && !op->isReady())
+                break;
+            op = nullptr;
+            ++oldestSeqNum;
+        }
+    }
+
     // Save the command and type
     void pushAsyncOp(std::shared_ptr<KalmarAsyncOp> op) {
-        op->setSeqNum(++opSeqNums);
-
+        sweepAsyncOps();
+        if (opSeqNums + 1 - oldestSeqNum >= MAX_INFLIGHT_COMMANDS_PER_QUEUE) {
 #if KALMAR_DEBUG_ASYNC_COPY
-        std::cerr << "  pushing op=" << op << "  #" << op->getSeqNum() << " signal="<< std::hex  << ((hsa_signal_t*)op->getNativeHandle())->handle
-                  << "  commandKind=" << getHcCommandKindString(op->getCommandKind()) << std::endl;
+            std::cerr << "Hit max inflight ops. op#" << opSeqNums << " wait for op#" << oldestSeqNum << "\n";
 #endif
+            waitSignal(slot(oldestSeqNum), hcWaitModeBlocked);
+            slot(oldestSeqNum) = nullptr;
+            ++oldestSeqNum;
+        }
 
+        op->setSeqNum(++opSeqNums);
 
-        if (asyncOps.size() >= MAX_INFLIGHT_COMMANDS_PER_QUEUE) {
 #if KALMAR_DEBUG_ASYNC_COPY
-            std::cerr << "Hit max inflight ops asyncOps.size=" << asyncOps.size() << ". op#" << opSeqNums << " force sync\n";
+        std::cerr << "  pushing op=" << op << "  #" << op->getSeqNum() << " signal="<< std::hex  << ((hsa_signal_t*)op->getNativeHandle())->handle
+                  << "  commandKind=" << getHcCommandKindString(op->getCommandKind()) << std::endl;
 #endif
 
-            wait();
-        }
-        asyncOps.push_back(op);
+        slot(opSeqNums) = std::move(op);
 
-        youngestCommandKind = op->getCommandKind();
+        youngestCommandKind = slot(opSeqNums)->getCommandKind();
     }
 
 
@@ -919,7 +1261,9 @@ public:
         hcCommandKind newCommandKind = newOp->getCommandKind();
         assert (newCommandKind != hcCommandInvalid);
 
-        if (!asyncOps.empty()) {
+        // a completed youngest command needs no dependency
+        sweepAsyncOps();
+        if (oldestSeqNum <= opSeqNums) {
             assert (youngestCommandKind != hcCommandInvalid);
 
 
@@ -943,7 +1287,7 @@ public:
 #if KALMAR_DEBUG_ASYNC_COPY
                 std::cerr <<  "command type changed " << getHcCommandKindString(youngestCommandKind) << "  ->  " << getHcCommandKindString(newCommandKind) << "\n" ;
 #endif
-                return asyncOps.back();
+                return slot(opSeqNums);
             }
         }
 
@@ -960,16 +1304,12 @@ public:
 
 
     int getPendingAsyncOps() override {
+        sweepAsyncOps();
         int count = 0;
-        for (int i = 0; i < asyncOps.size(); ++i) {
-            auto asyncOp = asyncOps[i];
-
-            if (asyncOp != nullptr) {
-                hsa_signal_t signal = *(static_cast <hsa_signal_t*> (asyncOp->getNativeHandle()));
-                hsa_signal_value_t v = hsa_signal_load_relaxed(signal);
-                if (v != 0) {
-                    ++count;
-                }
+        for (uint64_t i = oldestSeqNum; i <= opSeqNums; ++i) {
+            auto& asyncOp = slot(i);
+            if (asyncOp != nullptr && !asyncOp->isReady()) {
+                ++count;
             }
         }
         return count;
@@ -984,18 +1324,24 @@ public:
 
       printAsyncOps(std::cerr);
 #endif
-      for (int i = asyncOps.size()-1; i >= 0;  i--) {
-        if (asyncOps[i] != nullptr) {
-            auto asyncOp = asyncOps[i];
-            // wait on valid futures only
-            std::shared_future<void>* future = asyncOp->getFuture();
-            if (future->valid()) {
-                future->wait();
+      flush();
+      if (get_execute_order() == execute_in_order) {
+        // commands complete in order, the youngest one completes last
+        sweepAsyncOps();
+        if (oldestSeqNum <= opSeqNums) {
+            waitSignal(slot(opSeqNums), mode);
+        }
+      } else {
+        for (uint64_t i = opSeqNums; i >= oldestSeqNum; i--) {
+            if (slot(i) != nullptr) {
+                waitSignal(slot(i), mode);
             }
         }
       }
       // clear async operations table
-      asyncOps.clear();
+      for (; oldestSeqNum <= opSeqNums; ++oldestSeqNum) {
+          slot(oldestSeqNum) = nullptr;
+      }
     }
 
     void LaunchKernel(void *ker, size_t nr_dim, size_t *global, size_t *local) override {
@@ -1011,11 +1357,8 @@ public:
         dispatch->setLaunchAttributes(nr_dim, global, local);
         dispatch->setDynamicGroupSegment(dynamic_group_size);
 
-        // wait for previous kernel dispatches be completed
-        std::for_each(std::begin(kernelBufferMap[ker]), std::end(kernelBufferMap[ker]),
-                      [&] (void* buffer) {
-                        waitForDependentAsyncOps(buffer);
-                      });
+        // order the dispatch after previous kernel dispatches using its buffers
+        enqueueBufferDeps(ker);
 
         waitForStreamDeps(dispatch);
 
@@ -1046,11 +1389,8 @@ public:
         dispatch->setLaunchAttributes(nr_dim, global, local);
         dispatch->setDynamicGroupSegment(dynamic_group_size);
 
-        // wait for previous kernel dispatches be completed
-        std::for_each(std::begin(kernelBufferMap[ker]), std::end(kernelBufferMap[ker]),
-                      [&] (void* buffer) {
-                        waitForDependentAsyncOps(buffer);
-                      });
+        // order the dispatch after previous kernel dispatches using its buffers
+        enqueueBufferDeps(ker);
 
         waitForStreamDeps(dispatch);
 
@@ -1065,10 +1405,7 @@ public:
         pushAsyncOp(sp_dispatch);
 
         // associate all buffers used by the kernel with the kernel dispatch instance
-        std::for_each(std::begin(kernelBufferMap[ker]), std::end(kernelBufferMap[ker]),
-                      [&] (void* buffer) {
-                        bufferKernelMap[buffer].push_back(sp_dispatch);
-                      });
+        bufferDeps.record(kernelBufferMap[ker], sp_dispatch);
 
         // clear data in kernelBufferMap
         kernelBufferMap[ker].clear();
@@ -1083,20 +1420,24 @@ public:
     }
 
     // wait for dependent async operations to complete
-    void waitForDependentAsyncOps(void* buffer) {
-        auto&& dependentAsyncOpVector = bufferKernelMap[buffer];
-        for (int i = 0; i < dependentAsyncOpVector.size(); ++i) {
-          auto dependentAsyncOp = dependentAsyncOpVector[i];
-          if (!dependentAsyncOp.expired()) {
-            auto dependentAsyncOpPointer = dependentAsyncOp.lock();
-            // wait on valid futures only
-            std::shared_future<void>* future = dependentAsyncOpPointer->getFuture();
-            if (future->valid()) {
-              future->wait();
-            }
-          }
+    // the host is about to access buffer, so it has to block
+    void waitForDependentAsyncOps(void* buffer) override {
+        flush();
+        bufferDeps.wait(buffer);
+    }
+
+    // make the next packet wait for the kernel dispatches still using the
+    // buffers of ker, without blocking the host
+    void enqueueBufferDeps(void* ker) {
+        std::vector<std::shared_ptr<KalmarAsyncOp>> deps = bufferDeps.collect(kernelBufferMap[ker]);
+        // in-order queues dispatch kernels with the barrier bit set, the
+        // packet processor already waits for every previous dispatch
+        if (get_execute_order() == execute_in_order)
+            return;
+        for (size_t i = 0; i < deps.size(); i += HSA_BARRIER_DEP_SIGNAL_CNT) {
+            int count = std::min<size_t>(HSA_BARRIER_DEP_SIGNAL_CNT, deps.size() - i);
+            EnqueueMarkerWithDependency(count, &deps[i]);
         }
-        dependentAsyncOpVector.clear();
     }
 
 
@@ -1339,10 +1680,27 @@ public:
         }
     }
 
+    bool PushArgs(void *kernel, const void* blob, size_t size, int count,
+                  void* const* modified, int modifiedCount) override {
+        HSADispatch *dispatch = reinterpret_cast<HSADispatch*>(kernel);
+        dispatch->pushArgBlock(blob, size, count);
+
+        // register the buffers written by the kernel, as Push does
+        if (modifiedCount > 0) {
+          auto& buffers = kernelBufferMap[kernel];
+          buffers.insert(buffers.end(), modified, modified + modifiedCount);
+        }
+        return true;
+    }
+
     void* getHSAQueue() override {
         return static_cast<void*>(commandQueue);
     }
 
+    KernargSlabs* getKernargSlabs() {
+        return kernargSlabs;
+    }
+
     void* getHSAAgent() override;
 
     void* getHostAgent() override;
@@ -1439,6 +1797,9 @@ public:
         // create shared_ptr instance
         std::shared_ptr<HSACopy> copyCommand = std::make_shared<HSACopy>(src, dst, size_bytes);
 
+        // the copy may depend on packets of the open batch
+        flush();
+
         // euqueue the async copy command
         status = copyCommand.get()->enqueueAsync(this);
         STATUS_CHECK(status, __LINE__);
@@ -1490,22 +1851,6 @@ public:
         std::cerr << "HSAQueue::copy() complete\n";
 #endif
     };
-
-    // remove finished async operation from waiting list
-    void removeAsyncOp(KalmarAsyncOp* asyncOp) {
-        for (int i = 0; i < asyncOps.size(); ++i) {
-            if (asyncOps[i].get() == asyncOp) {
-                asyncOps[i] = nullptr;
-            }
-        }
-
-        // GC for finished kernels
-        if (asyncOps.size() > ASYNCOPS_VECTOR_GC_SIZE) {
-            //printf ("GC\n");
-          asyncOps.erase(std::remove(asyncOps.begin(), asyncOps.end(), nullptr),
-                         asyncOps.end());
-        }
-    }
 };
 
 
@@ -1513,14 +1858,13 @@ public:
 class HSADevice final : public KalmarDevice
 {
 private:
-    /// memory pool for kernargs
-    std::vector<void*> kernargPool;
-    std::vector<bool> kernargPoolFlag;
-    int kernargCursor;
-    std::mutex kernargPoolMutex;
+    /// kernarg segments of the queues, guarded by queues_mutex
+    std::vector<std::unique_ptr<KernargSlabs>> kernargSlabs;
 
 
     std::map<std::string, HSAKernel *> programs;
+    /// guards programs and executables, host threads build kernels one at a time
+    std::mutex programs_mutex;
     hsa_agent_t agent;
     size_t max_tile_static_size;
 
@@ -1708,11 +2052,11 @@ public:
 
 
     HSADevice(hsa_agent_t a, hsa_agent_t host) : KalmarDevice(access_type_read_write),
-                               agent(a), programs(), max_tile_static_size(0),
+                               agent(a), programs(), programs_mutex(), max_tile_static_size(0),
                                queues(), queues_mutex(),
                                ri(),
                                useCoarseGrainedRegion(false),
-                               kernargPool(), kernargPoolFlag(), kernargCursor(0), kernargPoolMutex(),
+                               kernargSlabs(),
                                executables(),
                                profile(hcAgentProfileNone),
                                path(), description(), hostAgent(host),
@@ -1781,29 +2125,6 @@ public:
         }
         useCoarseGrainedRegion = result;
 
-        /// pre-allocate a pool of kernarg buffers in case:
-        /// - kernarg region is available
-        /// - compile-time macro USE_KERNARG_REGION is set
-        /// - compile-time macro KERNARG_POOL_SIZE is larger than 0
-        if (hasHSAKernargRegion() && USE_KERNARG_REGION) {
-#if KERNARG_POOL_SIZE > 0
-            hsa_amd_memory_pool_t kernarg_region = getHSAKernargRegion();
-
-            // pre-allocate kernarg buffers
-            void* kernargMemory = nullptr;
-            for (int i = 0; i < KERNARG_POOL_SIZE; ++i) {
-                status = hsa_amd_memory_pool_allocate(kernarg_region, KERNARG_BUFFER_SIZE, 0, &kernargMemory);
-                STATUS_CHECK(status, __LINE__);
-
-                // Allow device to access to it once it is allocated. Normally, this memory pool is on system memory.
-                status = hsa_amd_agents_allow_access(1, &agent, NULL, kernargMemory);
-                STATUS_CHECK(status, __LINE__);
-
-                kernargPool.push_back(kernargMemory);
-                kernargPoolFlag.push_back(false);
-            }
-#endif
-        }
 
         // Setup AM pool.
         ri._am_memory_pool = (ri._found_local_memory_pool)
@@ -1886,24 +2207,8 @@ public:
         queues.clear();
         queues_mutex.unlock();
 
-        // deallocate kernarg buffers in the pool
-        if (hasHSAKernargRegion() && USE_KERNARG_REGION) {
-#if KERNARG_POOL_SIZE > 0
-            kernargPoolMutex.lock();
-
-            hsa_status_t status = HSA_STATUS_SUCCESS;
-
-            for (int i = 0; i < kernargPool.size(); ++i) {
-                hsa_amd_memory_pool_free(kernargPool[i]);
-                STATUS_CHECK(status, __LINE__);
-            }
-
-            kernargPool.clear();
-            kernargPoolFlag.clear();
-
-            kernargPoolMutex.unlock();
-#endif
-        }
+        // deallocate the kernarg segments of the queues
+        kernargSlabs.clear();
 
         // release all data in programs
         for (auto kernel_iterator : programs) {
@@ -2031,6 +2336,7 @@ public:
     }
 
     void BuildProgram(void* size, void* source, bool needsCompilation = true) override {
+        std::lock_guard<std::mutex> lk(programs_mutex);
         if (executables.find(kernel_checksum((size_t)size, source)) == executables.end()) {
             bool use_amdgpu = false;
 #ifdef HSA_USE_AMDGPU_BACKEND
@@ -2086,7 +2392,13 @@ public:
     }
 
     void* CreateKernel(const char* fun, void* size, void* source, bool needsCompilation = true) override {
+        return CreateKernelFromHandle(LookupKernel(fun, size, source, needsCompilation));
+    }
+
+    // entries of programs are never removed, the HSAKernel is the handle
+    void* LookupKernel(const char* fun, void* size, void* source, bool needsCompilation = true) override {
         std::string str(fun);
+        std::lock_guard<std::mutex> lk(programs_mutex);
         HSAKernel *kernel = programs[str];
         if (!kernel) {
             bool use_amdgpu = false;
@@ -2119,6 +2431,11 @@ public:
             }
             programs[str] = kernel;
         }
+        return kernel;
+    }
+
+    void* CreateKernelFromHandle(void* handle) override {
+        HSAKernel *kernel = static_cast<HSAKernel*>(handle);
 
         // HSADispatch instance will be deleted in:
         // HSAQueue::LaunchKernel()
@@ -2139,8 +2456,12 @@ public:
     }
 
     std::shared_ptr<KalmarQueue> createQueue(execute_order order = execute_in_order) override {
-        std::shared_ptr<KalmarQueue> q =  std::shared_ptr<KalmarQueue>(new HSAQueue(this, agent, order));
+        std::shared_ptr<KalmarQueue> q =  std::shared_ptr<KalmarQueue>(new HSAQueue(this, agent, order, acquireKernargSlabs()));
         queues_mutex.lock();
+        // forget the queues already gone, threads come and go with their own
+        queues.erase(std::remove_if(queues.begin(), queues.end(),
+                                    [] (const std::weak_ptr<KalmarQueue>& queue) { return queue.expired(); }),
+                     queues.end());
         queues.push_back(q);
         queues_mutex.unlock();
         return q;
@@ -2225,151 +2546,48 @@ public:
         return cpu_accessible_am;
     };
 
-    void releaseKernargBuffer(void* kernargBuffer, int kernargBufferIndex) {
-        if (hasHSAKernargRegion() && USE_KERNARG_REGION) {
-            if ( (KERNARG_POOL_SIZE > 0) && (kernargBufferIndex >= 0) ) {
-                kernargPoolMutex.lock();
-
-                // mark the kernarg buffer pointed by kernelBufferIndex as available
-                kernargPoolFlag[kernargBufferIndex] = false;
-
-                kernargPoolMutex.unlock();
-             } else {
-                if (kernargBuffer != nullptr) {
-                    hsa_amd_memory_pool_free(kernargBuffer);
-                }
-             }
+    // the kernarg segments for a new queue: those of a queue already gone, or
+    // new ones
+    KernargSlabs* acquireKernargSlabs() {
+        if (!hasHSAKernargRegion() || !USE_KERNARG_REGION || KERNARG_POOL_SIZE <= 0)
+            return nullptr;
+        std::lock_guard<std::mutex> lk(queues_mutex);
+        for (auto& slabs : kernargSlabs) {
+            if (!slabs->inUse.load(std::memory_order_acquire)) {
+                slabs->inUse.store(true, std::memory_order_relaxed);
+                return slabs.get();
+            }
         }
+        kernargSlabs.emplace_back(new KernargSlabs(getHSAKernargRegion(), agent, kernargStats));
+        kernargSlabs.back()->inUse.store(true, std::memory_order_relaxed);
+        return kernargSlabs.back().get();
     }
 
-    std::pair<void*, int> getKernargBuffer(int size) {
+    // allocate a kernarg buffer too large for the kernarg segments of the
+    // queues, for a single dispatch
+    void* allocKernargBuffer(size_t size) {
         void* ret = nullptr;
-        int cursor = 0;
-
-        if (hasHSAKernargRegion() && USE_KERNARG_REGION) {
-
-            // find an available buffer in the pool in case
-            // - kernarg pool is available
-            // - requested size is smaller than KERNARG_BUFFER_SIZE
-            if ( (KERNARG_POOL_SIZE > 0) && (size <= KERNARG_BUFFER_SIZE) ) {
-                kernargPoolMutex.lock();
-                cursor = kernargCursor;
-
-                if (kernargPoolFlag[cursor] == false) {
-                    // the cursor is valid, use it
-                    ret = kernargPool[cursor];
-
-                    // set the kernarg buffer as used
-                    kernargPoolFlag[cursor] = true;
-
-                    // simply move the cursor to the next index
-                    ++kernargCursor;
-                    if (kernargCursor == kernargPool.size()) kernargCursor = 0;
-                } else {
-                    // the cursor is not valid, sequentially find the next available slot
-                    bool found = false;
+        hsa_amd_memory_pool_t kernarg_region = getHSAKernargRegion();
 
-                    int startingCursor = cursor;
-                    do {
-                        ++cursor;
-                        if (cursor == kernargPool.size()) cursor = 0;
-
-                        if (kernargPoolFlag[cursor] == false) {
-                            // the cursor is valid, use it
-                            ret = kernargPool[cursor];
-
-                            // set the kernarg buffer as used
-                            kernargPoolFlag[cursor] = true;
-
-                            // simply move the cursor to the next index
-                            kernargCursor = cursor + 1;
-                            if (kernargCursor == kernargPool.size()) kernargCursor = 0;
-
-                            // break from the loop
-                            found = true;
-                            break;
-                        }
-                    } while(cursor != startingCursor); // ensure we at most scan the vector once
-
-                    if (found == false) {
-                        hsa_status_t status = HSA_STATUS_SUCCESS;
-
-                        // increase kernarg pool on demand by KERNARG_POOL_SIZE
-                        hsa_amd_memory_pool_t kernarg_region = getHSAKernargRegion();
-
-                        // keep track of the size of kernarg pool before increasing it
-                        int oldKernargPoolSize = kernargPool.size();
-                        int oldKernargPoolFlagSize = kernargPoolFlag.size();
-                        assert(oldKernargPoolSize == oldKernargPoolFlagSize);
-
-                        // pre-allocate kernarg buffers
-                        void* kernargMemory = nullptr;
-                        for (int i = 0; i < KERNARG_POOL_SIZE; ++i) {
-                            status = hsa_amd_memory_pool_allocate(kernarg_region, KERNARG_BUFFER_SIZE, 0, &kernargMemory);
-                            STATUS_CHECK(status, __LINE__);
-
-                            status = hsa_amd_agents_allow_access(1, &agent, NULL, kernargMemory);
-                            STATUS_CHECK(status, __LINE__);
-
-                            kernargPool.push_back(kernargMemory);
-                            kernargPoolFlag.push_back(false);
-                        }
-
-                        assert(kernargPool.size() == oldKernargPoolSize + KERNARG_POOL_SIZE);
-                        assert(kernargPoolFlag.size() == oldKernargPoolFlagSize + KERNARG_POOL_SIZE);
-
-                        // set return values, after the pool has been increased
-
-                        // use the first item in the newly allocated pool
-                        cursor = oldKernargPoolSize;
-
-                        // access the new item through the newly assigned cursor
-                        ret = kernargPool[cursor];
-
-                        // mark the item as used
-                        kernargPoolFlag[cursor] = true;
-
-                        // simply move the cursor to the next index
-                        kernargCursor = cursor + 1;
-                        if (kernargCursor == kernargPool.size()) kernargCursor = 0;
-
-                        found = true;
-                    }
-
-                }
-
-                kernargPoolMutex.unlock();
-            } else {
-                // allocate new buffers in case:
-                // - the kernarg pool is set at compile-time
-                // - requested kernarg buffer size is larger than KERNARG_BUFFER_SIZE
-
-                hsa_status_t status = HSA_STATUS_SUCCESS;
-                hsa_amd_memory_pool_t kernarg_region = getHSAKernargRegion();
-
-                status = hsa_amd_memory_pool_allocate(kernarg_region, size, 0, &ret);
-                STATUS_CHECK(status, __LINE__);
+        hsa_status_t status = hsa_amd_memory_pool_allocate(kernarg_region, size, 0, &ret);
+        STATUS_CHECK(status, __LINE__);
 
-                status = hsa_amd_agents_allow_access(1, &agent, NULL, ret);
-                STATUS_CHECK(status, __LINE__);
+        status = hsa_amd_agents_allow_access(1, &agent, NULL, ret);
+        STATUS_CHECK(status, __LINE__);
 
-                // set cursor value as -1 to notice the buffer would be deallocated
-                // instead of recycled back into the pool
-                cursor = -1;
-            }
-        } else {
-            // this function does nothing in case:
-            // - kernarg region is not available on the agent
-            // - or we choose not to use kernarg region by setting USE_KERNARG_REGION to 0
-        }
+        ++kernargStats.oversized;
+        return ret;
+    }
 
-        return std::make_pair(ret, cursor);
+    void releaseKernargBuffer(void* kernargBuffer) {
+        hsa_amd_memory_pool_free(kernargBuffer);
     }
 
     void* getSymbolAddress(const char* symbolName) override {
         hsa_status_t status;
 
         unsigned long* symbol_ptr = nullptr;
+        std::lock_guard<std::mutex> lk(programs_mutex);
         if (executables.size() != 0) {
 
             // iterate through all HSA executables
@@ -2600,13 +2818,146 @@ private:
 
 };
 
+/// HSA signals shared by the queues of every thread
+///
+/// Signals are created SIGNAL_POOL_SIZE at a time and live as long as the
+/// pool. The free ones form a lock-free stack linked through their slots: the
+/// lower half of the head is the slot on top plus one, zero once the stack is
+/// empty, and the upper half is a tag bumped by every update, so a thread
+/// holding a stale head cannot pop a slot somebody else popped and pushed
+/// back meanwhile. Only growing the pool takes a lock.
+///
+/// The consumers are passed on to hsa_signal_create(). They must include
+/// every agent which waits on the signals; an empty list allows any agent to.
+/// With attributes, the signals are created by hsa_amd_signal_create()
+/// instead: HSA_AMD_SIGNAL_AMD_GPU_ONLY leaves out the interrupt event, so
+/// the host can only wait on such signals by polling.
+class SignalPool
+{
+    struct Chunk {
+        hsa_signal_t signals[SIGNAL_POOL_SIZE];
+        std::atomic<uint32_t> next[SIGNAL_POOL_SIZE];
+    };
+
+    std::vector<hsa_agent_t> consumers;
+    uint64_t attributes;
+    std::atomic<Chunk*> chunks[SIGNAL_POOL_MAX_CHUNKS];
+    std::atomic<uint64_t> head;
+    /// number of chunks created so far, guarded by growMutex
+    int chunkCount;
+    std::mutex growMutex;
+
+    Chunk* chunk(uint32_t slot) const {
+        return chunks[slot / SIGNAL_POOL_SIZE].load(std::memory_order_acquire);
+    }
+
+    /// push the slots first ... last, already linked to each other, at once
+    void push(uint32_t first, uint32_t last) {
+        std::atomic<uint32_t>& next = chunk(last)->next[last % SIGNAL_POOL_SIZE];
+        uint64_t oldHead = head.load(std::memory_order_relaxed);
+        uint64_t newHead;
+        do {
+            next.store(uint32_t(oldHead), std::memory_order_relaxed);
+            newHead = (((oldHead >> 32) + 1) << 32) | (first + 1);
+        } while (!head.compare_exchange_weak(oldHead, newHead, std::memory_order_release,
+                                             std::memory_order_relaxed));
+    }
+
+    void grow() {
+        std::lock_guard<std::mutex> lock(growMutex);
+        // somebody else grew the pool or released a signal meanwhile
+        if (uint32_t(head.load(std::memory_order_acquire)) != 0)
+            return;
+        if (chunkCount == SIGNAL_POOL_MAX_CHUNKS)
+            throw Kalmar::runtime_exception("HSA signal pool exhausted", chunkCount);
+
+        Chunk* c = new Chunk;
+        const uint32_t first = chunkCount * SIGNAL_POOL_SIZE;
+        for (int i = 0; i < SIGNAL_POOL_SIZE; ++i) {
+            hsa_status_t status;
+            if (attributes)
+                status = hsa_amd_signal_create(1, consumers.size(),
+                                               consumers.empty() ? NULL : consumers.data(),
+                                               attributes, &c->signals[i]);
+            else
+                status = hsa_signal_create(1, consumers.size(),
+                                           consumers.empty() ? NULL : consumers.data(),
+                                           &c->signals[i]);
+            STATUS_CHECK(status, __LINE__);
+            // link slot first + i to slot first + i + 1
+            c->next[i].store(first + i + 2, std::memory_order_relaxed);
+        }
+        chunks[chunkCount].store(c, std::memory_order_release);
+        ++chunkCount;
+        push(first, first + SIGNAL_POOL_SIZE - 1);
+
+#if KALMAR_DEBUG or KALMAR_DEBUG_ASYNC_COPY
+        std::cerr << "grew signal pool to size=" << chunkCount * SIGNAL_POOL_SIZE << "\n";
+#endif
+    }
+
+public:
+    SignalPool(const std::vector<hsa_agent_t>& consumers, uint64_t attributes = 0)
+        : consumers(consumers), attributes(attributes), head(0), chunkCount(0), growMutex() {
+        for (auto& c : chunks)
+            c.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~SignalPool() {
+        for (int i = 0; i < chunkCount; ++i) {
+            Chunk* c = chunks[i].load(std::memory_order_relaxed);
+            for (int j = 0; j < SIGNAL_POOL_SIZE; ++j) {
+                hsa_status_t status = hsa_signal_destroy(c->signals[j]);
+                STATUS_CHECK(status, __LINE__);
+            }
+            delete c;
+        }
+    }
+
+    /// create the first SIGNAL_POOL_SIZE signals ahead of time
+    void reserve() {
+        grow();
+    }
+
+    /// a signal no command uses, and the slot to release it with
+    std::pair<hsa_signal_t, int> get() {
+        uint64_t oldHead = head.load(std::memory_order_acquire);
+        for (;;) {
+            if (uint32_t(oldHead) == 0) {
+                grow();
+                oldHead = head.load(std::memory_order_acquire);
+                continue;
+            }
+            const uint32_t slot = uint32_t(oldHead) - 1;
+            Chunk* c = chunk(slot);
+            const uint64_t newHead = (((oldHead >> 32) + 1) << 32) |
+                                     c->next[slot % SIGNAL_POOL_SIZE].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(oldHead, newHead, std::memory_order_acquire,
+                                           std::memory_order_acquire))
+                return std::make_pair(c->signals[slot % SIGNAL_POOL_SIZE], int(slot));
+        }
+    }
+
+    /// the signal in slot may be handed out again, called from any thread
+    void release(int slot) {
+        push(slot, slot);
+    }
+};
+
 class HSAContext final : public KalmarContext
 {
     /// memory pool for signals
-    std::vector<hsa_signal_t> signalPool;
-    std::vector<bool> signalPoolFlag;
-    int signalCursor;
-    std::mutex signalPoolMutex;
+    ///
+    /// The signals of polledSignalPool raise no interrupt on completion, the
+    /// host waits for them by polling. The index handed out with a signal is
+    /// its slot in the pool shifted left by one, the lowest bit set for
+    /// polledSignalPool.
+    SignalPool* signalPool;
+    SignalPool* polledSignalPool;
+
+    /// kernel dispatches of at most this many work-items complete on signals
+    /// of polledSignalPool, set by HCC_POLLED_SIGNAL_GRID
+    uint64_t polledSignalMaxGrid;
     /* TODO: Modify properly when supporing multi-gpu.
     When using memory pool api, each agent will only report memory pool
     which is attached with the agent itself physically, eg, GPU won't
@@ -2677,7 +3028,7 @@ class HSAContext final : public KalmarContext
 
 
 public:
-    HSAContext() : KalmarContext(), signalPool(), signalPoolFlag(), signalCursor(0), signalPoolMutex() {
+    HSAContext() : KalmarContext(), signalPool(nullptr), polledSignalPool(nullptr), polledSignalMaxGrid(0) {
         host.handle = (uint64_t)-1;
         // initialize HSA runtime
 #if KALMAR_DEBUG
@@ -2707,22 +3058,29 @@ public:
 
 
 #if SIGNAL_POOL_SIZE > 0
-        signalPoolMutex.lock();
+        signalPool = new SignalPool(std::vector<hsa_agent_t>());
+        // signals without an interrupt event, the host polls for them
+        polledSignalPool = new SignalPool(agents, HSA_AMD_SIGNAL_AMD_GPU_ONLY);
 
         // pre-allocate signals
 #if KALMAR_DEBUG_ASYNC_COPY
         std::cerr << " precallocate " << SIGNAL_POOL_SIZE << " signals\n";
 #endif
-        for (int i = 0; i < SIGNAL_POOL_SIZE; ++i) {
-          hsa_signal_t signal;
-          status = hsa_signal_create(1, 0, NULL, &signal);
-          STATUS_CHECK(status, __LINE__);
-          signalPool.push_back(signal);
-          signalPoolFlag.push_back(false);
-        }
-
-        signalPoolMutex.unlock();
+        signalPool->reserve();
 #endif
+
+        // environment variable HCC_POLLED_SIGNAL_GRID may be used to let short
+        // kernels complete without raising an interrupt, the host polls for
+        // them instead
+        const char* polled_grid = getenv("HCC_POLLED_SIGNAL_GRID");
+        if (polled_grid != nullptr)
+            polledSignalMaxGrid = strtoull(polled_grid, nullptr, 0);
+    }
+
+    /// whether a kernel dispatch of gridSize work-items completes on a signal
+    /// raising no interrupt
+    bool usePolledSignal(uint64_t gridSize) const {
+        return gridSize <= polledSignalMaxGrid;
     }
 
     void releaseSignal(hsa_signal_t signal, int signalIndex) {
@@ -2732,117 +3090,30 @@ public:
 #endif
         hsa_status_t status = HSA_STATUS_SUCCESS;
 #if SIGNAL_POOL_SIZE > 0
-        signalPoolMutex.lock();
-
         // restore signal to the initial value 1
         hsa_signal_store_release(signal, 1);
 
-        // mark the signal pointed by signalIndex as available
-        signalPoolFlag[signalIndex] = false;
-
-        signalPoolMutex.unlock();
+        // hand the signal pointed by signalIndex out again
+        SignalPool* pool = (signalIndex & 1) ? polledSignalPool : signalPool;
+        pool->release(signalIndex >> 1);
 #else
         status = hsa_signal_destroy(signal);
         STATUS_CHECK(status, __LINE__);
 #endif
     }
 
-    std::pair<hsa_signal_t, int> getSignal() {
-        hsa_signal_t ret;
-
+    std::pair<hsa_signal_t, int> getSignal(bool polled = false) {
 #if SIGNAL_POOL_SIZE > 0
-        signalPoolMutex.lock();
-        int cursor = signalCursor;
-
-        if (signalPoolFlag[cursor] == false) {
-            // the cursor is valid, use it
-            ret = signalPool[cursor];
-
-            // set the signal as used
-            signalPoolFlag[cursor] = true;
-
-            // simply move the cursor to the next index
-            ++signalCursor;
-            if (signalCursor == signalPool.size()) signalCursor = 0;
-        } else {
-            // the cursor is not valid, sequentially find the next available slot
-            bool found = false;
-            int startingCursor = cursor;
-            do {
-                ++cursor;
-                if (cursor == signalPool.size()) cursor = 0;
-
-                if (signalPoolFlag[cursor] == false) {
-                    // the cursor is valid, use it
-                    ret = signalPool[cursor];
-
-                    // set the signal as used
-                    signalPoolFlag[cursor] = true;
-
-                    // simply move the cursor to the next index
-                    signalCursor = cursor + 1;
-                    if (signalCursor == signalPool.size()) signalCursor = 0;
-
-                    // break from the loop
-                    found = true;
-                    break;
-                }
-            } while(cursor != startingCursor); // ensure we at most scan the vector once
-
-            if (found == false) {
-                hsa_status_t status = HSA_STATUS_SUCCESS;
-
-                // increase signal pool on demand by SIGNAL_POOL_SIZE
-
-                // keep track of the size of signal pool before increasing it
-                int oldSignalPoolSize = signalPool.size();
-                int oldSignalPoolFlagSize = signalPoolFlag.size();
-                assert(oldSignalPoolSize == oldSignalPoolFlagSize);
-
-
-                // increase signal pool on demand for another SIGNAL_POOL_SIZE
-                for (int i = 0; i < SIGNAL_POOL_SIZE; ++i) {
-                    hsa_signal_t signal;
-                    status = hsa_signal_create(1, 0, NULL, &signal);
-                    STATUS_CHECK(status, __LINE__);
-                    signalPool.push_back(signal);
-                    signalPoolFlag.push_back(false);
-                }
-
-#if KALMAR_DEBUG or KALMAR_DEBUG_ASYNC_COPY
-                std::cerr << "grew signal pool to size=" << signalPool.size() << "\n";
-#endif
-
-                assert(signalPool.size() == oldSignalPoolSize + SIGNAL_POOL_SIZE);
-                assert(signalPoolFlag.size() == oldSignalPoolFlagSize + SIGNAL_POOL_SIZE);
-
-                // set return values, after the pool has been increased
-
-                // use the first item in the newly allocated pool
-                cursor = oldSignalPoolSize;
-
-                // access the new item through the newly assigned cursor
-                ret = signalPool[cursor];
-
-                // mark the item as used
-                signalPoolFlag[cursor] = true;
-
-                // simply move the cursor to the next index
-                signalCursor = cursor + 1;
-                if (signalCursor == signalPool.size()) signalCursor = 0;
-
-                found = true;
-            }
-        }
-
-        signalPoolMutex.unlock();
+        SignalPool* pool = polled ? polledSignalPool : signalPool;
+        std::pair<hsa_signal_t, int> ret = pool->get();
+        ret.second = (ret.second << 1) | (polled ? 1 : 0);
+        return ret;
 #else
         hsa_signal_t signal;
         hsa_status_t status = hsa_signal_create(1, 0, NULL, &signal);
         STATUS_CHECK(status, __LINE__);
-        int cursor = 0;
+        return std::make_pair(signal, 0);
 #endif
-        return std::make_pair(ret, cursor);
     }
 
     ~HSAContext() {
@@ -2858,19 +3129,11 @@ public:
         def = nullptr;
 
 #if SIGNAL_POOL_SIZE > 0
-        signalPoolMutex.lock();
-
-        // deallocate signals in the pool
-        for (int i = 0; i < signalPool.size(); ++i) {
-            hsa_signal_t signal;
-            status = hsa_signal_destroy(signalPool[i]);
-            STATUS_CHECK(status, __LINE__);
-        }
-
-        signalPool.clear();
-        signalPoolFlag.clear();
-
-        signalPoolMutex.unlock();
+        // deallocate signals in the pools
+        delete signalPool;
+        delete polledSignalPool;
+        signalPool = nullptr;
+        polledSignalPool = nullptr;
 #endif
 
         // shutdown HSA runtime
@@ -2957,11 +3220,15 @@ HSADispatch::HSADispatch(Kalmar::HSADevice* _device, HSAKernel* _kernel) :
     agent(_device->getAgent()),
     kernel(_kernel),
     isDispatched(false),
+    isBatched(false),
     waitMode(HSA_WAIT_STATE_BLOCKED),
     dynamicGroupSize(0),
-    future(nullptr),
     hsaQueue(nullptr),
-    kernargMemory(nullptr) {
+    kernargMemory(nullptr),
+    kernargSegment(nullptr),
+    kernargGeneration(0),
+    kernargSlabs(nullptr),
+    signalIndex(-1) {
 
     clearArgs();
 }
@@ -2980,11 +3247,16 @@ HSADispatch::dispatchKernel(hsa_queue_t* commandQueue) {
     }
 
     /*
-     * Create a signal to wait for the dispatch to finish.
+     * Create a signal to wait for the dispatch to finish. Short kernels may
+     * complete on a signal raising no interrupt, which is polled for.
      */
-    std::pair<hsa_signal_t, int> ret = Kalmar::ctx.getSignal();
+    const uint64_t gridSize = uint64_t(global_size[0]) * global_size[1] * global_size[2];
+    const bool polled = Kalmar::ctx.usePolledSignal(gridSize);
+    std::pair<hsa_signal_t, int> ret = Kalmar::ctx.getSignal(polled);
     signal = ret.first;
     signalIndex = ret.second;
+    if (polled)
+        waitMode = HSA_WAIT_STATE_ACTIVE;
 
     /*
      * Initialize the dispatch packet.
@@ -3030,9 +3302,14 @@ HSADispatch::dispatchKernel(hsa_queue_t* commandQueue) {
         hsa_amd_memory_pool_t kernarg_region = device->getHSAKernargRegion();
 
         if (arg_vec.size() > 0) {
-            std::pair<void*, int> ret = device->getKernargBuffer(arg_vec.size());
-            kernargMemory = ret.first;
-            kernargMemoryIndex = ret.second;
+            kernargSlabs = hsaQueue->getKernargSlabs();
+            kernargSegment = kernargSlabs ? kernargSlabs->get(arg_vec.size(), signal) : nullptr;
+            if (kernargSegment != nullptr) {
+                kernargMemory = kernargSegment->ptr;
+                kernargGeneration = kernargSegment->generation;
+            } else {
+                kernargMemory = device->allocKernargBuffer(arg_vec.size());
+            }
 
             // as kernarg buffers are fine-grained, we can directly use memcpy
             memcpy(kernargMemory, arg_vec.data(), arg_vec.size());
@@ -3075,23 +3352,12 @@ HSADispatch::dispatchKernel(hsa_queue_t* commandQueue) {
     STATUS_CHECK_Q(status, commandQueue, __LINE__);
     aql.private_segment_size = private_segment_size;
 
-    // write packet
-    uint32_t queueMask = commandQueue->size - 1;
-    // TODO: Need to check if package write is correct.
-    uint64_t index = hsa_queue_load_write_index_relaxed(commandQueue);
-    uint64_t nextIndex = index + 1;
-    if (nextIndex - hsa_queue_load_read_index_acquire(commandQueue) >= commandQueue->size) {
-      checkHCCRuntimeStatus(Kalmar::HCCRuntimeStatus::HCCRT_STATUS_ERROR_COMMAND_QUEUE_OVERFLOW, __LINE__, commandQueue);
-    }
-    ((hsa_kernel_dispatch_packet_t*)(commandQueue->base_address))[index & queueMask] = aql;
-    hsa_queue_store_write_index_relaxed(commandQueue, index + 1);
-
 #if KALMAR_DEBUG
     std::cerr << "ring door bell to dispatch kernel\n";
 #endif
 
-    // Ring door bell
-    hsa_signal_store_relaxed(commandQueue->doorbell_signal, index);
+    // write packet and ring door bell, unless a batch is open on the queue
+    isBatched = hsaQueue->submitPacket(aql);
 
     isDispatched = true;
 
@@ -3114,6 +3380,11 @@ HSADispatch::waitComplete() {
         return HSA_STATUS_ERROR_INVALID_ARGUMENT;
     }
 
+    // the dispatch may still sit in a batch of its queue; once it has
+    // completed its queue may be gone already
+    if (isBatched && hsa_signal_load_acquire(signal) != 0)
+        hsaQueue->flush();
+
 #if KALMAR_DEBUG
     std::cerr << " wait for kernel dispatch op#" << getSeqNum() << " completion with wait flag: " << waitMode << "  signal="<< std::hex  << signal.handle << "\n";
 #endif
@@ -3128,15 +3399,7 @@ HSADispatch::waitComplete() {
     std::cerr << "complete!\n";
 #endif
 
-    if (kernargMemory != nullptr) {
-      device->releaseKernargBuffer(kernargMemory, kernargMemoryIndex);
-      kernargMemory = nullptr;
-    }
-
-    // unregister this async operation from HSAQueue
-    if (this->hsaQueue != nullptr) {
-        this->hsaQueue->removeAsyncOp(this);
-    }
+    releaseKernarg();
 
     isDispatched = false;
     return status;
@@ -3179,30 +3442,34 @@ HSADispatch::dispatchKernelAsync(Kalmar::HSAQueue* hsaQueue) {
     status = dispatchKernel(queue);
     STATUS_CHECK_Q(status, queue, __LINE__);
 
-    // dynamically allocate a std::shared_future<void> object
-    future = new std::shared_future<void>(std::async(std::launch::deferred, [&] {
-        waitComplete();
-    }).share());
-
     return status;
 }
 
+inline void
+HSADispatch::releaseKernarg() {
+    if (kernargMemory == nullptr)
+        return;
+    if (kernargSegment != nullptr) {
+        kernargSlabs->release(kernargSegment, kernargGeneration);
+        kernargSegment = nullptr;
+    } else {
+        device->releaseKernargBuffer(kernargMemory);
+    }
+    kernargMemory = nullptr;
+}
+
 inline void
 HSADispatch::dispose() {
     hsa_status_t status;
-    if (kernargMemory != nullptr) {
-      device->releaseKernargBuffer(kernargMemory, kernargMemoryIndex);
-      kernargMemory = nullptr;
-    }
+    releaseKernarg();
 
     clearArgs();
     std::vector<uint8_t>().swap(arg_vec);
 
-    Kalmar::ctx.releaseSignal(signal, signalIndex);
-
-    if (future != nullptr) {
-      delete future;
-      future = nullptr;
+    // only release the signal if the kernel was dispatched
+    if (signalIndex >= 0) {
+        Kalmar::ctx.releaseSignal(signal, signalIndex);
+        signalIndex = -1;
     }
 }
 
@@ -3268,6 +3535,11 @@ HSABarrier::waitComplete() {
         return HSA_STATUS_ERROR_INVALID_ARGUMENT;
     }
 
+    // the barrier may still sit in a batch of its queue; once it has
+    // completed its queue may be gone already
+    if (isBatched && hsa_signal_load_acquire(signal) != 0)
+        hsaQueue->flush();
+
 #if KALMAR_DEBUG or KALMAR_DEBUG_ASYNC_COPY
     std::cerr << "  wait for barrier op#" << getSeqNum() << " completion with wait flag: " << waitMode << "  signal="<< std::hex  << signal.handle << "\n";
 #endif
@@ -3279,11 +3551,6 @@ HSABarrier::waitComplete() {
     std::cerr << "complete!\n";
 #endif
 
-    // unregister this async operation from HSAQueue
-    if (this->hsaQueue != nullptr) {
-        this->hsaQueue->removeAsyncOp(this);
-    }
-
     isDispatched = false;
 
     return status;
@@ -3302,11 +3569,6 @@ HSABarrier::enqueueAsync(Kalmar::HSAQueue* hsaQueue) {
     status = enqueueBarrier(queue);
     STATUS_CHECK_Q(status, queue, __LINE__);
 
-    // dynamically allocate a std::shared_future<void> object
-    future = new std::shared_future<void>(std::async(std::launch::deferred, [&] {
-        waitComplete();
-    }).share());
-
     return status;
 }
 
@@ -3322,24 +3584,16 @@ HSABarrier::enqueueBarrier(hsa_queue_t* queue) {
     signal = ret.first;
     signalIndex = ret.second;
 
-    // Obtain the write index for the command queue
-    uint64_t index = hsa_queue_load_write_index_relaxed(queue);
-    const uint32_t queueMask = queue->size - 1;
-    uint64_t nextIndex = index + 1;
-    if (nextIndex - hsa_queue_load_read_index_acquire(queue) >= queue->size) {
-      checkHCCRuntimeStatus(Kalmar::HCCRuntimeStatus::HCCRT_STATUS_ERROR_COMMAND_QUEUE_OVERFLOW, __LINE__, queue);
-    }
-
-    // Define the barrier packet to be at the calculated queue index address
-    hsa_barrier_and_packet_t* barrier = &(((hsa_barrier_and_packet_t*)(queue->base_address))[index&queueMask]);
-    memset(barrier, 0, sizeof(hsa_barrier_and_packet_t));
+    // Define the barrier packet
+    hsa_barrier_and_packet_t barrier;
+    memset(&barrier, 0, sizeof(hsa_barrier_and_packet_t));
 
     // setup header
     uint16_t header = HSA_PACKET_TYPE_BARRIER_AND << HSA_PACKET_HEADER_TYPE;
     header |= 1 << HSA_PACKET_HEADER_BARRIER;
     header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_ACQUIRE_FENCE_SCOPE;
     header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_RELEASE_FENCE_SCOPE;
-    barrier->header = header;
+    barrier.header = header;
 
 #if KALMAR_DEBUG
     std::cerr << "barrier dependency count: " << depCount << "\n";
@@ -3348,19 +3602,18 @@ HSABarrier::enqueueBarrier(hsa_queue_t* queue) {
     // setup dependent signals
     if ((depCount > 0) && (depCount <= 5)) {
         for (int i = 0; i < depCount; ++i) {
-            barrier->dep_signal[i] = *(static_cast <hsa_signal_t*> (depAsyncOps[i]->getNativeHandle()));
+            barrier.dep_signal[i] = *(static_cast <hsa_signal_t*> (depAsyncOps[i]->getNativeHandle()));
         }
     }
 
-    barrier->completion_signal = signal;
+    barrier.completion_signal = signal;
 
 #if KALMAR_DEBUG
     std::cerr << "ring door bell to dispatch barrier\n";
 #endif
 
-    // Increment write index and ring doorbell to dispatch the kernel
-    hsa_queue_store_write_index_relaxed(queue, nextIndex);
-    hsa_signal_store_relaxed(queue->doorbell_signal, index);
+    // write packet and ring door bell, unless a batch is open on the queue
+    isBatched = hsaQueue->submitPacket(barrier);
 
     isDispatched = true;
 
@@ -3369,17 +3622,16 @@ HSABarrier::enqueueBarrier(hsa_queue_t* queue) {
 
 inline void
 HSABarrier::dispose() {
-    Kalmar::ctx.releaseSignal(signal, signalIndex);
+    // only release the signal if the barrier was enqueued
+    if (signalIndex >= 0) {
+        Kalmar::ctx.releaseSignal(signal, signalIndex);
+        signalIndex = -1;
+    }
 
     // Release referecne to our dependent ops:
     for (int i=0; i<depCount; i++) {
         depAsyncOps[i] = nullptr;
     }
-
-    if (future != nullptr) {
-      delete future;
-      future = nullptr;
-    }
 }
 
 inline uint64_t
@@ -3425,11 +3677,6 @@ HSACopy::waitComplete() {
     std::cerr << "complete!\n";
 #endif
 
-    // unregister this async operation from HSAQueue
-    if (this->hsaQueue != nullptr) {
-        this->hsaQueue->removeAsyncOp(this);
-    }
-
     isSubmitted = false;
 
     return status;
@@ -3448,11 +3695,6 @@ HSACopy::enqueueAsync(Kalmar::HSAQueue* hsaQueue) {
     status = enqueueAsyncCopy();
     STATUS_CHECK_Q(status, queue, __LINE__);
 
-    // dynamically allocate a std::shared_future<void> object
-    future = new std::shared_future<void>(std::async(std::launch::deferred, [&] {
-        waitComplete();
-    }).share());
-
     return status;
 }
 
@@ -3556,11 +3798,6 @@ HSACopy::dispose() {
     if (signalIndex >= 0) {
         Kalmar::ctx.releaseSignal(signal, signalIndex);
     }
-
-    if (future != nullptr) {
-        delete future;
-        future = nullptr;
-    }
 }
 
 inline uint64_t
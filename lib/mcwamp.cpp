@@ -11,7 +11,9 @@
 #include <tuple>
 
 #include <amp.h>
+#include <cstdlib>
 #include <mutex>
+#include <thread>
 
 #include "mcwamp_impl.hpp"
 
@@ -225,71 +227,92 @@ static RuntimeImpl* LoadCPURuntime() {
   return runtimeImpl;
 }
 
-RuntimeImpl* GetOrInitRuntime() {
-  static RuntimeImpl* runtimeImpl = nullptr;
-  if (runtimeImpl == nullptr) {
-    HSAPlatformDetect hsa_rt;
-    OpenCLPlatformDetect opencl_rt;
+static RuntimeImpl* InitRuntime() {
+  RuntimeImpl* runtimeImpl = nullptr;
+  HSAPlatformDetect hsa_rt;
+  OpenCLPlatformDetect opencl_rt;
 
-    char* verbose_env = getenv("HCC_VERBOSE");
-    if (verbose_env != nullptr) {
-      if (std::string("ON") == verbose_env) {
-        mcwamp_verbose = true;
-      }
-    }
-
-    // force use certain C++AMP runtime from HCC_RUNTIME environment variable
-    char* runtime_env = getenv("HCC_RUNTIME");
-    if (runtime_env != nullptr) {
-      if (std::string("HSA") == runtime_env) {
-        if (hsa_rt.detect()) {
-          runtimeImpl = LoadHSARuntime();
-        } else {
-          std::cerr << "Ignore unsupported HCC_RUNTIME environment variable: " << runtime_env << std::endl;
-        }
-      } else if (runtime_env[0] == 'C' && runtime_env[1] == 'L') {
-          if (opencl_rt.detect()) {
-              runtimeImpl = LoadOpenCLRuntime();
-          } else {
-              std::cerr << "Ignore unsupported HCC_RUNTIME environment variable: " << runtime_env << std::endl;
-          }
-      } else if(std::string("CPU") == runtime_env) {
-          // CPU runtime should be available
-          runtimeImpl = LoadCPURuntime();
-          runtimeImpl->set_cpu();
-      } else {
-        std::cerr << "Ignore unknown HCC_RUNTIME environment variable:" << runtime_env << std::endl;
-      }
+  char* verbose_env = getenv("HCC_VERBOSE");
+  if (verbose_env != nullptr) {
+    if (std::string("ON") == verbose_env) {
+      mcwamp_verbose = true;
     }
+  }
 
-    // If can't determined by environment variable, try detect what can be used
-    if (runtimeImpl == nullptr) {
+  // force use certain C++AMP runtime from HCC_RUNTIME environment variable
+  char* runtime_env = getenv("HCC_RUNTIME");
+  if (runtime_env != nullptr) {
+    if (std::string("HSA") == runtime_env) {
       if (hsa_rt.detect()) {
         runtimeImpl = LoadHSARuntime();
-      } else if (opencl_rt.detect()) {
-        runtimeImpl = LoadOpenCLRuntime();
       } else {
-          runtimeImpl = LoadCPURuntime();
-          runtimeImpl->set_cpu();
-          std::cerr << "No suitable runtime detected. Fall back to CPU!" << std::endl;
+        std::cerr << "Ignore unsupported HCC_RUNTIME environment variable: " << runtime_env << std::endl;
       }
+    } else if (runtime_env[0] == 'C' && runtime_env[1] == 'L') {
+        if (opencl_rt.detect()) {
+            runtimeImpl = LoadOpenCLRuntime();
+        } else {
+            std::cerr << "Ignore unsupported HCC_RUNTIME environment variable: " << runtime_env << std::endl;
+        }
+    } else if(std::string("CPU") == runtime_env) {
+        // CPU runtime should be available
+        runtimeImpl = LoadCPURuntime();
+        runtimeImpl->set_cpu();
+    } else {
+      std::cerr << "Ignore unknown HCC_RUNTIME environment variable:" << runtime_env << std::endl;
+    }
+  }
+
+  // If can't determined by environment variable, try detect what can be used
+  if (runtimeImpl == nullptr) {
+    if (hsa_rt.detect()) {
+      runtimeImpl = LoadHSARuntime();
+    } else if (opencl_rt.detect()) {
+      runtimeImpl = LoadOpenCLRuntime();
+    } else {
+        runtimeImpl = LoadCPURuntime();
+        runtimeImpl->set_cpu();
+        std::cerr << "No suitable runtime detected. Fall back to CPU!" << std::endl;
     }
   }
   return runtimeImpl;
 }
 
+RuntimeImpl* GetOrInitRuntime() {
+  // initialization of a local static is thread safe, so host threads racing
+  // on their first kernel launch load the runtime only once
+  static RuntimeImpl* runtimeImpl = InitRuntime();
+  return runtimeImpl;
+}
+
 bool is_cpu()
 {
     return GetOrInitRuntime()->is_cpu();
 }
 
-static bool in_kernel = false;
-bool in_cpu_kernel() { return in_kernel; }
-void enter_kernel() { in_kernel = true; }
-void leave_kernel() { in_kernel = false; }
+// The execution context of CPU kernels is kept per thread: the parts of a
+// launch run on the pool workers while the launching threads carry on with
+// host code, and several launches may be in flight at once. enter_kernel()
+// and leave_kernel() nest, leaving a kernel context only restores the one
+// that was current when it was entered.
+static thread_local int kernel_depth = 0;
+bool in_cpu_kernel() { return kernel_depth > 0; }
+void enter_kernel() { ++kernel_depth; }
+void leave_kernel() { --kernel_depth; }
+
+// HCC_COEXEC=ON splits large non-tiled launches between the CPU and an
+// accelerator sharing its memory with the host
+bool coexec_enabled() {
+  static const bool enabled = [] {
+    char* coexec_env = getenv("HCC_COEXEC");
+    return coexec_env != nullptr && std::string("ON") == coexec_env;
+  }();
+  return enabled;
+}
 
-void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** kernel_source, bool* needs_compilation) {
-  static bool firstTime = true;
+void DetermineAndGetProgram(KalmarDevice* pDev, size_t* kernel_size, void** kernel_source, bool* needs_compilation) {
+  // host threads launching their first kernels detect the kernel kind once
+  static std::once_flag detected;
   static bool hasSPIR = false;
   static bool hasFinalized = false;
 
@@ -297,7 +320,7 @@ void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** ker
 
   // FIXME need a more elegant way
   if (GetOrInitRuntime()->m_ImplName.find("libmcwamp_opencl") != std::string::npos) {
-    if (firstTime) {
+    std::call_once(detected, [&]() {
       // force use OpenCL C kernel from HCC_NOSPIR environment variable
       kernel_env = getenv("HCC_NOSPIR");
       if (kernel_env == nullptr) {
@@ -314,8 +337,7 @@ void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** ker
         if (mcwamp_verbose)
           std::cout << "Use OpenCL C kernel\n";
       }
-      firstTime = false;
-    }
+    });
     if (hasSPIR) {
       // SPIR path
       *kernel_size =
@@ -334,7 +356,7 @@ void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** ker
   } else {
     // HSA path
 
-    if (firstTime) {
+    std::call_once(detected, [&]() {
       // force use HSA BRIG kernel from HCC_NOISA environment variable
       kernel_env = getenv("HCC_NOISA");
       if (kernel_env == nullptr) {
@@ -344,7 +366,7 @@ void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** ker
           (ptrdiff_t)((void *)hsa_offline_finalized_kernel_source);
         // check if offline finalized kernel is compatible with ISA of the HSA agent
         if ((kernel_finalized_size > 0) &&
-            (pQueue->getDev()->IsCompatibleKernel((void*)kernel_finalized_size, hsa_offline_finalized_kernel_source))) {
+            (pDev->IsCompatibleKernel((void*)kernel_finalized_size, hsa_offline_finalized_kernel_source))) {
           if (mcwamp_verbose)
             std::cout << "Use offline finalized HSA kernels\n";
           hasFinalized = true;
@@ -357,8 +379,7 @@ void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** ker
         if (mcwamp_verbose)
           std::cout << "Use HSA BRIG kernel\n";
       }
-      firstTime = false;
-    }
+    });
     if (hasFinalized) {
       *kernel_size =
         (ptrdiff_t)((void *)hsa_offline_finalized_kernel_end) -
@@ -375,13 +396,13 @@ void DetermineAndGetProgram(KalmarQueue* pQueue, size_t* kernel_size, void** ker
   }
 }
 
-void BuildProgram(KalmarQueue* pQueue) {
+void BuildProgram(KalmarDevice* pDev) {
   size_t kernel_size = 0;
   void* kernel_source = nullptr;
   bool needs_compilation = true;
 
-  DetermineAndGetProgram(pQueue, &kernel_size, &kernel_source, &needs_compilation);
-  pQueue->getDev()->BuildProgram((void*)kernel_size, kernel_source, needs_compilation);
+  DetermineAndGetProgram(pDev, &kernel_size, &kernel_source, &needs_compilation);
+  pDev->BuildProgram((void*)kernel_size, kernel_source, needs_compilation);
 }
 
 // used in parallel_for_each.h
@@ -390,11 +411,22 @@ void *CreateKernel(std::string s, KalmarQueue* pQueue) {
   void* kernel_source = nullptr;
   bool needs_compilation = true;
 
-  DetermineAndGetProgram(pQueue, &kernel_size, &kernel_source, &needs_compilation);
+  DetermineAndGetProgram(pQueue->getDev(), &kernel_size, &kernel_source, &needs_compilation);
 
   return pQueue->getDev()->CreateKernel(s.c_str(), (void *)kernel_size, kernel_source, needs_compilation);
 }
 
+// used in kalmar_launch.h to resolve a kernel once per device
+void *LookupKernel(std::string s, KalmarQueue* pQueue) {
+  size_t kernel_size = 0;
+  void* kernel_source = nullptr;
+  bool needs_compilation = true;
+
+  DetermineAndGetProgram(pQueue->getDev(), &kernel_size, &kernel_source, &needs_compilation);
+
+  return pQueue->getDev()->LookupKernel(s.c_str(), (void *)kernel_size, kernel_source, needs_compilation);
+}
+
 void PushArg(void *k_, int idx, size_t sz, const void *s) {
   GetOrInitRuntime()->m_PushArgImpl(k_, idx, sz, s);
 }
@@ -409,31 +441,71 @@ KalmarContext *getContext() {
 }
 
 // Kalmar runtime bootstrap logic
+//
+// HCC_LAZYINIT tells when the runtime is loaded and the kernels are built:
+//   ON          on first use; each kernel is built when it is first launched,
+//               programs that never launch one do not pay for it (default)
+//   BACKGROUND  a thread loads the runtime and builds the kernels of the
+//               default device while main() proceeds
+//   OFF         both are done before main() starts
 class KalmarBootstrap {
 private:
-  RuntimeImpl* runtime;
-public:
-  KalmarBootstrap() : runtime(nullptr) {
-    bool to_init = true;
-    char* lazyinit_env = getenv("HCC_LAZYINIT");
-    if (lazyinit_env != nullptr) {
-      if (std::string("ON") == lazyinit_env) {
-        to_init = false;
-      }
+  struct Builder {
+    std::mutex mtx;
+    std::thread thread;
+    std::once_flag finishRegistered;
+
+    // the program exited before the runtime was up, finish() is not
+    // registered yet
+    ~Builder() {
+      if (thread.joinable())
+        thread.join();
     }
+  };
 
-    if (to_init) {
-      // initialize runtime
-      runtime = CLAMP::GetOrInitRuntime();
-  
-      // get context
-      KalmarContext* context = static_cast<KalmarContext*>(runtime->m_GetContextImpl());
-  
-      // get default queue on the default device
-      std::shared_ptr<KalmarQueue> queue = context->auto_select();
-  
-      // build kernels on the default queue on the default device
-      CLAMP::BuildProgram(queue.get());
+  // constructed on first use, the bootstrap runs before static initializers
+  static Builder& builder() {
+    static Builder b;
+    return b;
+  }
+
+  static void load(bool background) {
+    // initialize runtime
+    RuntimeImpl* runtime = CLAMP::GetOrInitRuntime();
+
+    // get context
+    KalmarContext* context = static_cast<KalmarContext*>(runtime->m_GetContextImpl());
+
+    // the runtime tears down its context at exit, finish building first;
+    // registered only now so that finish() runs before that teardown
+    if (background)
+      std::call_once(builder().finishRegistered, [] { std::atexit(finish); });
+
+    // build kernels on the default device
+    CLAMP::BuildProgram(context->getDevice());
+  }
+
+  /// wait for the background build, the program may exit while it runs
+  static void finish() {
+    Builder& b = builder();
+    std::lock_guard<std::mutex> lk(b.mtx);
+    if (b.thread.joinable())
+      b.thread.join();
+  }
+
+public:
+  KalmarBootstrap() {
+    char* lazyinit_env = getenv("HCC_LAZYINIT");
+    if (lazyinit_env == nullptr || std::string("ON") == lazyinit_env) {
+      return;
+    } else if (std::string("BACKGROUND") == lazyinit_env) {
+      // create the builder before the runtime, so that it is still around
+      // when finish runs
+      Builder& b = builder();
+      std::lock_guard<std::mutex> lk(b.mtx);
+      b.thread = std::thread(load, true);
+    } else {
+      load(false);
     }
   }
 };
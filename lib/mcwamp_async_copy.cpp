@@ -0,0 +1,103 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <kalmar_runtime.h>
+
+// Copy worker of the runtime
+//
+// hc::copy_async and array_view::synchronize_async hand their copy to a
+// thread of its own, so the transfer overlaps with the host and with kernels
+// using other buffers. The copy goes through the same synchronous paths as
+// hc::copy, so it works with every runtime; the buffers it touches are marked
+// busy with its operation, which makes host accesses wait for it.
+
+namespace Kalmar {
+namespace CLAMP {
+
+static thread_local bool copy_worker_thread = false;
+
+class CopyWorker
+{
+  struct Copy {
+    std::shared_ptr<CPUAsyncOp> op;
+    std::function<void()> copy;
+  };
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::deque<Copy> copies;
+  bool stopping;
+  std::thread thread;
+
+  void workerLoop() {
+    copy_worker_thread = true;
+    while (true) {
+      Copy c;
+      {
+        std::unique_lock<std::mutex> lk(mtx);
+        cond.wait(lk, [&] { return stopping || !copies.empty(); });
+        if (copies.empty())
+          return;
+        c = std::move(copies.front());
+        copies.pop_front();
+      }
+      std::exception_ptr error;
+      try {
+        c.copy();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      // drop what the copy holds on to before reporting completion
+      c.copy = nullptr;
+      c.op->complete(error);
+    }
+  }
+
+public:
+  CopyWorker() : mtx(), cond(), copies(), stopping(false), thread() {
+    thread = std::thread(&CopyWorker::workerLoop, this);
+  }
+
+  /// pending copies are still carried out
+  ~CopyWorker() {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      stopping = true;
+    }
+    cond.notify_one();
+    if (thread.joinable())
+      thread.join();
+  }
+
+  void enqueue(std::shared_ptr<CPUAsyncOp> op, std::function<void()> copy) {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      copies.push_back({std::move(op), std::move(copy)});
+    }
+    cond.notify_one();
+  }
+};
+
+void enqueue_async_copy(std::shared_ptr<CPUAsyncOp> op, std::function<void()> copy) {
+  static CopyWorker worker;
+  worker.enqueue(std::move(op), std::move(copy));
+}
+
+bool in_async_copy() {
+  return copy_worker_thread;
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
@@ -1,183 +1,251 @@
-#include <mutex>
-#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Host implementations of the atomic functions, used by the CPU path.
+//
+// Every operation is a single atomic instruction or a compare-and-swap loop on
+// the addressed word, so only accesses to the same address contend. Floating
+// point operations work on the bit pattern of the value.
+
+#define ATOMIC_ORDER __ATOMIC_SEQ_CST
+
+static inline unsigned int float_as_bits(float f) {
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float bits_as_float(unsigned int u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/// atomically replace *x by op(*x), return the previous value
+template <typename T, typename Op>
+static inline T atomic_update(T *x, Op op) {
+    T old = __atomic_load_n(x, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(x, &old, op(old), true, ATOMIC_ORDER, __ATOMIC_RELAXED))
+        ;
+    return old;
+}
+
+/// same as atomic_update, for a float updated through its bit pattern
+template <typename Op>
+static inline float atomic_update_float(float *x, Op op) {
+    unsigned int *p = reinterpret_cast<unsigned int*>(x);
+    unsigned int old = atomic_update(p, [&](unsigned int bits) {
+        return float_as_bits(op(bits_as_float(bits)));
+    });
+    return bits_as_float(old);
+}
 
-// FIXME : need to consider how to let hc namespace could also use functions here
 namespace Concurrency {
 
-std::mutex afx_u, afx_i, afx_f;
 unsigned int atomic_exchange_unsigned(unsigned int *x, unsigned int y) {
-    std::lock_guard<std::mutex> guard(afx_u);
-    unsigned int old = *x;
-    *x = y;
-    return old;
+    return __atomic_exchange_n(x, y, ATOMIC_ORDER);
 }
 int atomic_exchange_int(int *x, int y) {
-    std::lock_guard<std::mutex> guard(afx_i);
-    int old = *x;
-    *x = y;
-    return old;
+    return __atomic_exchange_n(x, y, ATOMIC_ORDER);
 }
 float atomic_exchange_float(float* x, float y) {
-    std::lock_guard<std::mutex> guard(afx_f);
-    int old = *x;
-    *x = y;
-    return old;
+    unsigned int old = __atomic_exchange_n(reinterpret_cast<unsigned int*>(x),
+                                           float_as_bits(y), ATOMIC_ORDER);
+    return bits_as_float(old);
 }
 
-std::mutex afcas_u, afcas_i;
 unsigned int atomic_compare_exchange_unsigned(unsigned int *x, unsigned int y, unsigned int z) {
-    std::lock_guard<std::mutex> guard(afcas_u);
-    unsigned int old = *x;
-    if (*x == y) {
-        *x = z;
-    }
-    return old;
+    __atomic_compare_exchange_n(x, &y, z, false, ATOMIC_ORDER, ATOMIC_ORDER);
+    return y;
 }
 int atomic_compare_exchange_int(int *x, int y, int z) {
-    std::lock_guard<std::mutex> guard(afcas_i);
-    int old = *x;
-    if (*x == y) {
-        *x = z;
-    }
-    return old;
+    __atomic_compare_exchange_n(x, &y, z, false, ATOMIC_ORDER, ATOMIC_ORDER);
+    return y;
 }
 
-std::mutex afa_u, afa_i, afa_f;
 unsigned int atomic_add_unsigned(unsigned int *x, unsigned int y) {
-    std::lock_guard<std::mutex> guard(afa_u);
-    unsigned int old = *x;
-    *x += y;
-    return old;
+    return __atomic_fetch_add(x, y, ATOMIC_ORDER);
 }
 int atomic_add_int(int *x, int y) {
-    std::lock_guard<std::mutex> guard(afa_i);
-    int old = *x;
-    *x += y;
-    return old;
+    return __atomic_fetch_add(x, y, ATOMIC_ORDER);
 }
 float atomic_add_float(float* x, float y) {
-    std::lock_guard<std::mutex> guard(afa_f);
-    float old = *x;
-    *x += y;
-    return old;
+    return atomic_update_float(x, [=](float v) { return v + y; });
 }
 
-std::mutex afs_u, afs_i, afs_f;
 unsigned int atomic_sub_unsigned(unsigned int *x, unsigned int y) {
-    std::lock_guard<std::mutex> guard(afa_u);
-    unsigned int old = *x;
-    *x -= y;
-    return old;
+    return __atomic_fetch_sub(x, y, ATOMIC_ORDER);
 }
 int atomic_sub_int(int *x, int y) {
-    std::lock_guard<std::mutex> guard(afa_i);
-    int old = *x;
-    *x -= y;
-    return old;
+    return __atomic_fetch_sub(x, y, ATOMIC_ORDER);
 }
 float atomic_sub_float(float* x, float y) {
-    std::lock_guard<std::mutex> guard(afa_f);
-    float old = *x;
-    *x -= y;
-    return old;
+    return atomic_update_float(x, [=](float v) { return v - y; });
 }
 
-std::mutex afand_u, afand_i;
 unsigned int atomic_and_unsigned(unsigned int *x, unsigned int y) {
-    std::lock_guard<std::mutex> guard(afand_u);
-    unsigned int old = *x;
-    *x &= y;
-    return old;
+    return __atomic_fetch_and(x, y, ATOMIC_ORDER);
 }
 int atomic_and_int(int *x, int y) {
-    std::lock_guard<std::mutex> guard(afand_i);
-    int old = *x;
-    *x &= y;
-    return old;
+    return __atomic_fetch_and(x, y, ATOMIC_ORDER);
 }
 
-std::mutex afor_u, afor_i;
 unsigned int atomic_or_unsigned(unsigned int *x, unsigned int y) {
-    std::lock_guard<std::mutex> guard(afor_u);
-    unsigned int old = *x;
-    *x |= y;
-    return old;
+    return __atomic_fetch_or(x, y, ATOMIC_ORDER);
 }
 int atomic_or_int(int *x, int y) {
-    std::lock_guard<std::mutex> guard(afor_i);
-    int old = *x;
-    *x |= y;
-    return old;
+    return __atomic_fetch_or(x, y, ATOMIC_ORDER);
 }
 
-std::mutex afxor_u, afxor_i;
 unsigned int atomic_xor_unsigned(unsigned int *x, unsigned int y) {
-    std::lock_guard<std::mutex> guard(afxor_u);
-    unsigned int old = *x;
-    *x ^= y;
-    return old;
+    return __atomic_fetch_xor(x, y, ATOMIC_ORDER);
 }
 int atomic_xor_int(int *x, int y) {
-    std::lock_guard<std::mutex> guard(afxor_i);
-    int old = *x;
-    *x ^= y;
-    return old;
+    return __atomic_fetch_xor(x, y, ATOMIC_ORDER);
 }
 
-std::mutex afmax_u, afmax_i;
 unsigned int atomic_max_unsigned(unsigned int *p, unsigned int val) {
-    std::lock_guard<std::mutex> guard(afmax_u);
-    unsigned int old = *p;
-    *p = std::max(*p, val);
-    return old;
+    return atomic_update(p, [=](unsigned int v) { return v < val ? val : v; });
 }
 int atomic_max_int(int *p, int val) {
-    std::lock_guard<std::mutex> guard(afmax_i);
-    int old = *p;
-    *p = std::max(*p, val);
-    return old;
+    return atomic_update(p, [=](int v) { return v < val ? val : v; });
 }
 
-std::mutex afmin_u, afmin_i;
 unsigned int atomic_min_unsigned(unsigned int *p, unsigned int val) {
-    std::lock_guard<std::mutex> guard(afmin_u);
-    unsigned int old = *p;
-    *p = std::min(*p, val);
-    return old;
+    return atomic_update(p, [=](unsigned int v) { return val < v ? val : v; });
 }
 int atomic_min_int(int *p, int val) {
-    std::lock_guard<std::mutex> guard(afmin_i);
-    int old = *p;
-    *p = std::min(*p, val);
-    return old;
+    return atomic_update(p, [=](int v) { return val < v ? val : v; });
 }
 
-std::mutex afi_u, afi_i;
 unsigned int atomic_inc_unsigned(unsigned int *p) {
-    std::lock_guard<std::mutex> guard(afi_u);
-    unsigned int old = *p;
-    *p += 1;
-    return old;
+    return __atomic_fetch_add(p, 1u, ATOMIC_ORDER);
 }
 int atomic_inc_int(int *p) {
-    std::lock_guard<std::mutex> guard(afi_i);
-    int old = *p;
-    *p += 1;
-    return old;
+    return __atomic_fetch_add(p, 1, ATOMIC_ORDER);
 }
 
-std::mutex afd_u, afd_i;
 unsigned int atomic_dec_unsigned(unsigned int *p) {
-    std::lock_guard<std::mutex> guard(afd_u);
-    unsigned int old = *p;
-    *p -= 1;
-    return old;
+    return __atomic_fetch_sub(p, 1u, ATOMIC_ORDER);
 }
 int atomic_dec_int(int *p) {
-    std::lock_guard<std::mutex> guard(afd_i);
-    int old = *p;
-    *p -= 1;
-    return old;
+    return __atomic_fetch_sub(p, 1, ATOMIC_ORDER);
+}
+
+}
+
+// hc declares the same set of functions, plus 64-bit variants
+namespace hc {
+
+unsigned int atomic_exchange_unsigned(unsigned int *x, unsigned int y) {
+    return Concurrency::atomic_exchange_unsigned(x, y);
+}
+int atomic_exchange_int(int *x, int y) {
+    return Concurrency::atomic_exchange_int(x, y);
+}
+float atomic_exchange_float(float* x, float y) {
+    return Concurrency::atomic_exchange_float(x, y);
+}
+uint64_t atomic_exchange_uint64(uint64_t *x, uint64_t y) {
+    return __atomic_exchange_n(x, y, ATOMIC_ORDER);
+}
+
+unsigned int atomic_compare_exchange_unsigned(unsigned int *x, unsigned int y, unsigned int z) {
+    return Concurrency::atomic_compare_exchange_unsigned(x, y, z);
+}
+int atomic_compare_exchange_int(int *x, int y, int z) {
+    return Concurrency::atomic_compare_exchange_int(x, y, z);
+}
+uint64_t atomic_compare_exchange_uint64(uint64_t *x, uint64_t y, uint64_t z) {
+    __atomic_compare_exchange_n(x, &y, z, false, ATOMIC_ORDER, ATOMIC_ORDER);
+    return y;
+}
+
+unsigned int atomic_add_unsigned(unsigned int *x, unsigned int y) {
+    return Concurrency::atomic_add_unsigned(x, y);
+}
+int atomic_add_int(int *x, int y) {
+    return Concurrency::atomic_add_int(x, y);
+}
+float atomic_add_float(float* x, float y) {
+    return Concurrency::atomic_add_float(x, y);
+}
+uint64_t atomic_add_uint64(uint64_t *x, uint64_t y) {
+    return __atomic_fetch_add(x, y, ATOMIC_ORDER);
+}
+
+unsigned int atomic_sub_unsigned(unsigned int *x, unsigned int y) {
+    return Concurrency::atomic_sub_unsigned(x, y);
+}
+int atomic_sub_int(int *x, int y) {
+    return Concurrency::atomic_sub_int(x, y);
+}
+float atomic_sub_float(float* x, float y) {
+    return Concurrency::atomic_sub_float(x, y);
+}
+
+unsigned int atomic_and_unsigned(unsigned int *x, unsigned int y) {
+    return Concurrency::atomic_and_unsigned(x, y);
+}
+int atomic_and_int(int *x, int y) {
+    return Concurrency::atomic_and_int(x, y);
+}
+uint64_t atomic_and_uint64(uint64_t *x, uint64_t y) {
+    return __atomic_fetch_and(x, y, ATOMIC_ORDER);
+}
+
+unsigned int atomic_or_unsigned(unsigned int *x, unsigned int y) {
+    return Concurrency::atomic_or_unsigned(x, y);
+}
+int atomic_or_int(int *x, int y) {
+    return Concurrency::atomic_or_int(x, y);
+}
+uint64_t atomic_or_uint64(uint64_t *x, uint64_t y) {
+    return __atomic_fetch_or(x, y, ATOMIC_ORDER);
+}
+
+unsigned int atomic_xor_unsigned(unsigned int *x, unsigned int y) {
+    return Concurrency::atomic_xor_unsigned(x, y);
+}
+int atomic_xor_int(int *x, int y) {
+    return Concurrency::atomic_xor_int(x, y);
+}
+uint64_t atomic_xor_uint64(uint64_t *x, uint64_t y) {
+    return __atomic_fetch_xor(x, y, ATOMIC_ORDER);
+}
+
+unsigned int atomic_max_unsigned(unsigned int *p, unsigned int val) {
+    return Concurrency::atomic_max_unsigned(p, val);
+}
+int atomic_max_int(int *p, int val) {
+    return Concurrency::atomic_max_int(p, val);
+}
+uint64_t atomic_max_uint64(uint64_t *p, uint64_t val) {
+    return atomic_update(p, [=](uint64_t v) { return v < val ? val : v; });
+}
+
+unsigned int atomic_min_unsigned(unsigned int *p, unsigned int val) {
+    return Concurrency::atomic_min_unsigned(p, val);
+}
+int atomic_min_int(int *p, int val) {
+    return Concurrency::atomic_min_int(p, val);
+}
+uint64_t atomic_min_uint64(uint64_t *p, uint64_t val) {
+    return atomic_update(p, [=](uint64_t v) { return val < v ? val : v; });
+}
+
+unsigned int atomic_inc_unsigned(unsigned int *p) {
+    return Concurrency::atomic_inc_unsigned(p);
+}
+int atomic_inc_int(int *p) {
+    return Concurrency::atomic_inc_int(p);
+}
+
+unsigned int atomic_dec_unsigned(unsigned int *p) {
+    return Concurrency::atomic_dec_unsigned(p);
+}
+int atomic_dec_int(int *p) {
+    return Concurrency::atomic_dec_int(p);
 }
 
 }
@@ -0,0 +1,214 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Copies between sections of arrays and array_views
+//
+// A section is copied as a set of rows. Dimensions whose rows lie back to
+// back on both sides are folded into the rows, so a section spanning whole
+// rows of its view takes a single memcpy per plane, or a single one at all.
+// Large copies are split over the threads of the CPU pool, and their stores
+// bypass the cache so they do not evict the working set of the program.
+
+namespace Kalmar {
+namespace CLAMP {
+
+extern unsigned int cpu_thread_count(int node);
+extern bool cpu_help_until(const std::function<bool()>& ready);
+extern void cpu_parallel_launch(int node, int parts, void (*task)(void*, int),
+                                void (*done)(void*), void* arg);
+
+/// bytes a copy needs before it is spread over the thread pool
+#define COPY_PARALLEL_MIN (4 << 20)
+/// bytes each thread copies at least
+#define COPY_PART_MIN (1 << 20)
+/// bytes a copy needs before it uses non-temporal stores
+#define COPY_STREAM_MIN (8 << 20)
+/// runs shorter than this are copied through the cache regardless
+#define COPY_STREAM_RUN_MIN (4096)
+
+/**
+ * \brief A strided copy reduced to runs of contiguous bytes
+ *
+ * Row r starts at the offsets of the multi-index r within ext, weighted by
+ * the pitches of each side.
+ */
+struct CopyPlan
+{
+  const char* src;
+  char* dst;
+  /// bytes per row
+  size_t run;
+  /// number of rows
+  size_t rows;
+  /// rows along each remaining dimension, the last one varies fastest
+  std::vector<size_t> ext;
+  std::vector<size_t> srcPitch;
+  std::vector<size_t> dstPitch;
+  bool stream;
+};
+
+static CopyPlan make_plan(const void* src, void* dst, int rank, const size_t* ext,
+                          const size_t* src_pitch, const size_t* dst_pitch) {
+  CopyPlan plan;
+  plan.src = static_cast<const char*>(src);
+  plan.dst = static_cast<char*>(dst);
+  plan.run = ext[rank - 1] * src_pitch[rank - 1];
+  plan.rows = 1;
+  // fold the outer dimensions whose rows follow each other on both sides
+  int d = rank - 2;
+  while (d >= 0 && (ext[d] == 1 || (src_pitch[d] == plan.run && dst_pitch[d] == plan.run))) {
+    plan.run *= ext[d];
+    --d;
+  }
+  for (int i = 0; i <= d; ++i) {
+    if (ext[i] == 1)
+      continue;
+    plan.ext.push_back(ext[i]);
+    plan.srcPitch.push_back(src_pitch[i]);
+    plan.dstPitch.push_back(dst_pitch[i]);
+    plan.rows *= ext[i];
+  }
+  plan.stream = plan.run >= COPY_STREAM_RUN_MIN && plan.run * plan.rows >= COPY_STREAM_MIN;
+  return plan;
+}
+
+static void copy_run(char* dst, const char* src, size_t n, bool stream) {
+#if defined(__SSE2__)
+  if (stream) {
+    size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+    memmove(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+    for (; n >= 64; n -= 64, dst += 64, src += 64) {
+      const __m128i* s = reinterpret_cast<const __m128i*>(src);
+      __m128i* t = reinterpret_cast<__m128i*>(dst);
+      __m128i a = _mm_loadu_si128(s);
+      __m128i b = _mm_loadu_si128(s + 1);
+      __m128i c = _mm_loadu_si128(s + 2);
+      __m128i e = _mm_loadu_si128(s + 3);
+      _mm_stream_si128(t, a);
+      _mm_stream_si128(t + 1, b);
+      _mm_stream_si128(t + 2, c);
+      _mm_stream_si128(t + 3, e);
+    }
+  }
+#endif
+  memmove(dst, src, n);
+}
+
+/// copy rows [first, last) of plan
+static void copy_rows(const CopyPlan& plan, size_t first, size_t last) {
+  const int n = plan.ext.size();
+  std::vector<size_t> idx(n);
+  const char* src = plan.src;
+  char* dst = plan.dst;
+  size_t r = first;
+  for (int i = n - 1; i >= 0; --i) {
+    idx[i] = r % plan.ext[i];
+    r /= plan.ext[i];
+    src += idx[i] * plan.srcPitch[i];
+    dst += idx[i] * plan.dstPitch[i];
+  }
+  for (size_t row = first; row < last; ++row) {
+    copy_run(dst, src, plan.run, plan.stream);
+    for (int i = n - 1; i >= 0; --i) {
+      src += plan.srcPitch[i];
+      dst += plan.dstPitch[i];
+      if (++idx[i] < plan.ext[i])
+        break;
+      src -= plan.ext[i] * plan.srcPitch[i];
+      dst -= plan.ext[i] * plan.dstPitch[i];
+      idx[i] = 0;
+    }
+  }
+#if defined(__SSE2__)
+  if (plan.stream)
+    _mm_sfence();
+#endif
+}
+
+/// one copy spread over the thread pool, the caller waits for its parts
+struct CopyJob
+{
+  const CopyPlan* plan;
+  int parts;
+  std::mutex mtx;
+  std::condition_variable cond;
+  bool done;
+
+  static void run_part(void* arg, int i) {
+    CopyJob* job = static_cast<CopyJob*>(arg);
+    const CopyPlan& plan = *job->plan;
+    if (plan.rows > 1) {
+      copy_rows(plan, plan.rows * i / job->parts, plan.rows * (i + 1) / job->parts);
+      return;
+    }
+    // a single run is split into byte ranges
+    size_t first = plan.run * i / job->parts;
+    size_t last = plan.run * (i + 1) / job->parts;
+    copy_run(plan.dst + first, plan.src + first, last - first, plan.stream);
+#if defined(__SSE2__)
+    if (plan.stream)
+      _mm_sfence();
+#endif
+  }
+
+  static void finish(void* arg) {
+    CopyJob* job = static_cast<CopyJob*>(arg);
+    // notify under the lock, the job lives on the stack of the waiting thread
+    std::lock_guard<std::mutex> lk(job->mtx);
+    job->done = true;
+    job->cond.notify_one();
+  }
+};
+
+void copy_strided(const void* src, void* dst, int rank, const size_t* ext,
+                  const size_t* src_pitch, const size_t* dst_pitch) {
+  for (int i = 0; i < rank; ++i)
+    if (ext[i] == 0)
+      return;
+  CopyPlan plan = make_plan(src, dst, rank, ext, src_pitch, dst_pitch);
+  const size_t total = plan.run * plan.rows;
+  size_t parts = 1;
+  if (total >= COPY_PARALLEL_MIN) {
+    parts = total / COPY_PART_MIN;
+    if (parts > cpu_thread_count(-1))
+      parts = cpu_thread_count(-1);
+    if (plan.rows > 1 && parts > plan.rows)
+      parts = plan.rows;
+  }
+  if (parts <= 1) {
+    copy_rows(plan, 0, plan.rows);
+    return;
+  }
+  CopyJob job;
+  job.plan = &plan;
+  job.parts = parts;
+  job.done = false;
+  cpu_parallel_launch(-1, parts, CopyJob::run_part, CopyJob::finish, &job);
+  cpu_help_until([&job]() {
+    std::lock_guard<std::mutex> lk(job.mtx);
+    return job.done;
+  });
+  std::unique_lock<std::mutex> lk(job.mtx);
+  job.cond.wait(lk, [&] { return job.done; });
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
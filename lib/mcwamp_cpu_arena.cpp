@@ -0,0 +1,183 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <kalmar_aligned_alloc.h>
+
+// Per-thread scratch memory of the CPU path
+//
+// Every worker of the CPU thread pool keeps the fiber stacks, the tiled_index
+// arrays and the buffers of array_views created inside kernels it used last,
+// so back to back launches of short tiled kernels do not go through the
+// allocator. tile_static variables are thread_local on the CPU path and thus
+// already live as long as the worker.
+//
+// Setting HCC_CPU_STACK_GUARD=ON puts an inaccessible page below each fiber
+// stack, so a work-item overflowing its stack faults right away instead of
+// corrupting the stack of its neighbour.
+
+namespace Kalmar {
+namespace CLAMP {
+
+/// bytes a fiber keeps above its stack, see mcwamp_cpu_fiber.cpp
+extern size_t cpu_fiber_context_size();
+
+static bool use_stack_guard() {
+  static bool guard = [] {
+    char* guard_env = getenv("HCC_CPU_STACK_GUARD");
+    return guard_env != nullptr && std::string("ON") == guard_env;
+  }();
+  return guard;
+}
+
+/**
+ * \brief Fiber stacks of one thread
+ *
+ * The stacks are carved out of one anonymous mapping, which only gets
+ * committed as far as the stacks are actually used.
+ */
+struct CPUStackArena
+{
+  char* base;
+  size_t length;
+  size_t slot;
+  int count;
+
+  CPUStackArena() : base(nullptr), length(0), slot(0), count(0) {}
+  ~CPUStackArena() {
+    if (base)
+      munmap(base, length);
+  }
+
+  char* get(int n, size_t size, size_t* stride) {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const bool guard = use_stack_guard();
+    size_t s = guard ? (size + page - 1) / page * page + page
+                     : (size + 15) & ~size_t(15);
+    if (s != slot || n > count) {
+      if (base)
+        munmap(base, length);
+      count = n;
+      slot = s;
+      length = (slot * count + page - 1) / page * page;
+      void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      base = p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+      if (!base) {
+        length = slot = count = 0;
+        throw std::bad_alloc();
+      }
+      if (guard)
+        for (int i = 0; i < count; ++i)
+          mprotect(base + i * slot, page, PROT_NONE);
+    }
+    *stride = slot;
+    return guard ? base + page : base;
+  }
+};
+
+/// a block of memory which only grows
+struct CPUScratch
+{
+  void* ptr;
+  size_t size;
+
+  CPUScratch() : ptr(nullptr), size(0) {}
+  ~CPUScratch() { kalmar_aligned_free(ptr); }
+
+  void* get(size_t n) {
+    if (n > size) {
+      kalmar_aligned_free(ptr);
+      size = n > 2 * size ? n : 2 * size;
+      ptr = kalmar_aligned_alloc(64, size);
+    }
+    return ptr;
+  }
+};
+
+/// smallest and largest power of two buffers kept for reuse
+#define CPU_KERNEL_ALLOC_MIN_SHIFT (6)
+#define CPU_KERNEL_ALLOC_MAX_SHIFT (20)
+/// buffers of one size kept by one thread
+#define CPU_KERNEL_ALLOC_CACHED (8)
+
+/**
+ * \brief Buffers of array_views created inside CPU kernels
+ *
+ * Sizes are rounded up to a power of two; freed buffers go back to the list
+ * of the thread releasing them.
+ */
+struct CPUKernelAllocCache
+{
+  std::vector<void*> free[CPU_KERNEL_ALLOC_MAX_SHIFT + 1];
+
+  ~CPUKernelAllocCache() {
+    for (auto& list : free)
+      for (void* p : list)
+        kalmar_aligned_free(p);
+  }
+
+  static int size_class(size_t size) {
+    int shift = CPU_KERNEL_ALLOC_MIN_SHIFT;
+    while ((size_t(1) << shift) < size)
+      ++shift;
+    return shift;
+  }
+
+  void* alloc(size_t size) {
+    int shift = size_class(size);
+    if (shift > CPU_KERNEL_ALLOC_MAX_SHIFT)
+      return kalmar_aligned_alloc(0x1000, size);
+    if (!free[shift].empty()) {
+      void* p = free[shift].back();
+      free[shift].pop_back();
+      return p;
+    }
+    return kalmar_aligned_alloc(0x1000, size_t(1) << shift);
+  }
+
+  void release(void* p, size_t size) {
+    int shift = size_class(size);
+    if (shift > CPU_KERNEL_ALLOC_MAX_SHIFT || free[shift].size() >= CPU_KERNEL_ALLOC_CACHED) {
+      kalmar_aligned_free(p);
+      return;
+    }
+    free[shift].push_back(p);
+  }
+};
+
+static thread_local CPUStackArena stack_arena;
+static thread_local CPUScratch tile_scratch;
+static thread_local CPUKernelAllocCache kernel_alloc_cache;
+
+char* cpu_fiber_stacks(int count, size_t size, size_t* stride) {
+  return stack_arena.get(count, size + cpu_fiber_context_size(), stride);
+}
+
+void* cpu_tile_scratch(size_t size) {
+  return tile_scratch.get(size);
+}
+
+void* cpu_kernel_alloc(size_t size) {
+  return kernel_alloc_cache.alloc(size);
+}
+
+void cpu_kernel_free(void* ptr, size_t size) {
+  if (ptr)
+    kernel_alloc_cache.release(ptr, size);
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
@@ -0,0 +1,180 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if !defined(__x86_64__)
+#include <ucontext.h>
+#endif
+
+// Fibers used to run the work-items of a tile on the CPU path.
+//
+// On x86-64 a suspended fiber is represented by its saved stack pointer.
+// Switching only saves and restores the callee-saved registers together with
+// the SSE and x87 control words, so unlike swapcontext() there is no signal
+// mask to save and no system call per tile_barrier::wait().
+//
+// Other targets fall back to ucontext: a suspended fiber is represented by
+// its ucontext_t and switching is a swapcontext().
+
+#if defined(__x86_64__)
+
+// void __hcc_cpu_fiber_switch(void** save_sp, void* load_sp)
+//
+// Save the current context on the current stack, store the stack pointer into
+// *save_sp, then resume the context saved at load_sp.
+//
+// __hcc_cpu_fiber_start is where a fiber created by cpu_fiber_make() returns
+// into the first time it is switched to. r12 and r13 hold the arguments, r14
+// the entry point. The entry point must never return.
+asm(R"(
+    .text
+    .globl  __hcc_cpu_fiber_switch
+    .type   __hcc_cpu_fiber_switch, @function
+    .p2align 4
+__hcc_cpu_fiber_switch:
+    pushq   %rbp
+    pushq   %rbx
+    pushq   %r12
+    pushq   %r13
+    pushq   %r14
+    pushq   %r15
+    subq    $16, %rsp
+    stmxcsr 8(%rsp)
+    fnstcw  (%rsp)
+    movq    %rsp, (%rdi)
+    movq    %rsi, %rsp
+    ldmxcsr 8(%rsp)
+    fldcw   (%rsp)
+    addq    $16, %rsp
+    popq    %r15
+    popq    %r14
+    popq    %r13
+    popq    %r12
+    popq    %rbx
+    popq    %rbp
+    ret
+    .size   __hcc_cpu_fiber_switch, .-__hcc_cpu_fiber_switch
+
+    .globl  __hcc_cpu_fiber_start
+    .type   __hcc_cpu_fiber_start, @function
+    .p2align 4
+__hcc_cpu_fiber_start:
+    movq    %r12, %rdi
+    movq    %r13, %rsi
+    callq   *%r14
+    ud2
+    .size   __hcc_cpu_fiber_start, .-__hcc_cpu_fiber_start
+)");
+
+extern "C" void __hcc_cpu_fiber_start();
+
+namespace Kalmar {
+namespace CLAMP {
+
+void* cpu_fiber_make(char* stack, size_t size,
+                     void (*entry)(void*, void*), void* arg0, void* arg1) {
+  // the stack grows down, __hcc_cpu_fiber_start must see a 16-byte aligned
+  // stack pointer so the call into entry keeps the ABI alignment
+  uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size) & ~uintptr_t(15);
+  uint64_t* sp = reinterpret_cast<uint64_t*>(top);
+
+  *--sp = reinterpret_cast<uint64_t>(&__hcc_cpu_fiber_start); // return address
+  *--sp = 0;                                                  // rbp
+  *--sp = 0;                                                  // rbx
+  *--sp = reinterpret_cast<uint64_t>(arg0);                   // r12
+  *--sp = reinterpret_cast<uint64_t>(arg1);                   // r13
+  *--sp = reinterpret_cast<uint64_t>(entry);                  // r14
+  *--sp = 0;                                                  // r15
+
+  // start with the control words of the creating thread
+  uint32_t mxcsr;
+  uint16_t fpucw;
+  asm volatile("stmxcsr %0" : "=m"(mxcsr));
+  asm volatile("fnstcw %0" : "=m"(fpucw));
+  sp -= 2;
+  *reinterpret_cast<uint16_t*>(sp) = fpucw;
+  *reinterpret_cast<uint32_t*>(sp + 1) = mxcsr;
+  return sp;
+}
+
+size_t cpu_fiber_context_size() {
+  return 0;
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
+
+#else // !defined(__x86_64__)
+
+namespace Kalmar {
+namespace CLAMP {
+
+/// a fiber created by cpu_fiber_make(), kept above the top of its stack
+struct CPUFiberContext
+{
+  ucontext_t ctx;
+  void (*entry)(void*, void*);
+  void* arg0;
+  void* arg1;
+};
+
+/// the context the running fiber is saved into when it switches away, null
+/// while the thread runs on its own stack
+static thread_local ucontext_t* cpu_fiber_current = nullptr;
+
+// makecontext() only passes int arguments, the context is split in two
+static void cpu_fiber_start(unsigned int hi, unsigned int lo) {
+  CPUFiberContext* fiber = reinterpret_cast<CPUFiberContext*>(
+      (static_cast<uintptr_t>(hi) << 16 << 16) | lo);
+  cpu_fiber_current = &fiber->ctx;
+  fiber->entry(fiber->arg0, fiber->arg1);
+  __builtin_trap();
+}
+
+void* cpu_fiber_make(char* stack, size_t size,
+                     void (*entry)(void*, void*), void* arg0, void* arg1) {
+  // cpu_fiber_stacks() leaves cpu_fiber_context_size() bytes above the stack
+  uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size + 15) & ~uintptr_t(15);
+  CPUFiberContext* fiber = new (reinterpret_cast<void*>(top)) CPUFiberContext;
+  fiber->entry = entry;
+  fiber->arg0 = arg0;
+  fiber->arg1 = arg1;
+
+  getcontext(&fiber->ctx);
+  fiber->ctx.uc_stack.ss_sp = stack;
+  fiber->ctx.uc_stack.ss_size = size;
+  fiber->ctx.uc_link = nullptr;
+  uintptr_t p = reinterpret_cast<uintptr_t>(fiber);
+  makecontext(&fiber->ctx, (void (*)(void))cpu_fiber_start, 2,
+              static_cast<unsigned int>(p >> 16 >> 16),
+              static_cast<unsigned int>(p & 0xffffffffu));
+  return &fiber->ctx;
+}
+
+size_t cpu_fiber_context_size() {
+  return sizeof(CPUFiberContext) + 16;
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
+
+extern "C" void __hcc_cpu_fiber_switch(void** save_sp, void* load_sp) {
+  // a fiber saves into its own context, the thread's own stack into a frame
+  // of this call which stays alive until the thread is switched back to
+  ucontext_t self;
+  ucontext_t* save = Kalmar::CLAMP::cpu_fiber_current;
+  if (!save)
+    save = &self;
+  *save_sp = save;
+  swapcontext(save, static_cast<ucontext_t*>(load_sp));
+  Kalmar::CLAMP::cpu_fiber_current = save == &self ? nullptr : save;
+}
+
+#endif // !defined(__x86_64__)
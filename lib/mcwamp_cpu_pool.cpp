@@ -0,0 +1,352 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mcwamp_cpu_topology.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace Kalmar {
+namespace CLAMP {
+
+/// number of empty polls a worker makes before going to sleep
+#define CPU_POOL_SPIN_COUNT (2048)
+
+/// whether the calling thread runs a work-item of a tiled kernel, see
+/// mcwamp_cpu_wave.cpp
+extern bool cpu_in_tile();
+
+class CPUThreadPool;
+
+/// the pool the calling thread is a worker of, and its index there
+static thread_local CPUThreadPool* current_pool = nullptr;
+static thread_local unsigned int current_worker = 0;
+
+/**
+ * \brief Completion tracking for all parts submitted by one CPU kernel launch
+ *
+ * The group is owned by the pool; the thread finishing the last part calls
+ * done(arg) and frees it.
+ */
+struct CPUTaskGroup
+{
+  std::atomic<int> remaining;
+  void (*done)(void*);
+  void* arg;
+};
+
+/**
+ * \brief One part of one CPU kernel launch
+ */
+struct CPUTask
+{
+  void (*fn)(void*, int);
+  void* arg;
+  int part;
+  CPUTaskGroup* group;
+};
+
+/**
+ * \brief Process-wide persistent thread pool used by the CPU execution path
+ *
+ * Every worker owns a deque. A launch distributes its parts round-robin over
+ * the deques and returns right away; a worker pops from the back of its own
+ * deque and steals from the front of the others once it runs dry. The thread
+ * finishing the last part of a launch completes it. A thread outside the
+ * pool waiting on a launch blocks, while a worker waiting on one, such as a
+ * kernel waiting on a launch it made, runs queued tasks until it completes.
+ *
+ * There is one pool per NUMA node. On a multi-node system its workers are
+ * pinned to the CPUs of the node, so the kernels of a CPU accelerator bound
+ * to the node run next to its memory. Each pool has one worker per CPU of
+ * its node. HCC_CPU_NUM_THREADS sets the number of workers of all pools
+ * together instead; they are split across the nodes by their number of CPUs,
+ * with at least one worker per node.
+ */
+class CPUThreadPool
+{
+  struct Worker {
+    std::mutex mtx;
+    std::deque<CPUTask> tasks;
+    CPUThreadPool* pool;
+    unsigned int id;
+    pthread_t thread;
+    bool started;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  /// number of tasks pushed to any deque but not yet taken
+  std::atomic<int> pending;
+  /// round-robin cursor used to spread submissions over the deques
+  std::atomic<unsigned int> cursor;
+  std::atomic<bool> stopping;
+  std::mutex sleepMutex;
+  std::condition_variable sleepCond;
+
+  bool popLocal(unsigned int id, CPUTask& task) {
+    Worker& w = *workers[id];
+    std::lock_guard<std::mutex> lk(w.mtx);
+    if (w.tasks.empty())
+      return false;
+    task = w.tasks.back();
+    w.tasks.pop_back();
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /// steal from the front of the deques, starting with the one after @p id
+  bool steal(unsigned int id, CPUTask& task) {
+    const unsigned int n = workers.size();
+    for (unsigned int i = 1; i <= n; ++i) {
+      Worker& w = *workers[(id + i) % n];
+      std::lock_guard<std::mutex> lk(w.mtx);
+      if (w.tasks.empty())
+        continue;
+      task = w.tasks.front();
+      w.tasks.pop_front();
+      pending.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  static void execute(const CPUTask& task) {
+    task.fn(task.arg, task.part);
+    CPUTaskGroup* group = task.group;
+    if (group->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      group->done(group->arg);
+      delete group;
+    }
+  }
+
+  static void* workerMain(void* arg) {
+    Worker* w = static_cast<Worker*>(arg);
+    w->pool->workerLoop(w->id);
+    return nullptr;
+  }
+
+  void workerLoop(unsigned int id) {
+    current_pool = this;
+    current_worker = id;
+    CPUTask task;
+    int idle = 0;
+    while (true) {
+      if (popLocal(id, task) || steal(id, task)) {
+        execute(task);
+        idle = 0;
+        continue;
+      }
+      if (++idle < CPU_POOL_SPIN_COUNT) {
+        std::this_thread::yield();
+        continue;
+      }
+      std::unique_lock<std::mutex> lk(sleepMutex);
+      sleepCond.wait(lk, [&] {
+        return stopping.load() || pending.load() > 0;
+      });
+      if (stopping.load() && pending.load() == 0)
+        return;
+      idle = 0;
+    }
+  }
+
+  /// stop the workers once their deques have drained and join them
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lk(sleepMutex);
+      stopping = true;
+    }
+    sleepCond.notify_all();
+    for (auto& w : workers) {
+      if (w->started)
+        pthread_join(w->thread, nullptr);
+      w->started = false;
+    }
+  }
+
+public:
+  /// @n: number of workers
+  /// @cpus: CPUs the workers are pinned to, empty to leave them unpinned
+  CPUThreadPool(unsigned int n, const std::vector<int>& cpus)
+      : workers(), pending(0), cursor(0), stopping(false),
+        sleepMutex(), sleepCond() {
+    for (unsigned int i = 0; i < n; ++i) {
+      workers.emplace_back(new Worker);
+      workers[i]->pool = this;
+      workers[i]->id = i;
+      workers[i]->started = false;
+    }
+    // the affinity is part of the attributes, so a worker never runs a
+    // single instruction on a CPU outside its node
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (!cpus.empty()) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+      pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    for (unsigned int i = 0; i < n; ++i) {
+      int err = pthread_create(&workers[i]->thread, &attr, &CPUThreadPool::workerMain, workers[i].get());
+      // the CPUs of the node may be unavailable to this process, run unpinned then
+      if (err == EINVAL && !cpus.empty())
+        err = pthread_create(&workers[i]->thread, nullptr, &CPUThreadPool::workerMain, workers[i].get());
+      if (err != 0) {
+        pthread_attr_destroy(&attr);
+        shutdown();
+        throw std::system_error(err, std::system_category(), "CPU thread pool");
+      }
+      workers[i]->started = true;
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  ~CPUThreadPool() { shutdown(); }
+
+  unsigned int size() const { return workers.size(); }
+
+  /// run one queued task on worker id, false if there was none
+  bool help(unsigned int id) {
+    CPUTask task;
+    if (!popLocal(id, task) && !steal(id, task))
+      return false;
+    execute(task);
+    return true;
+  }
+
+  /// queue fn(arg, 0) ... fn(arg, parts - 1) and return right away, done(arg)
+  /// is called by the thread which completes the last of them
+  void launch(int parts, void (*fn)(void*, int), void (*done)(void*), void* arg) {
+    if (parts <= 0) {
+      done(arg);
+      return;
+    }
+    CPUTaskGroup* group = new CPUTaskGroup;
+    group->remaining = parts;
+    group->done = done;
+    group->arg = arg;
+
+    const unsigned int n = workers.size();
+    unsigned int start = cursor.fetch_add(parts, std::memory_order_relaxed);
+    for (int i = 0; i < parts; ++i) {
+      Worker& w = *workers[(start + i) % n];
+      std::lock_guard<std::mutex> lk(w.mtx);
+      w.tasks.push_back({fn, arg, i, group});
+    }
+    pending.fetch_add(parts);
+    {
+      // pairs with the predicate check in workerLoop so no wakeup is lost
+      std::lock_guard<std::mutex> lk(sleepMutex);
+    }
+    sleepCond.notify_all();
+  }
+};
+
+struct CPUNodePool
+{
+  int node;
+  std::unique_ptr<CPUThreadPool> pool;
+};
+
+/// number of CPUs of node, all of the machine if the topology is unknown
+static unsigned int node_cpu_count(const CPUNumaNode& node) {
+  if (!node.cpus.empty())
+    return node.cpus.size();
+  unsigned int n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+/// workers of each node's pool; HCC_CPU_NUM_THREADS is the total over all
+/// nodes, split in proportion to their number of CPUs with at least one each
+static std::vector<unsigned int> cpu_pool_sizes(const std::vector<CPUNumaNode>& nodes) {
+  std::vector<unsigned int> sizes;
+  unsigned int cpus = 0;
+  for (auto& node : nodes) {
+    sizes.push_back(node_cpu_count(node));
+    cpus += sizes.back();
+  }
+  char* threads_env = getenv("HCC_CPU_NUM_THREADS");
+  int total = threads_env != nullptr ? std::atoi(threads_env) : 0;
+  if (total <= 0)
+    return sizes;
+  // one worker per node, the rest goes by number of CPUs
+  unsigned long long rest = total > static_cast<int>(sizes.size()) ? total - sizes.size() : 0;
+  unsigned long long before = 0;
+  for (auto& n : sizes) {
+    unsigned long long first = before * rest / cpus;
+    before += n;
+    n = 1 + before * rest / cpus - first;
+  }
+  return sizes;
+}
+
+static std::vector<CPUNodePool> create_cpu_pools() {
+  std::vector<CPUNodePool> pools;
+  std::vector<CPUNumaNode> nodes = get_cpu_numa_nodes();
+  std::vector<unsigned int> sizes = cpu_pool_sizes(nodes);
+  // pinning only pays off when there is more than one node to choose from
+  bool pin = nodes.size() > 1;
+  for (size_t i = 0; i < nodes.size(); ++i)
+    pools.push_back({nodes[i].id, std::unique_ptr<CPUThreadPool>(
+        new CPUThreadPool(sizes[i], pin ? nodes[i].cpus : std::vector<int>()))});
+  return pools;
+}
+
+/// pool of the given NUMA node, the one of the first node for -1 or an
+/// unknown node
+static CPUThreadPool& get_cpu_pool(int node) {
+  static std::vector<CPUNodePool> pools = create_cpu_pools();
+  for (auto& p : pools)
+    if (p.node == node)
+      return *p.pool;
+  return *pools[0].pool;
+}
+
+unsigned int cpu_thread_count(int node) {
+  return get_cpu_pool(node).size();
+}
+
+void cpu_parallel_launch(int node, int parts, void (*task)(void*, int),
+                         void (*done)(void*), void* arg) {
+  get_cpu_pool(node).launch(parts, task, done, arg);
+}
+
+bool cpu_help_until(const std::function<bool()>& ready) {
+  // work-items of tiled kernels run on fiber stacks too small to run other
+  // tasks on, they wait by blocking
+  if (current_pool == nullptr || cpu_in_tile())
+    return false;
+  while (!ready())
+    if (!current_pool->help(current_worker))
+      std::this_thread::yield();
+  return true;
+}
+
+void cpu_run_async(std::function<void()> fn) {
+  auto* task = new std::function<void()>(std::move(fn));
+  get_cpu_pool(-1).launch(1,
+      [](void* arg, int) { (*static_cast<std::function<void()>*>(arg))(); },
+      [](void* arg) { delete static_cast<std::function<void()>*>(arg); },
+      task);
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
@@ -0,0 +1,67 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Kalmar {
+
+/// One NUMA node and the CPUs it holds
+struct CPUNumaNode
+{
+  int id;
+  std::vector<int> cpus;
+};
+
+/// parse a sysfs CPU or node list, e.g. "0-3,8-11"
+static inline std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> ids;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range[0] < '0' || range[0] > '9')
+      continue;
+    size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int i = first; i <= last; ++i)
+      ids.push_back(i);
+  }
+  return ids;
+}
+
+static inline std::string read_sysfs_line(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+/// NUMA nodes of the system which hold CPUs, in ascending order of id
+///
+/// Memory-only nodes are skipped. If the topology cannot be read the whole
+/// machine is reported as node 0 with an empty CPU list, meaning no affinity.
+static inline std::vector<CPUNumaNode> get_cpu_numa_nodes() {
+  std::vector<CPUNumaNode> nodes;
+  const std::string root = "/sys/devices/system/node/";
+  for (int id : parse_cpu_list(read_sysfs_line(root + "online"))) {
+    std::vector<int> cpus =
+      parse_cpu_list(read_sysfs_line(root + "node" + std::to_string(id) + "/cpulist"));
+    if (!cpus.empty())
+      nodes.push_back({id, cpus});
+  }
+  if (nodes.empty())
+    nodes.push_back({0, std::vector<int>()});
+  return nodes;
+}
+
+} // namespace Kalmar
@@ -0,0 +1,272 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <kalmar_cpu_launch.h>
+
+// Cross-lane functions of the CPU path
+//
+// The work-items of a tile are grouped into wavefronts of consecutive
+// flattened local ids, 64 lanes by default. HCC_CPU_WAVEFRONT_SIZE sets
+// another power of two up to 64.
+//
+// The lanes of a wavefront execute in lockstep: a lane entering a cross-lane
+// operation publishes its operand and passes control to the next lane of the
+// wavefront, which runs up to the same operation. Once every lane has
+// published its operand the lanes resume one after the other and compute
+// their results. Just like on the GPU all lanes of a wavefront must reach
+// the same cross-lane operations.
+//
+// Work-items of non-tiled kernels each form a wavefront of their own.
+
+extern "C" void __hcc_cpu_fiber_switch(void** save_sp, void* load_sp);
+
+namespace Kalmar {
+namespace CLAMP {
+
+static thread_local CPUTileFibers* current_tile = nullptr;
+
+CPUTileFibers* cpu_enter_tile(CPUTileFibers* tile) {
+  CPUTileFibers* prev = current_tile;
+  current_tile = tile;
+  return prev;
+}
+
+bool cpu_in_tile() { return current_tile != nullptr; }
+
+static int wave_size() {
+  static int size = [] {
+    char* size_env = getenv("HCC_CPU_WAVEFRONT_SIZE");
+    int n = size_env ? atoi(size_env) : 64;
+    // lane masks are 64 bits wide
+    if (n < 1 || n > 64 || (n & (n - 1)) != 0)
+      n = 64;
+    return n;
+  }();
+  return size;
+}
+
+/// The wavefront of the calling work-item, as seen by one cross-lane operation
+struct CPUWave
+{
+  /// lane 0 of the wavefront
+  CPULane* lanes;
+  /// lanes of the wavefront which exist, the last one of a tile may be partial
+  int size;
+  /// lane of the caller
+  int lane;
+  /// slot holding the operands of this operation
+  unsigned int slot;
+
+  int value(int l) const { return lanes[l].value[slot]; }
+  int index(int l) const { return lanes[l].index[slot]; }
+};
+
+static int current_lane() {
+  CPUTileFibers* tile = current_tile;
+  return tile ? (tile->cur - 1) & (wave_size() - 1) : 0;
+}
+
+/// publish the operands of the calling lane and wait until every lane of its
+/// wavefront has done the same
+static CPUWave exchange(int value, int index) {
+  CPUWave w;
+  CPUTileFibers* tile = current_tile;
+  if (!tile) {
+    static thread_local CPULane self;
+    self.value[0] = value;
+    self.index[0] = index;
+    w.lanes = &self;
+    w.size = 1;
+    w.lane = 0;
+    w.slot = 0;
+    return w;
+  }
+
+  const int width = wave_size();
+  const int f = tile->cur;
+  const int first = f - ((f - 1) & (width - 1));
+  w.lanes = &tile->lanes[first];
+  w.size = tile->count - first + 1 < width ? tile->count - first + 1 : width;
+  w.lane = f - first;
+
+  CPULane& me = tile->lanes[f];
+  w.slot = me.phase++ & 1;
+  me.value[w.slot] = value;
+  me.index[w.slot] = index;
+
+  // fibers run in descending order: hand over to the next lower lane, the
+  // lowest lane restarts the wavefront from its highest one, which then
+  // finds the operands of all lanes published
+  int next = f > first ? f - 1 : first + w.size - 1;
+  if (next != f) {
+    tile->cur = next;
+    __hcc_cpu_fiber_switch(&tile->sp[f], tile->sp[next]);
+  }
+  return w;
+}
+
+/// data parallel primitive control values of __amdgcn_move_dpp
+enum {
+  DPP_ROW_SHL0 = 0x100,
+  DPP_ROW_SHR0 = 0x110,
+  DPP_ROW_ROR0 = 0x120,
+  DPP_WAVE_SHL1 = 0x130,
+  DPP_WAVE_ROL1 = 0x134,
+  DPP_WAVE_SHR1 = 0x138,
+  DPP_WAVE_ROR1 = 0x13C,
+  DPP_ROW_MIRROR = 0x140,
+  DPP_ROW_HALF_MIRROR = 0x141,
+  DPP_ROW_BCAST15 = 0x142,
+  DPP_ROW_BCAST31 = 0x143
+};
+
+/// lane whose value lane reads for dpp_ctrl, -1 if there is none
+static int dpp_source(int ctrl, int lane, int width) {
+  const int row = lane & ~15;
+  const int n = ctrl & 15;
+  int l;
+  if (ctrl <= 0xFF)
+    return (lane & ~3) | ((ctrl >> ((lane & 3) * 2)) & 3);
+  if (ctrl > DPP_ROW_SHL0 && ctrl < DPP_ROW_SHL0 + 16) {
+    l = lane + n;
+    return (l & ~15) == row ? l : -1;
+  }
+  if (ctrl > DPP_ROW_SHR0 && ctrl < DPP_ROW_SHR0 + 16) {
+    l = lane - n;
+    return l >= 0 && (l & ~15) == row ? l : -1;
+  }
+  if (ctrl > DPP_ROW_ROR0 && ctrl < DPP_ROW_ROR0 + 16)
+    return row | ((lane - n) & 15);
+  switch (ctrl) {
+  case DPP_WAVE_SHL1:
+    return lane + 1 < width ? lane + 1 : -1;
+  case DPP_WAVE_ROL1:
+    return (lane + 1) & (width - 1);
+  case DPP_WAVE_SHR1:
+    return lane - 1;
+  case DPP_WAVE_ROR1:
+    return (lane - 1) & (width - 1);
+  case DPP_ROW_MIRROR:
+    return row | (15 - (lane & 15));
+  case DPP_ROW_HALF_MIRROR:
+    return (lane & ~7) | (7 - (lane & 7));
+  case DPP_ROW_BCAST15:
+    return row > 0 ? row - 1 : -1;
+  case DPP_ROW_BCAST31:
+    return lane >= 32 ? 31 : -1;
+  default:
+    return -1;
+  }
+}
+
+static int move_dpp(int src, int ctrl, int row_mask, int bank_mask, bool bound_ctrl) {
+  CPUWave w = exchange(src, 0);
+  // lanes of disabled rows or banks keep their value
+  if (!((row_mask >> (w.lane >> 4)) & 1) || !((bank_mask >> ((w.lane >> 2) & 3)) & 1))
+    return src;
+  int l = dpp_source(ctrl, w.lane, wave_size());
+  if (l < 0 || l >= w.size)
+    return bound_ctrl ? 0 : src;
+  return w.value(l);
+}
+
+} // namespace CLAMP
+} // namespace Kalmar
+
+using namespace Kalmar::CLAMP;
+
+extern "C" unsigned int __wavesize() {
+  return wave_size();
+}
+
+extern "C" unsigned int __hsail_get_lane_id() {
+  return current_lane();
+}
+
+// every lane of a wavefront is active on the CPU path
+extern "C" unsigned int __activelaneid_u32() {
+  return current_lane();
+}
+
+extern "C" uint64_t __activelanemask_v4_b64_b1(unsigned int input) {
+  CPUWave w = exchange(input != 0, 0);
+  uint64_t mask = 0;
+  for (int l = 0; l < w.size; ++l)
+    if (w.value(l))
+      mask |= uint64_t(1) << l;
+  return mask;
+}
+
+extern "C" unsigned int __activelanepermute_b32(unsigned int src, unsigned int laneId,
+                                                unsigned int identity, unsigned int useIdentity) {
+  CPUWave w = exchange(src, 0);
+  if (useIdentity || laneId >= static_cast<unsigned int>(w.size))
+    return identity;
+  return w.value(laneId);
+}
+
+extern "C" unsigned int __hsail_activelanepermute_b32(unsigned int src, unsigned int lid,
+                                                      unsigned int ival, bool useival) {
+  return __activelanepermute_b32(src, lid, ival, useival);
+}
+
+// lane l reads the value of lane index / 4
+extern "C" int __amdgcn_ds_bpermute(int index, int src) {
+  CPUWave w = exchange(src, 0);
+  int l = (index >> 2) & (wave_size() - 1);
+  return l < w.size ? w.value(l) : 0;
+}
+
+// lane l writes its value to lane index / 4, the highest of several lanes
+// writing the same lane wins
+extern "C" int __amdgcn_ds_permute(int index, int src) {
+  CPUWave w = exchange(src, (index >> 2) & (wave_size() - 1));
+  int ret = 0;
+  for (int l = 0; l < w.size; ++l)
+    if (w.index(l) == w.lane)
+      ret = w.value(l);
+  return ret;
+}
+
+extern "C" int __amdgcn_ds_swizzle(int src, int pattern) {
+  CPUWave w = exchange(src, 0);
+  int l;
+  if (pattern & 0x8000) {
+    // lane i of each group of 4 reads lane pattern[2i + 1 : 2i] of the group
+    l = (w.lane & ~3) | ((pattern >> ((w.lane & 3) * 2)) & 3);
+  } else {
+    // within groups of 32 lanes, ((lane & and_mask) | or_mask) ^ xor_mask
+    int and_mask = pattern & 0x1F;
+    int or_mask = (pattern >> 5) & 0x1F;
+    int xor_mask = (pattern >> 10) & 0x1F;
+    l = (w.lane & ~0x1F) | (((w.lane & and_mask) | or_mask) ^ xor_mask);
+  }
+  return l < w.size ? w.value(l) : 0;
+}
+
+extern "C" int __amdgcn_move_dpp(int src, int dpp_ctrl, int row_mask, int bank_mask, bool bound_ctrl) {
+  return move_dpp(src, dpp_ctrl, row_mask, bank_mask, bound_ctrl);
+}
+
+extern "C" int __amdgcn_wave_sr1(int src, bool bound_ctrl) {
+  return move_dpp(src, DPP_WAVE_SHR1, 0xF, 0xF, bound_ctrl);
+}
+
+extern "C" int __amdgcn_wave_sl1(int src, bool bound_ctrl) {
+  return move_dpp(src, DPP_WAVE_SHL1, 0xF, 0xF, bound_ctrl);
+}
+
+extern "C" int __amdgcn_wave_rr1(int src) {
+  return move_dpp(src, DPP_WAVE_ROR1, 0xF, 0xF, false);
+}
+
+extern "C" int __amdgcn_wave_rl1(int src) {
+  return move_dpp(src, DPP_WAVE_ROL1, 0xF, 0xF, false);
+}
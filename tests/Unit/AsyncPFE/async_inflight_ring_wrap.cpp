@@ -0,0 +1,77 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test dispatching more async commands than an HSA queue tracks at once
+//
+// A queue keeps its in-flight commands in a ring of 512 slots indexed by
+// sequence number, so slots are reused many times over here. The kernels must
+// all run, in submission order on an in-order queue. accelerator_view::wait()
+// only blocks on the youngest command, after which every command must have
+// completed. The futures of commands whose slots were reused before anybody
+// asked for their state must still resolve.
+
+// several times MAX_INFLIGHT_COMMANDS_PER_QUEUE
+#define DISPATCH_COUNT (1300)
+
+#define VEC_SIZE (256)
+
+int main() {
+  bool ret = true;
+
+  hc::accelerator_view av = hc::accelerator().create_view();
+
+  hc::array<int, 1> data(VEC_SIZE, av);
+  hc::array<int, 1> counter(1, av);
+  hc::array<int, 1> ticket(DISPATCH_COUNT, av);
+  hc::parallel_for_each(av, data.get_extent(), [&](hc::index<1> idx) [[hc]] {
+    data[idx] = 0;
+    if (idx[0] == 0)
+      counter[0] = 0;
+  }).wait();
+
+  // each command draws a ticket when it runs, and adds 1 to every element
+  std::vector<hc::completion_future> futures;
+  futures.reserve(DISPATCH_COUNT);
+  for (int i = 0; i < DISPATCH_COUNT; ++i) {
+    futures.push_back(hc::parallel_for_each(av, data.get_extent(), [&, i](hc::index<1> idx) [[hc]] {
+      data[idx] += 1;
+      if (idx[0] == 0)
+        ticket[i] = hc::atomic_fetch_add(&counter[0], 1);
+    }));
+  }
+
+  // the youngest command completes last on an in-order queue
+  av.wait();
+  ret &= futures.back().is_ready();
+
+  // the other futures are only asked for now, long after their slots were
+  // taken by later commands
+  futures[0].wait();
+  futures[DISPATCH_COUNT / 2].wait();
+  for (int i = 0; i < DISPATCH_COUNT; ++i)
+    ret &= futures[i].is_ready();
+
+  std::vector<int> result(VEC_SIZE);
+  hc::copy(data, result.begin());
+  for (int i = 0; i < VEC_SIZE; ++i)
+    ret &= (result[i] == DISPATCH_COUNT);
+
+  // completion order follows submission order
+  std::vector<int> order(DISPATCH_COUNT);
+  hc::copy(ticket, order.begin());
+  for (int i = 0; i < DISPATCH_COUNT; ++i)
+    ret &= (order[i] == i);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,90 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU %t.out
+
+#include <hc.hpp>
+
+#include <future>
+#include <iostream>
+#include <random>
+
+// loop to deliberately slow down kernel execution
+#define LOOP_COUNT (1024)
+
+/// test which checks that kernels launched on the CPU runtime return a
+/// completion_future tied to the work still in flight:
+/// completion_future::wait()
+/// completion_future::is_ready()
+/// completion_future::then()
+/// accelerator_view::create_blocking_marker()
+bool test() {
+  bool ret = true;
+
+  const int vecSize = 2048;
+
+  hc::array_view<int, 1> table_a(vecSize);
+  hc::array_view<int, 1> table_b(vecSize);
+  hc::array_view<int, 1> table_c(vecSize);
+  hc::array_view<int, 1> table_d(vecSize);
+
+  std::random_device rd;
+  std::uniform_int_distribution<int32_t> int_dist;
+  for (int i = 0; i < vecSize; ++i) {
+    table_a[i] = int_dist(rd);
+    table_b[i] = int_dist(rd);
+  }
+
+  hc::accelerator_view av = hc::accelerator().get_default_view();
+  hc::extent<1> e(vecSize);
+
+  hc::completion_future fut = hc::parallel_for_each(av, e,
+    [=](hc::index<1> idx) __HC__ {
+      for (int i = 0; i < LOOP_COUNT; ++i)
+        table_c(idx) = table_a(idx) + table_b(idx);
+  });
+  ret &= fut.valid();
+
+  // a second kernel in another tile shape, independent of the first one
+  hc::completion_future fut2 = hc::parallel_for_each(av, e.tile(64),
+    [=](hc::tiled_index<1> tidx) __HC__ {
+      table_d(tidx.global) = tidx.local[0];
+  });
+
+  std::promise<void> done_promise;
+  auto callback = [&done_promise] { done_promise.set_value(); };
+  fut.then(callback);
+
+  // the marker must not complete before the kernels it depends on
+  hc::completion_future marker = av.create_blocking_marker({ fut, fut2 });
+  marker.wait();
+  ret &= marker.is_ready();
+  ret &= fut.is_ready();
+  ret &= fut2.is_ready();
+
+  av.wait();
+  ret &= (av.get_pending_async_ops() == 0);
+
+  int error = 0;
+  for (int i = 0; i < vecSize; ++i) {
+    error += table_c[i] - (table_a[i] + table_b[i]);
+    error += table_d[i] != (i % 64);
+  }
+  ret &= (error == 0);
+
+  // the callback of then() runs once the first kernel has completed
+  ret &= (done_promise.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+  return ret;
+}
+
+int main() {
+  bool ret = true;
+
+  ret &= test();
+
+  return !(ret == true);
+}
@@ -0,0 +1,127 @@
+// XFAIL: Linux
+// RUN: %hc %s -I%hsa_header_path -I%S/../../../lib/hsa -o %t.out && %t.out
+#include <hsa.h>
+
+#include <hsa_packet_writer.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// test writing AQL packets into a ring in host memory
+//
+// The writer only needs the slots, the indices and the doorbell of a ring.
+// Here they are plain host memory: the slots of a batch are reserved at once,
+// the packets land in consecutive slots wrapping around the end of the ring,
+// the doorbell is rung a single time per batch with the index of the last
+// packet, a batch the ring has no room for is refused and one filling the
+// free slots exactly is not.
+
+#define RING_SIZE (8)
+
+struct HostRing {
+  std::vector<Kalmar::AqlPacket> slots;
+  uint64_t readIndex;
+  uint64_t writeIndex;
+  uint64_t doorbell;
+  int doorbellCount;
+
+  HostRing() : slots(RING_SIZE), readIndex(0), writeIndex(0), doorbell(0), doorbellCount(0) {
+    for (auto& slot : slots) {
+      memset(slot.bytes, 0, AQL_PACKET_SIZE);
+      slot.bytes[0] = HSA_PACKET_TYPE_INVALID;
+    }
+  }
+
+  void* base() { return slots.data(); }
+  uint32_t size() { return RING_SIZE; }
+  uint64_t loadReadIndex() { return readIndex; }
+  uint64_t loadWriteIndex() { return writeIndex; }
+  uint64_t casWriteIndex(uint64_t expected, uint64_t index) {
+    uint64_t observed = writeIndex;
+    if (observed == expected)
+      writeIndex = index;
+    return observed;
+  }
+  void ringDoorbell(uint64_t index) { doorbell = index; ++doorbellCount; }
+
+  const hsa_kernel_dispatch_packet_t& dispatch(uint64_t index) {
+    return *reinterpret_cast<const hsa_kernel_dispatch_packet_t*>(slots[index % RING_SIZE].bytes);
+  }
+};
+
+hsa_kernel_dispatch_packet_t make_dispatch(uint32_t grid) {
+  hsa_kernel_dispatch_packet_t aql;
+  memset(&aql, 0, sizeof(aql));
+  aql.header = (HSA_PACKET_TYPE_KERNEL_DISPATCH << HSA_PACKET_HEADER_TYPE) |
+               (1 << HSA_PACKET_HEADER_BARRIER);
+  aql.setup = 1 << HSA_KERNEL_DISPATCH_PACKET_SETUP_DIMENSIONS;
+  aql.grid_size_x = grid;
+  aql.kernel_object = 0x1000 + grid;
+  return aql;
+}
+
+int main() {
+  bool ret = true;
+
+  HostRing ring;
+  Kalmar::AqlPacketWriter<HostRing> writer(ring);
+
+  // a batch of 3 packets, a dispatch and a barrier among them
+  ret &= writer.reserve(3);
+  ret &= (ring.writeIndex == 3);
+  writer.write(make_dispatch(1));
+  hsa_barrier_and_packet_t barrier;
+  memset(&barrier, 0, sizeof(barrier));
+  barrier.header = HSA_PACKET_TYPE_BARRIER_AND << HSA_PACKET_HEADER_TYPE;
+  barrier.completion_signal.handle = 42;
+  writer.write(barrier);
+  writer.write(make_dispatch(3));
+  writer.commit();
+
+  ret &= (ring.doorbellCount == 1);
+  ret &= (ring.doorbell == 2);
+  ret &= (ring.dispatch(0).grid_size_x == 1);
+  ret &= (ring.dispatch(0).setup == 1);
+  ret &= (ring.dispatch(0).kernel_object == 0x1001);
+  ret &= (reinterpret_cast<const hsa_barrier_and_packet_t&>(ring.dispatch(1)).completion_signal.handle == 42);
+  ret &= ((ring.dispatch(1).header >> HSA_PACKET_HEADER_TYPE & 0xff) == HSA_PACKET_TYPE_BARRIER_AND);
+  ret &= (ring.dispatch(2).grid_size_x == 3);
+  // slots past the batch are untouched
+  ret &= (ring.dispatch(3).header == HSA_PACKET_TYPE_INVALID);
+
+  // the packet processor consumed the first batch, the next one wraps around
+  ring.readIndex = 3;
+  ret &= writer.reserve(6);
+  for (uint32_t i = 0; i < 6; ++i)
+    writer.write(make_dispatch(10 + i));
+  writer.commit();
+  ret &= (ring.doorbellCount == 2);
+  ret &= (ring.doorbell == 8);
+  ret &= (ring.writeIndex == 9);
+  for (uint64_t i = 3; i < 9; ++i)
+    ret &= (ring.dispatch(i).grid_size_x == 10 + i - 3);
+
+  // 6 packets are in flight, there is no room for 3 more
+  ret &= !writer.reserve(3);
+  ret &= (ring.writeIndex == 9);
+  ret &= (ring.doorbellCount == 2);
+
+  // but 2 more fill the ring
+  ret &= writer.reserve(2);
+  writer.write(make_dispatch(20));
+  writer.write(make_dispatch(21));
+  writer.commit();
+  ret &= (ring.writeIndex == 11);
+  ret &= (ring.doorbell == 10);
+  ret &= (ring.dispatch(9).grid_size_x == 20);
+  ret &= (ring.dispatch(10).grid_size_x == 21);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,71 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test that modifying a section of a large array_view only transfers the
+// chunks holding the section
+//
+// A kernel writes a small window of the data, then the host reads all of it.
+// Only the window has to come back from the accelerator, and a window
+// written on the host only has to go to the accelerator for the next kernel.
+
+#define VEC_SIZE (16 << 20)
+#define WINDOW_OFFSET (4 << 20)
+#define WINDOW_SIZE (1024)
+
+int main() {
+  bool ret = true;
+
+  std::vector<int> data(VEC_SIZE, 1);
+  hc::array_view<int, 1> av(VEC_SIZE, data);
+
+  // bring the data to the accelerator once
+  hc::parallel_for_each(hc::extent<1>(1), [=](hc::index<1> idx) __HC__ {
+    av[idx];
+  }).wait();
+
+  hc::array_view<int, 1> window = av.section(WINDOW_OFFSET, WINDOW_SIZE);
+  hc::coherence_stats before = hc::get_coherence_stats();
+  hc::parallel_for_each(window.get_extent(), [=](hc::index<1> idx) __HC__ {
+    window[idx] = 2;
+  }).wait();
+  av.synchronize();
+  hc::coherence_stats after = hc::get_coherence_stats();
+
+  // at most the two chunks overlapping the window come back
+  ret &= (after.bytes_copied - before.bytes_copied <= 2 * 64 * 1024);
+
+  for (int i = 0; i < VEC_SIZE; ++i) {
+    bool in_window = i >= WINDOW_OFFSET && i < WINDOW_OFFSET + WINDOW_SIZE;
+    ret &= (av[i] == (in_window ? 2 : 1));
+  }
+
+  // modify the window on the host, the next kernel only needs the window
+  for (int i = 0; i < WINDOW_SIZE; ++i)
+    window[i] = 3;
+  before = hc::get_coherence_stats();
+  hc::array_view<int, 1> sum(1);
+  sum[0] = 0;
+  hc::parallel_for_each(hc::extent<1>(1), [=](hc::index<1> idx) __HC__ {
+    int s = 0;
+    for (int i = 0; i < WINDOW_SIZE; ++i)
+      s += av[WINDOW_OFFSET + i];
+    sum[0] = s;
+  }).wait();
+  after = hc::get_coherence_stats();
+
+  // the window, plus the 4 bytes of sum going there and back
+  ret &= (after.bytes_copied - before.bytes_copied <= 2 * 64 * 1024 + 2 * sizeof(int));
+  ret &= (sum[0] == 3 * WINDOW_SIZE);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,73 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test launching kernels in a batch
+//
+// The kernels of a batch are sent to the device together at end_batch().
+// They must still run in order, waiting on one of them in the middle of the
+// batch must send the batch early instead of blocking forever, and a host
+// access inside a batch must see the results of the kernels before it.
+
+#define VEC_SIZE (1024)
+#define BATCH (48)
+
+int main() {
+  bool ret = true;
+
+  hc::accelerator_view av = hc::accelerator().create_view();
+  hc::array_view<int, 1> a(VEC_SIZE);
+  for (int i = 0; i < VEC_SIZE; ++i)
+    a[i] = i;
+
+  // a whole pipeline in one batch
+  std::vector<hc::completion_future> futures;
+  av.begin_batch();
+  for (int i = 0; i < BATCH; ++i) {
+    futures.push_back(hc::parallel_for_each(av, a.get_extent(), [=](hc::index<1> idx) [[hc]] {
+      a[idx] = a[idx] * 2 % 1000003 + 1;
+    }));
+  }
+  av.end_batch();
+  futures.back().wait();
+
+  std::vector<int> expected(VEC_SIZE);
+  for (int i = 0; i < VEC_SIZE; ++i) {
+    expected[i] = i;
+    for (int j = 0; j < BATCH; ++j)
+      expected[i] = expected[i] * 2 % 1000003 + 1;
+    ret &= (a[i] == expected[i]);
+  }
+
+  // waiting inside a batch, nested batches
+  av.begin_batch();
+  av.begin_batch();
+  hc::completion_future first = hc::parallel_for_each(av, a.get_extent(), [=](hc::index<1> idx) [[hc]] {
+    a[idx] = idx[0];
+  });
+  first.wait();
+  ret &= first.is_ready();
+  hc::parallel_for_each(av, a.get_extent(), [=](hc::index<1> idx) [[hc]] {
+    a[idx] += 1;
+  });
+  av.end_batch();
+  // still batched: the host access sends the batch itself
+  ret &= (a[VEC_SIZE - 1] == VEC_SIZE);
+  av.end_batch();
+
+  av.wait();
+  ret &= (av.get_pending_async_ops() == 0);
+  for (int i = 0; i < VEC_SIZE; ++i)
+    ret &= (a[i] == i + 1);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
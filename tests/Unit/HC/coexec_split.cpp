@@ -0,0 +1,71 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU HCC_COEXEC=ON %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test splitting large launches between the CPU and their accelerator
+//
+// In the CPU runtime the host and the CPU accelerators share their memory,
+// so with HCC_COEXEC=ON the leading rows of each launch below run on the host
+// queue and the others on the accelerator, both at once. The share of the
+// host moves from one launch of a kernel to the next; every launch must still
+// cover its whole extent exactly once, and a host access must wait for both
+// halves.
+
+#define VEC_SIZE (1 << 20)
+#define DIM (512)
+#define ITERATIONS (8)
+
+int main() {
+  bool ret = true;
+
+  hc::accelerator_view av = hc::accelerator().get_default_view();
+
+  // 1-D, accumulating into the same buffer launch after launch
+  std::vector<int> host(VEC_SIZE, 0);
+  hc::array_view<int, 1> table(VEC_SIZE, host);
+  for (int i = 0; i < ITERATIONS; ++i) {
+    hc::parallel_for_each(av, table.get_extent(), [=](hc::index<1> idx) __HC__ {
+      table[idx] += idx[0] + 1;
+    });
+  }
+  for (int i = 0; i < VEC_SIZE; ++i)
+    ret &= (table[i] == ITERATIONS * (i + 1));
+
+  // 2-D, reading one buffer written by the previous launch
+  hc::array<float, 2> a(DIM, DIM, av);
+  hc::array<float, 2> b(DIM, DIM, av);
+  for (int i = 0; i < ITERATIONS; ++i) {
+    hc::parallel_for_each(av, a.get_extent(), [=, &a](hc::index<2> idx) __HC__ {
+      a[idx] = idx[0] * DIM + idx[1] + i;
+    });
+    hc::parallel_for_each(av, b.get_extent(), [=, &a, &b](hc::index<2> idx) __HC__ {
+      b[idx] = a[idx] * 2;
+    });
+    std::vector<float> out(DIM * DIM);
+    hc::copy(b, out.begin());
+    for (int j = 0; j < DIM * DIM; ++j)
+      ret &= (out[j] == (j + i) * 2.0f);
+  }
+
+  // the future covers both halves
+  hc::array_view<int, 1> last(VEC_SIZE);
+  last.discard_data();
+  hc::completion_future fut = hc::parallel_for_each(av, last.get_extent(), [=](hc::index<1> idx) __HC__ {
+    last[idx] = VEC_SIZE - idx[0];
+  });
+  fut.wait();
+  ret &= fut.is_ready();
+  ret &= (last[0] == VEC_SIZE);
+  ret &= (last[VEC_SIZE - 1] == 1);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
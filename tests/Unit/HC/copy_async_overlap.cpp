@@ -0,0 +1,75 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+// RUN: %hc -cpu %s -o %t.cpu.out && HCC_RUNTIME=CPU %t.cpu.out
+#include <hc.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// test that copy_async and synchronize_async make progress on their own
+//
+// The copies run on the copy worker of the runtime, so their futures become
+// ready without anybody waiting on them, while the host goes on with other
+// work. Host accesses to a buffer wait for the copy using it.
+
+#define VEC_SIZE (1 << 20)
+
+// poll fut until it is ready, without ever waiting on it
+bool becomes_ready(hc::completion_future& fut) {
+  for (int i = 0; i < 10000; ++i) {
+    if (fut.is_ready())
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+int main() {
+  bool ret = true;
+
+  std::vector<int> host(VEC_SIZE);
+  for (int i = 0; i < VEC_SIZE; ++i)
+    host[i] = i;
+
+  hc::array<int, 1> table(VEC_SIZE);
+  hc::completion_future fut = hc::copy_async(host.begin(), host.end(), table);
+  ret &= fut.valid();
+  ret &= becomes_ready(fut);
+
+  // a kernel queued behind the copy sees its data
+  hc::array_view<int, 1> out(VEC_SIZE);
+  out.discard_data();
+  hc::parallel_for_each(out.get_extent(), [=, &table](hc::index<1> idx) __HC__ {
+    out[idx] = table[idx] * 2;
+  });
+
+  // copy back while the host keeps going, reading out waits for the kernel
+  std::vector<int> result(VEC_SIZE);
+  hc::completion_future back = hc::copy_async(out, result.begin());
+  ret &= becomes_ready(back);
+  for (int i = 0; i < VEC_SIZE; ++i)
+    ret &= (result[i] == i * 2);
+
+  // the future outlives the array_view it was created from
+  hc::completion_future sync;
+  {
+    hc::array_view<int, 1> view(table);
+    sync = view.synchronize_async();
+  }
+  ret &= becomes_ready(sync);
+
+  // a host access to the destination waits for the copy
+  hc::array_view<int, 1> dest(VEC_SIZE);
+  hc::copy_async(out, dest);
+  ret &= (dest[VEC_SIZE - 1] == (VEC_SIZE - 1) * 2);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,68 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test copying sections of a 3-D volume
+//
+// Sections spanning whole rows or planes of their volume are copied as a few
+// large runs, the volume is large enough for the copy to be spread over
+// several threads.
+
+#define DIM (160)
+
+int main() {
+  bool ret = true;
+
+  std::vector<int> data(DIM * DIM * DIM);
+  for (int i = 0; i < DIM * DIM * DIM; ++i)
+    data[i] = i;
+  hc::array_view<int, 3> volume(DIM, DIM, DIM, data);
+
+  auto value = [](int i, int j, int k) { return (i * DIM + j) * DIM + k; };
+
+  // a box inside the volume, rows are not contiguous
+  hc::extent<3> box(DIM - 20, DIM - 30, DIM - 40);
+  hc::array<int, 3> inner(box);
+  hc::copy(volume.section(hc::index<3>(10, 20, 30), box), inner);
+  std::vector<int> out(box.size());
+  hc::copy(inner, out.begin());
+  for (int i = 0; i < box[0]; ++i)
+    for (int j = 0; j < box[1]; ++j)
+      for (int k = 0; k < box[2]; ++k)
+        ret &= (out[(i * box[1] + j) * box[2] + k] == value(i + 10, j + 20, k + 30));
+
+  // whole planes, the copy collapses to a single run
+  hc::extent<3> planes(DIM / 2, DIM, DIM);
+  hc::array_view<int, 3> half(planes);
+  hc::copy(volume.section(hc::index<3>(DIM / 4, 0, 0), planes), half);
+  for (int i = 0; i < planes[0]; i += 7)
+    for (int j = 0; j < DIM; j += 3)
+      for (int k = 0; k < DIM; ++k)
+        ret &= (half(i, j, k) == value(i + DIM / 4, j, k));
+
+  // between two sections of different volumes
+  std::vector<int> other(DIM * DIM * DIM, -1);
+  hc::array_view<int, 3> target(DIM, DIM, DIM, other);
+  hc::extent<3> slab(DIM / 2, DIM / 2, DIM);
+  hc::copy(volume.section(hc::index<3>(0, DIM / 2, 0), slab),
+           target.section(hc::index<3>(DIM / 2, 0, 0), slab));
+  target.synchronize();
+  for (int i = 0; i < DIM; ++i)
+    for (int j = 0; j < DIM; ++j)
+      for (int k = 0; k < DIM; k += 5) {
+        bool inside = i >= DIM / 2 && j < DIM / 2;
+        int expected = inside ? value(i - DIM / 2, j + DIM / 2, k) : -1;
+        ret &= (other[(i * DIM + j) * DIM + k] == expected);
+      }
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
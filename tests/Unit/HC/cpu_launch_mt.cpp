@@ -0,0 +1,88 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// stress test for CPU kernels launched from several host threads at once
+//
+// Every thread owns an accelerator_view and launches a mix of non-tiled and
+// tiled kernels on it, while also creating host side array_view instances
+// between the launches. The kernels of different threads are in flight at
+// the same time, so any kernel execution state shared between them would
+// corrupt the results or the buffers created on the host.
+
+#define NUM_THREADS (4)
+#define NUM_ITERATIONS (64)
+#define VEC_SIZE (4096)
+#define TILE_SIZE (64)
+
+void test(bool* result, int seed) {
+  bool ret = true;
+
+  hc::accelerator_view av = hc::accelerator().create_view();
+  std::vector<hc::completion_future> futures;
+
+  for (int iter = 0; iter < NUM_ITERATIONS; ++iter) {
+    int base = seed * NUM_ITERATIONS + iter;
+
+    // created on the host while kernels of other threads are running
+    hc::array_view<int, 1> table(VEC_SIZE);
+    hc::array_view<int, 1> sums(VEC_SIZE / TILE_SIZE);
+
+    futures.push_back(hc::parallel_for_each(av, table.get_extent(),
+      [=](hc::index<1> idx) __HC__ {
+        table[idx] = idx[0] + base;
+    }));
+
+    futures.push_back(hc::parallel_for_each(av, table.get_extent().tile(TILE_SIZE),
+      [=](hc::tiled_index<1> tidx) __HC__ {
+        tile_static int lds[TILE_SIZE];
+        lds[tidx.local[0]] = table[tidx.global];
+        tidx.barrier.wait();
+        if (tidx.local[0] == 0) {
+          int sum = 0;
+          for (int i = 0; i < TILE_SIZE; ++i)
+            sum += lds[i];
+          sums[tidx.tile] = sum;
+        }
+    }));
+
+    for (int t = 0; t < VEC_SIZE / TILE_SIZE; ++t) {
+      int expected = 0;
+      for (int i = 0; i < TILE_SIZE; ++i)
+        expected += t * TILE_SIZE + i + base;
+      ret &= (sums[t] == expected);
+    }
+  }
+
+  av.wait();
+  for (auto& fut : futures)
+    ret &= fut.is_ready();
+
+  *result = ret;
+}
+
+int main() {
+  bool ret = true;
+
+  bool results[NUM_THREADS];
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; ++i)
+    threads.push_back(std::thread(test, &results[i], i));
+  for (auto& t : threads)
+    t.join();
+
+  for (int i = 0; i < NUM_THREADS; ++i)
+    ret &= results[i];
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,57 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU %t.out
+// RUN: HCC_CPU_NUM_THREADS=1 HCC_RUNTIME=CPU %t.out
+#include <hc.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+// test CPU kernels launching kernels of their own and waiting for them
+//
+// The outer launch has far more work-items than the pool has workers, so
+// every worker ends up inside an outer work-item waiting on an inner launch.
+// The waiting workers run the parts of the inner launches themselves;
+// otherwise no worker would be left to run them and the pool would hang.
+
+#define OUTER_PER_THREAD (256)
+#define INNER_SIZE (1024)
+
+static hc::accelerator_view* inner_av;
+static std::atomic<int> inner_items(0);
+
+int main() {
+  bool ret = true;
+
+  hc::accelerator_view outer_av = hc::accelerator().create_view();
+  hc::accelerator_view av = hc::accelerator().create_view();
+  inner_av = &av;
+
+  unsigned int threads = std::thread::hardware_concurrency();
+  if (threads == 0)
+    threads = 1;
+  const int outer = OUTER_PER_THREAD * threads;
+
+  hc::array_view<int, 1> done(outer);
+  for (int i = 0; i < outer; ++i)
+    done[i] = 0;
+
+  hc::parallel_for_each(outer_av, done.get_extent(), [=](hc::index<1> idx) [[hc]] {
+    hc::parallel_for_each(*inner_av, hc::extent<1>(INNER_SIZE), [=](hc::index<1>) [[hc]] {
+      inner_items.fetch_add(1, std::memory_order_relaxed);
+    }).wait();
+    done[idx] = 1;
+  }).wait();
+
+  for (int i = 0; i < outer; ++i)
+    ret &= (done[i] == 1);
+  ret &= (inner_items.load() == outer * INNER_SIZE);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
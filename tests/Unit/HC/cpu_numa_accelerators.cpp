@@ -0,0 +1,55 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test partitioning work across the CPU accelerators of the CPU runtime
+//
+// The runtime exposes one accelerator per NUMA node on multi-socket systems,
+// and a single one otherwise. Each accelerator gets a slice of the data and
+// the kernels of all slices are in flight at the same time.
+
+#define VEC_SIZE (1 << 16)
+
+int main() {
+  bool ret = true;
+
+  std::vector<hc::accelerator_view> views;
+  for (auto& acc : hc::accelerator::get_all()) {
+    // skip the host device
+    if (acc.get_device_path() == L"cpu")
+      continue;
+    views.push_back(acc.get_default_view());
+  }
+  ret &= !views.empty();
+
+  const int slice = VEC_SIZE / views.size();
+  std::vector<hc::array_view<int, 1>> tables;
+  std::vector<hc::completion_future> futures;
+  for (size_t i = 0; i < views.size(); ++i) {
+    hc::array_view<int, 1> table(slice);
+    int base = i * slice;
+    futures.push_back(hc::parallel_for_each(views[i], table.get_extent(),
+      [=](hc::index<1> idx) __HC__ {
+        table[idx] = base + idx[0];
+    }));
+    tables.push_back(table);
+  }
+
+  for (auto& fut : futures)
+    fut.wait();
+
+  for (size_t i = 0; i < tables.size(); ++i)
+    for (int j = 0; j < slice; ++j)
+      ret &= (tables[i][j] == static_cast<int>(i) * slice + j);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,104 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU %t.out
+// RUN: HCC_RUNTIME=CPU HCC_CPU_NUM_THREADS=3 %t.out
+#include <hc.hpp>
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// test the thread pools behind the CPU accelerators of the CPU runtime
+//
+// On a multi-node system every accelerator is bound to one NUMA node, and
+// the workers running its kernels are pinned to the CPUs of that node. Each
+// part of a launch on the pool of a node records the CPU it ran on, which
+// must belong to the node. HCC_CPU_NUM_THREADS is the number of workers of
+// all pools together, with at least one per node.
+
+// CPUs listed in /sys/devices/system/node/node<node>/cpulist
+std::vector<bool> node_cpus(int node) {
+  std::vector<bool> cpus;
+  std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+  std::string list;
+  std::getline(in, list);
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    if (static_cast<int>(cpus.size()) <= last)
+      cpus.resize(last + 1, false);
+    for (int c = first; c <= last; ++c)
+      cpus[c] = true;
+  }
+  return cpus;
+}
+
+struct Parts {
+  std::vector<int> cpu;
+  std::atomic<bool> done;
+};
+
+void run_part(void* arg, int part) {
+  static_cast<Parts*>(arg)->cpu[part] = sched_getcpu();
+}
+
+void finish(void* arg) {
+  static_cast<Parts*>(arg)->done = true;
+}
+
+int main() {
+  bool ret = true;
+
+  std::vector<int> nodes;
+  for (auto& acc : hc::accelerator::get_all()) {
+    std::wstring path = acc.get_device_path();
+    if (path.compare(0, 8, L"fallback") != 0)
+      continue;
+    nodes.push_back(path.size() > 8 ? std::stoi(path.substr(8)) : -1);
+  }
+  ret &= !nodes.empty();
+
+  unsigned int workers = 0;
+  for (int node : nodes) {
+    unsigned int n = Kalmar::CLAMP::cpu_thread_count(node);
+    workers += n;
+    ret &= n > 0;
+
+    Parts parts;
+    parts.cpu.assign(n, -1);
+    parts.done = false;
+    Kalmar::CLAMP::cpu_parallel_launch(node, n, run_part, finish, &parts);
+    while (!parts.done)
+      sched_yield();
+
+    // the pool of a single node system is not pinned
+    if (node < 0)
+      continue;
+    std::vector<bool> cpus = node_cpus(node);
+    for (int cpu : parts.cpu)
+      ret &= cpu >= 0 && cpu < static_cast<int>(cpus.size()) && cpus[cpu];
+  }
+
+  char* threads_env = getenv("HCC_CPU_NUM_THREADS");
+  if (threads_env != nullptr) {
+    unsigned int total = std::atoi(threads_env);
+    ret &= workers == std::max<unsigned int>(total, nodes.size());
+  }
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,82 @@
+// XFAIL: Linux
+// RUN: %hc -cpu %s -o %t.out && HCC_RUNTIME=CPU %t.out
+// RUN: HCC_RUNTIME=CPU HCC_CPU_WAVEFRONT_SIZE=16 %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test the cross-lane functions on the CPU runtime
+//
+// The work-items of a tile are grouped into emulated wavefronts, so
+// warp-synchronous reductions and scans give the same results as on the GPU.
+// The wavefront size is taken from the kernel, as it can be changed through
+// HCC_CPU_WAVEFRONT_SIZE.
+
+#define GRID_SIZE (4096)
+#define TILE_SIZE (256)
+
+int main() {
+  bool ret = true;
+
+  hc::array_view<int, 1> wave(1);
+  hc::array_view<int, 1> lane(GRID_SIZE);
+  hc::array_view<int, 1> sum(GRID_SIZE);
+  hc::array_view<int, 1> scan(GRID_SIZE);
+  hc::array_view<int, 1> shifted(GRID_SIZE);
+  hc::array_view<uint64_t, 1> ballot(GRID_SIZE);
+
+  hc::parallel_for_each(hc::extent<1>(GRID_SIZE).tile(TILE_SIZE),
+    [=](hc::tiled_index<1> tidx) __HC__ {
+      int i = tidx.global[0];
+      int width = hc::__wavesize();
+      if (i == 0)
+        wave[0] = width;
+      lane[i] = hc::__lane_id();
+
+      // butterfly reduction over the wavefront
+      int v = i;
+      for (int mask = width / 2; mask > 0; mask /= 2)
+        v += hc::__shfl_xor(v, mask, width);
+      sum[i] = v;
+
+      // inclusive scan of ones
+      int s = 1;
+      for (int delta = 1; delta < width; delta *= 2) {
+        int t = hc::__shfl_up(s, delta, width);
+        if (hc::__lane_id() >= delta)
+          s += t;
+      }
+      scan[i] = s;
+
+      shifted[i] = hc::__amdgcn_wave_sr1(i, true);
+      ballot[i] = hc::__ballot(i & 1);
+  }).wait();
+
+  const int width = wave[0];
+  ret &= (width > 0 && width <= 64 && (width & (width - 1)) == 0);
+
+  for (int i = 0; i < GRID_SIZE; ++i) {
+    int first = i / width * width;
+    int expected_sum = 0;
+    uint64_t expected_ballot = 0;
+    for (int j = 0; j < width; ++j) {
+      expected_sum += first + j;
+      if ((first + j) & 1)
+        expected_ballot |= uint64_t(1) << j;
+    }
+    ret &= (lane[i] == i - first);
+    ret &= (sum[i] == expected_sum);
+    ret &= (scan[i] == i - first + 1);
+    ret &= (shifted[i] == (i == first ? 0 : i - 1));
+    ret &= (ballot[i] == expected_ballot);
+  }
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,50 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test dependencies between kernels of an any-order queue
+//
+// Each kernel reads what the previous one wrote. The queue does not order
+// its kernels by itself, the dispatches wait for each other through
+// barrier packets while the host queues the whole chain without waiting.
+
+#define VEC_SIZE (1 << 16)
+#define CHAIN (16)
+
+int main() {
+  bool ret = true;
+
+  hc::accelerator_view av = hc::accelerator().create_view(hc::execute_any_order);
+
+  hc::array<int, 1> a(VEC_SIZE, av);
+  hc::array<int, 1> b(VEC_SIZE, av);
+  hc::parallel_for_each(av, a.get_extent(), [&a](hc::index<1> idx) [[hc]] {
+    a[idx] = idx[0];
+  });
+
+  std::vector<hc::completion_future> futures;
+  for (int i = 0; i < CHAIN; ++i) {
+    hc::array<int, 1>& src = (i % 2) ? b : a;
+    hc::array<int, 1>& dst = (i % 2) ? a : b;
+    futures.push_back(hc::parallel_for_each(av, a.get_extent(), [&src, &dst](hc::index<1> idx) [[hc]] {
+      dst[idx] = src[idx] + 1;
+    }));
+  }
+  futures.back().wait();
+
+  std::vector<int> out(VEC_SIZE);
+  hc::copy(a, out.begin());
+  for (int i = 0; i < VEC_SIZE; ++i)
+    ret &= (out[i] == i + CHAIN);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,134 @@
+// XFAIL: Linux
+// RUN: %hc %s -I%S/../../../lib/hsa -o %t.out && %t.out
+#include <hsa_dependencies.hpp>
+
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// test the buffer dependency bookkeeping of HSA queues on stand-in operations
+//
+// BufferDependencies only looks at isReady() and getFuture() of the
+// operations it tracks, so plain host operations stand in for kernel
+// dispatches here. A dispatch collects the users of its buffers still in
+// flight, each of them once, skipping completed or destroyed ones. The
+// collected users are forgotten, so a host access afterwards only waits for
+// the users recorded since.
+
+class FakeOp : public Kalmar::KalmarAsyncOp {
+  std::promise<void> promise;
+  std::shared_future<void> future;
+
+public:
+  FakeOp() : KalmarAsyncOp(Kalmar::hcCommandKernel), promise(), future(promise.get_future().share()) {}
+
+  std::shared_future<void>* getFuture() override { return &future; }
+  bool isReady() override {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  void complete() { promise.set_value(); }
+};
+
+int main() {
+  bool ret = true;
+
+  int a, b, c;
+  void* ab[] = { &a, &b };
+  std::vector<void*> bufsAB(ab, ab + 2);
+  std::vector<void*> bufsA(1, &a);
+  std::vector<void*> bufsC(1, &c);
+
+  // an operation using two buffers is collected once
+  {
+    Kalmar::BufferDependencies deps;
+    auto op = std::make_shared<FakeOp>();
+    deps.record(bufsAB, op);
+    std::vector<std::shared_ptr<Kalmar::KalmarAsyncOp>> found = deps.collect(bufsAB);
+    ret &= (found.size() == 1);
+    ret &= (found.size() == 1 && found[0] == op);
+    // and then forgotten
+    ret &= deps.collect(bufsAB).empty();
+    op->complete();
+  }
+
+  // two operations on overlapping buffers are collected once each, buffers
+  // nobody uses contribute nothing
+  {
+    Kalmar::BufferDependencies deps;
+    auto op1 = std::make_shared<FakeOp>();
+    auto op2 = std::make_shared<FakeOp>();
+    deps.record(bufsAB, op1);
+    deps.record(bufsA, op2);
+    std::vector<void*> bufsABC(bufsAB);
+    bufsABC.push_back(&c);
+    std::vector<std::shared_ptr<Kalmar::KalmarAsyncOp>> found = deps.collect(bufsABC);
+    ret &= (found.size() == 2);
+    ret &= (found.size() == 2 && found[0] == op1 && found[1] == op2);
+    op1->complete();
+    op2->complete();
+  }
+
+  // completed operations are skipped
+  {
+    Kalmar::BufferDependencies deps;
+    auto done = std::make_shared<FakeOp>();
+    auto pending = std::make_shared<FakeOp>();
+    deps.record(bufsA, done);
+    deps.record(bufsA, pending);
+    done->complete();
+    std::vector<std::shared_ptr<Kalmar::KalmarAsyncOp>> found = deps.collect(bufsA);
+    ret &= (found.size() == 1 && found[0] == pending);
+    pending->complete();
+  }
+
+  // destroyed operations are skipped, and wait() does not touch them
+  {
+    Kalmar::BufferDependencies deps;
+    auto op = std::make_shared<FakeOp>();
+    deps.record(bufsA, op);
+    deps.record(bufsC, op);
+    op->complete();
+    op.reset();
+    ret &= deps.collect(bufsA).empty();
+    deps.wait(&c);
+  }
+
+  // after collect() erased the users of a buffer, wait() only blocks on the
+  // operation recorded since
+  {
+    Kalmar::BufferDependencies deps;
+    auto old = std::make_shared<FakeOp>();
+    deps.record(bufsA, old);
+    ret &= (deps.collect(bufsA).size() == 1);
+    // nothing is recorded for a anymore, this returns right away even though
+    // old is still in flight
+    deps.wait(&a);
+    ret &= !old->isReady();
+
+    auto next = std::make_shared<FakeOp>();
+    deps.record(bufsA, next);
+    std::thread worker([next]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      next->complete();
+    });
+    deps.wait(&a);
+    ret &= next->isReady();
+    worker.join();
+    old->complete();
+
+    // the users waited for are forgotten as well
+    ret &= deps.collect(bufsA).empty();
+  }
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
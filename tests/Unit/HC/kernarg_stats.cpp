@@ -0,0 +1,67 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <vector>
+
+// test the recycling of kernarg segments
+//
+// Each queue keeps its own pools of kernarg segments. Once the dispatches
+// of a queue have completed their segments are reused, so the second batch
+// of kernels mostly runs on the segments the first one left behind. Segments
+// are reused as well once their dispatch completed, even if nobody waited
+// for it and its completion_future is still around.
+
+#define BATCH (256)
+
+void dispatch_batch(hc::accelerator_view& av, hc::array_view<int, 1>& a) {
+  for (int i = 0; i < BATCH; ++i) {
+    hc::parallel_for_each(av, a.get_extent(), [=](hc::index<1> idx) [[hc]] {
+      a[idx] += 1;
+    });
+  }
+  av.wait();
+}
+
+int main() {
+  bool ret = true;
+
+  hc::accelerator acc;
+  hc::accelerator_view av = acc.create_view();
+  hc::array_view<int, 1> a(64);
+  for (int i = 0; i < 64; ++i)
+    a[i] = i;
+
+  dispatch_batch(av, a);
+  hc::kernarg_stats first = acc.get_kernarg_stats();
+  ret &= (first.grown > 0);
+
+  dispatch_batch(av, a);
+  hc::kernarg_stats second = acc.get_kernarg_stats();
+  ret &= (second.grown - first.grown < BATCH);
+  ret &= (second.hits > first.hits);
+
+  // keep the futures, only observe completion without waiting
+  std::vector<hc::completion_future> futures;
+  for (int i = 0; i < 4 * BATCH; ++i) {
+    futures.push_back(hc::parallel_for_each(av, a.get_extent(), [=](hc::index<1> idx) [[hc]] {
+      a[idx] += 1;
+    }));
+    while (!futures.back().is_ready());
+  }
+  hc::kernarg_stats third = acc.get_kernarg_stats();
+  ret &= (third.grown - second.grown < BATCH);
+  futures.clear();
+
+  for (int i = 0; i < 64; ++i)
+    ret &= (a[i] == i + 6 * BATCH);
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,67 @@
+// XFAIL: Linux
+// RUN: %hc %s -o %t.out && %t.out
+// RUN: HCC_POLLED_SIGNAL_GRID=1024 %t.out
+#include <hc.hpp>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// test the completion signals of kernels dispatched from 4 threads
+//
+// Every thread takes a signal from the pool shared by all queues for each of
+// its dispatches and hands it back once the dispatch has completed, well
+// beyond the signals the pool starts with. With HCC_POLLED_SIGNAL_GRID the
+// short kernels below complete on signals raising no interrupt, which the
+// host waits on by polling.
+
+#define THREADS (4)
+#define DISPATCHES (1024)
+#define VEC_SIZE (256)
+
+void test(bool* ret) {
+  hc::accelerator_view av = hc::accelerator().create_view();
+  hc::array_view<int, 1> a(VEC_SIZE);
+  for (int i = 0; i < VEC_SIZE; ++i)
+    a[i] = i;
+
+  std::vector<hc::completion_future> futures;
+  for (int i = 0; i < DISPATCHES; ++i) {
+    futures.push_back(hc::parallel_for_each(av, a.get_extent(), [=](hc::index<1> idx) [[hc]] {
+      a[idx] += 1;
+    }));
+    // wait on some of the dispatches while later ones are in flight
+    if (i % 64 == 63) {
+      futures[i - 32].wait(hc::hcWaitModeActive);
+      *ret &= futures[i - 32].is_ready();
+    }
+  }
+  futures.back().wait(hc::hcWaitModeActive);
+
+  for (int i = 0; i < VEC_SIZE; ++i)
+    *ret &= (a[i] == i + DISPATCHES);
+}
+
+int main() {
+  bool ret = true;
+
+  bool results[THREADS];
+  std::vector<std::thread> threads;
+  for (int i = 0; i < THREADS; ++i) {
+    results[i] = true;
+    threads.push_back(std::thread(test, &results[i]));
+  }
+  for (auto& t : threads)
+    t.join();
+
+  for (int i = 0; i < THREADS; ++i)
+    ret &= results[i];
+
+  if (ret) {
+    std::cout << "Verify success!\n";
+  } else {
+    std::cout << "Verify failed!\n";
+  }
+
+  return !(ret == true);
+}
@@ -0,0 +1,103 @@
+// RUN: %hc -cpu %s -o %t.out
+// RUN: HCC_RUNTIME=CPU %t.out 10
+
+// benchmark for atomic operations under contention on the CPU runtime
+//
+// Every work-item atomically adds to one bin of a histogram. The fewer bins,
+// the more work-items hit the same address at the same time, so the time per
+// kernel shows how the host atomics scale from fully contended (one bin) to
+// practically uncontended (one bin per cache line and more).
+//
+// hcc -cpu `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// HCC_RUNTIME=CPU ./bench 100
+//
+// HCC_CPU_NUM_THREADS can be set to change the number of CPU worker threads.
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define GRID_SIZE (1 << 20)
+
+#define DISPATCH_COUNT 100
+
+template <typename T>
+T median(std::vector<std::chrono::duration<T>> data) {
+  std::sort(data.begin(), data.end());
+  return data[data.size() / 2].count();
+}
+
+template <typename T>
+T average(const std::vector<std::chrono::duration<T>> &data) {
+  T avg_duration = 0;
+
+  for(auto &i : data)
+    avg_duration += i.count();
+
+  return avg_duration/data.size();
+}
+
+template <typename Launch>
+void measure(const std::string &name, int dispatch_count, Launch launch) {
+  std::vector<std::chrono::duration<double>> elapsed;
+  elapsed.reserve(dispatch_count);
+
+  for(int i = 0; i < dispatch_count; ++i) {
+    auto start = std::chrono::high_resolution_clock::now();
+    launch().wait();
+    auto end = std::chrono::high_resolution_clock::now();
+    elapsed.push_back(end - start);
+  }
+
+  std::cout << std::setw(32) << std::left << (name + " mean (us):")
+            << std::setprecision(8) << average(elapsed)*1000000.0 << "\n";
+  std::cout << std::setw(32) << std::left << (name + " median (us):")
+            << std::setprecision(8) << median(elapsed)*1000000.0 << "\n";
+}
+
+template <typename T>
+bool histogram(hc::accelerator_view& av, int dispatch_count, int bins,
+               const std::string& type) {
+  hc::array<T, 1> table(bins, av);
+  std::vector<T> zero(bins, T(0));
+  hc::copy(zero.begin(), zero.end(), table);
+
+  measure(type + " " + std::to_string(bins) + " bins", dispatch_count, [&]() {
+    return hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE),
+    [=, &table](hc::index<1>& idx) __HC__ {
+      hc::atomic_fetch_add(&table[idx[0] % bins], T(1));
+    });
+  });
+
+  // every work-item of every kernel added one
+  std::vector<T> result(bins);
+  hc::copy(table, result.begin());
+  T sum = 0;
+  for (T v : result)
+    sum += v;
+  return sum == T(GRID_SIZE) * dispatch_count;
+}
+
+int main(int argc, char* argv[]) {
+
+  int dispatch_count = DISPATCH_COUNT;
+  if(argc > 1)
+    dispatch_count = std::stoi(argv[1]);
+
+  hc::accelerator_view av = hc::accelerator().get_default_view();
+
+  std::cout << "Iterations per test:           " << dispatch_count << "\n";
+
+  bool ret = true;
+  for (int bins : { 1, 16, 256, 4096 }) {
+    ret &= histogram<int>(av, dispatch_count, bins, "int");
+    ret &= histogram<float>(av, dispatch_count, bins, "float");
+  }
+
+  return !(ret == true);
+}
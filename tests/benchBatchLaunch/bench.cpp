@@ -0,0 +1,102 @@
+// RUN: %hc %s -o %t.out
+// RUN: %t.out 100
+
+// benchmark for launching pipelines of short kernels in batches
+//
+// A pipeline is a chain of small kernels launched back to back and waited on
+// as a whole. Launched one by one, every kernel writes its own AQL packet
+// and rings the doorbell of the queue. Between accelerator_view::begin_batch()
+// and end_batch() the packets of the whole pipeline are written at once and
+// the doorbell is rung a single time. Reports the mean and median time of a
+// pipeline launched both ways.
+//
+// hcc `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// ./bench 1000 32
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define GRID_SIZE 64
+
+#define KERNEL_COUNT 32
+
+#define DISPATCH_COUNT 1000
+
+template <typename T>
+T median(std::vector<std::chrono::duration<T>> data) {
+  std::sort(data.begin(), data.end());
+  return data[data.size() / 2].count();
+}
+
+template <typename T>
+T average(const std::vector<std::chrono::duration<T>> &data) {
+  T avg_duration = 0;
+
+  for(auto &i : data)
+    avg_duration += i.count();
+
+  return avg_duration/data.size();
+}
+
+void pipeline(hc::accelerator_view& av, hc::array_view<int, 1>& out, int kernels) {
+  for (int k = 0; k < kernels; ++k) {
+    hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE), [=](hc::index<1>& idx) __HC__ {
+      out[idx] += 1;
+    });
+  }
+}
+
+void measure(const std::string &name, int dispatch_count, hc::accelerator_view& av,
+             hc::array_view<int, 1>& out, int kernels, bool batched) {
+  std::vector<std::chrono::duration<double>> elapsed;
+  elapsed.reserve(dispatch_count);
+
+  for(int i = 0; i < dispatch_count; ++i) {
+    auto start = std::chrono::high_resolution_clock::now();
+    if (batched)
+      av.begin_batch();
+    pipeline(av, out, kernels);
+    if (batched)
+      av.end_batch();
+    av.wait();
+    auto end = std::chrono::high_resolution_clock::now();
+    elapsed.push_back(end - start);
+  }
+
+  std::cout << std::setw(32) << std::left << (name + " mean (us):")
+            << std::setprecision(8) << average(elapsed)*1000000.0 << "\n";
+  std::cout << std::setw(32) << std::left << (name + " median (us):")
+            << std::setprecision(8) << median(elapsed)*1000000.0 << "\n";
+}
+
+int main(int argc, char* argv[]) {
+
+  int dispatch_count = DISPATCH_COUNT;
+  if(argc > 1)
+    dispatch_count = std::stoi(argv[1]);
+
+  int kernels = KERNEL_COUNT;
+  if(argc > 2)
+    kernels = std::stoi(argv[2]);
+
+  hc::accelerator_view av = hc::accelerator().create_view();
+  hc::array_view<int, 1> out(GRID_SIZE);
+  out.discard_data();
+  hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE), [=](hc::index<1>& idx) __HC__ {
+    out[idx] = 0;
+  }).wait();
+
+  std::cout << "Iterations per test:           " << dispatch_count << "\n";
+  std::cout << "Kernels per pipeline:          " << kernels << "\n";
+
+  measure("one by one", dispatch_count, av, out, kernels, false);
+  measure("batched", dispatch_count, av, out, kernels, true);
+
+  return !(out[0] == 2 * dispatch_count * kernels);
+}
@@ -2,6 +2,8 @@
 // RUN: %t.out 10000
 // RUN: test -e pfe.dat && mv pfe.dat %T/pfe.dat
 // RUN: test -e grid_launch.dat && mv grid_launch.dat %T/grid_launch.dat
+// RUN: test -e pfe_av16.dat && mv pfe_av16.dat %T/pfe_av16.dat
+// RUN: test -e pfe_args16.dat && mv pfe_args16.dat %T/pfe_args16.dat
 
 // benchmark for empty PFE/grid_launch kernel
 //
@@ -29,6 +31,8 @@
 #define TILE_SIZE 16
 
 #define DISPATCH_COUNT 10000
+#define AV_COUNT 16
+#define ARG_COUNT 16
 #define TOL_HI 1e-4
 
 __attribute__((hc_grid_launch)) 
@@ -111,10 +115,14 @@ int main(int argc, char* argv[]) {
   std::vector<std::chrono::duration<double>> elapsed_pfe;
   std::vector<std::chrono::duration<double>> elapsed_grid_launch;
   std::vector<std::chrono::duration<double>> elapsed_exception;
+  std::vector<std::chrono::duration<double>> elapsed_pfe_av16;
+  std::vector<std::chrono::duration<double>> elapsed_pfe_args16;
   std::chrono::duration<double> tol_hi(TOL_HI);
   std::vector<std::chrono::duration<double>> outliers_pfe;
   std::vector<std::chrono::duration<double>> outliers_gl;
   std::vector<std::chrono::duration<double>> outliers_gl_ex;
+  std::vector<std::chrono::duration<double>> outliers_pfe_av16;
+  std::vector<std::chrono::duration<double>> outliers_pfe_args16;
 
   grid_launch_parm lp;
   grid_launch_init(&lp);
@@ -174,5 +182,56 @@ int main(int argc, char* argv[]) {
   std::cout << "grid_launch time (us):          " 
             << std::setprecision(8) << average(elapsed_grid_launch)*1000000.0 << "\n";
 
+  // Timing pfe capturing 16 array_views, measures the per-buffer launch overhead
+  std::vector<hc::array_view<float, 1>> avs;
+  for(int i = 0; i < AV_COUNT; ++i)
+    avs.push_back(hc::array_view<float, 1>(GRID_SIZE));
+  hc::array_view<float, 1> a0 = avs[0], a1 = avs[1], a2 = avs[2], a3 = avs[3],
+                           a4 = avs[4], a5 = avs[5], a6 = avs[6], a7 = avs[7],
+                           a8 = avs[8], a9 = avs[9], a10 = avs[10], a11 = avs[11],
+                           a12 = avs[12], a13 = avs[13], a14 = avs[14], a15 = avs[15];
+  for(int i = 0; i < dispatch_count; ++i) {
+    start = std::chrono::high_resolution_clock::now();
+    auto cf = hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE),
+    [=](hc::index<1>& idx) __HC__ {
+      a0[idx] = a1[idx] + a2[idx] + a3[idx] + a4[idx] + a5[idx] + a6[idx] + a7[idx]
+              + a8[idx] + a9[idx] + a10[idx] + a11[idx] + a12[idx] + a13[idx]
+              + a14[idx] + a15[idx];
+    });
+    cf.wait();
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> dur = end - start;
+    elapsed_pfe_av16.push_back(dur);
+  }
+  remove_outliers(elapsed_pfe_av16, outliers_pfe_av16);
+  plot("pfe_av16", elapsed_pfe_av16);
+  std::cout << "pfe 16 array_views time (us):   "
+            << std::setprecision(8) << average(elapsed_pfe_av16)*1000000.0 << "\n";
+
+  // Timing pfe capturing 16 scalars, measures the per-argument launch overhead
+  std::vector<int> args(ARG_COUNT);
+  for(int i = 0; i < ARG_COUNT; ++i)
+    args[i] = i;
+  int s0 = args[0], s1 = args[1], s2 = args[2], s3 = args[3],
+      s4 = args[4], s5 = args[5], s6 = args[6], s7 = args[7],
+      s8 = args[8], s9 = args[9], s10 = args[10], s11 = args[11],
+      s12 = args[12], s13 = args[13], s14 = args[14], s15 = args[15];
+  for(int i = 0; i < dispatch_count; ++i) {
+    start = std::chrono::high_resolution_clock::now();
+    auto cf = hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE),
+    [=](hc::index<1>& idx) __HC__ {
+      a0[idx] = s0 + s1 + s2 + s3 + s4 + s5 + s6 + s7
+              + s8 + s9 + s10 + s11 + s12 + s13 + s14 + s15;
+    });
+    cf.wait();
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> dur = end - start;
+    elapsed_pfe_args16.push_back(dur);
+  }
+  remove_outliers(elapsed_pfe_args16, outliers_pfe_args16);
+  plot("pfe_args16", elapsed_pfe_args16);
+  std::cout << "pfe 16 scalars time (us):       "
+            << std::setprecision(8) << average(elapsed_pfe_args16)*1000000.0 << "\n";
+
   return 0;
 }
@@ -15,3 +15,13 @@ set output "grid_launch.svg"
 set title "Grid Launch plot"
 stats "./grid_launch.dat" using 2 prefix "A"
 plot "./grid_launch.dat" using 1:2 title "", A_mean title gprintf("Mean = %.5te%+03T s", A_mean)
+
+set output "pfe_av16.svg"
+set title "PFE with 16 array_views plot"
+stats "./pfe_av16.dat" using 2 prefix "A"
+plot "./pfe_av16.dat" using 1:2 title "", A_mean title gprintf("Mean = %.5te%+03T s", A_mean)
+
+set output "pfe_args16.svg"
+set title "PFE with 16 scalars plot"
+stats "./pfe_args16.dat" using 2 prefix "A"
+plot "./pfe_args16.dat" using 1:2 title "", A_mean title gprintf("Mean = %.5te%+03T s", A_mean)
@@ -0,0 +1,96 @@
+// RUN: %hc -cpu %s -o %t.out
+// RUN: HCC_RUNTIME=CPU %t.out 10000
+
+// benchmark for empty PFE kernels on the CPU runtime
+//
+// Measures the launch latency of an empty kernel when the CPU fallback path
+// executes parallel_for_each, i.e. the cost of handing a kernel to the CPU
+// worker threads and waiting for them to finish.
+//
+// hcc -cpu `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// HCC_RUNTIME=CPU ./bench 10000
+//
+// HCC_CPU_NUM_THREADS can be set to change the number of CPU worker threads.
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#define GRID_SIZE 16
+#define TILE_SIZE 16
+
+#define DISPATCH_COUNT 10000
+
+template <typename T>
+T median(std::vector<std::chrono::duration<T>> data) {
+  std::sort(data.begin(), data.end());
+  return data[data.size() / 2].count();
+}
+
+template <typename T>
+T average(const std::vector<std::chrono::duration<T>> &data) {
+  T avg_duration = 0;
+
+  for(auto &i : data)
+    avg_duration += i.count();
+
+  return avg_duration/data.size();
+}
+
+template <typename Launch>
+void measure(const std::string &name, int dispatch_count, Launch launch) {
+  std::vector<std::chrono::duration<double>> elapsed;
+  elapsed.reserve(dispatch_count);
+
+  for(int i = 0; i < dispatch_count; ++i) {
+    auto start = std::chrono::high_resolution_clock::now();
+    launch().wait();
+    auto end = std::chrono::high_resolution_clock::now();
+    elapsed.push_back(end - start);
+  }
+
+  std::cout << std::setw(32) << std::left << (name + " mean (us):")
+            << std::setprecision(8) << average(elapsed)*1000000.0 << "\n";
+  std::cout << std::setw(32) << std::left << (name + " median (us):")
+            << std::setprecision(8) << median(elapsed)*1000000.0 << "\n";
+}
+
+int main(int argc, char* argv[]) {
+
+  int dispatch_count = DISPATCH_COUNT;
+  if(argc > 1)
+    dispatch_count = std::stoi(argv[1]);
+
+  hc::accelerator_view av = hc::accelerator().get_default_view();
+
+  // launch empty kernel to initialize everything first
+  hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE * TILE_SIZE),
+  [=](hc::index<1>& idx) __HC__ {
+  }).wait();
+
+  std::cout << "Iterations per test:           " << dispatch_count << "\n";
+
+  measure("pfe", dispatch_count, [&]() {
+    return hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE * TILE_SIZE),
+    [=](hc::index<1>& idx) __HC__ {
+    });
+  });
+
+  measure("pfe 3D", dispatch_count, [&]() {
+    return hc::parallel_for_each(av, hc::extent<3>(GRID_SIZE * TILE_SIZE, 1, 1),
+    [=](hc::index<3>& idx) __HC__ {
+    });
+  });
+
+  measure("tiled pfe", dispatch_count, [&]() {
+    return hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE * TILE_SIZE).tile(TILE_SIZE),
+    [=](hc::tiled_index<1>& tidx) __HC__ {
+    });
+  });
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+// RUN: %hc %s -o %t.out
+// RUN: %t.out 1000
+
+// benchmark for launching kernels from many host threads
+//
+// Each thread launches empty kernels on an accelerator_view of its own, as
+// fast as it can. The launch path does not share mutable state between the
+// threads, so the total launch rate should grow with the number of threads
+// until the device is saturated. Runs with 1, 2, 4, ... up to MAX_THREADS
+// threads and reports the launches per second of each run.
+//
+// hcc `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// ./bench 10000
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GRID_SIZE 64
+
+#define MAX_THREADS 32
+
+#define DISPATCH_COUNT 1000
+
+// launches per second of threads threads doing dispatch_count launches each
+double measure(int threads, int dispatch_count) {
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> workers;
+  std::vector<hc::array_view<int, 1>> outs;
+  for (int t = 0; t < threads; ++t)
+    outs.push_back(hc::array_view<int, 1>(GRID_SIZE));
+
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      hc::accelerator_view av = hc::accelerator().create_view();
+      hc::array_view<int, 1> out = outs[t];
+      // warm up the kernel and the queue of the thread
+      hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE), [=](hc::index<1>& idx) __HC__ {
+        out[idx] = 0;
+      }).wait();
+
+      ++ready;
+      while (!go)
+        std::this_thread::yield();
+
+      for (int i = 0; i < dispatch_count; ++i) {
+        hc::parallel_for_each(av, hc::extent<1>(GRID_SIZE), [=](hc::index<1>& idx) __HC__ {
+          out[idx] += 1;
+        });
+      }
+      av.wait();
+    });
+  }
+
+  while (ready < threads)
+    std::this_thread::yield();
+  auto start = std::chrono::high_resolution_clock::now();
+  go = true;
+  for (auto& worker : workers)
+    worker.join();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+
+  for (int t = 0; t < threads; ++t)
+    if (outs[t][0] != dispatch_count)
+      std::cout << "thread " << t << " result mismatch\n";
+
+  return threads * dispatch_count / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+
+  int dispatch_count = DISPATCH_COUNT;
+  if(argc > 1)
+    dispatch_count = std::stoi(argv[1]);
+
+  int max_threads = MAX_THREADS;
+  if(argc > 2)
+    max_threads = std::stoi(argv[2]);
+
+  std::cout << "Launches per thread:           " << dispatch_count << "\n";
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    double rate = measure(threads, dispatch_count);
+    std::cout << std::setw(3) << std::right << threads << std::setw(28) << std::left
+              << " threads launches/s:" << std::setprecision(8) << rate << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+// RUN: %hc %s -o %t.out
+// RUN: %t.out 5
+// RUN: %hc -cpu %s -o %t.cpu.out
+// RUN: HCC_RUNTIME=CPU %t.cpu.out 5
+
+// benchmark for the startup cost of the runtime
+//
+// Runs itself as a child process under each HCC_LAZYINIT mode, and times
+// the whole run of the child: once for a tool which never launches a kernel,
+// and once for one which launches a single kernel and waits for it.
+//
+//   ON          the runtime is loaded and kernels are built on first use
+//   BACKGROUND  a thread loads the runtime while main() proceeds
+//   OFF         the runtime is loaded before main() starts
+//
+// The runtime is picked as usual, build with -cpu and run with
+// HCC_RUNTIME=CPU to measure the CPU runtime.
+//
+// hcc `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// ./bench 20
+// hcc -cpu `hcc-config --cxxflags --ldflags` bench.cpp -o bench_cpu
+// HCC_RUNTIME=CPU ./bench_cpu 20
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define RUN_COUNT 10
+
+template <typename T>
+T median(std::vector<std::chrono::duration<T>> data) {
+  std::sort(data.begin(), data.end());
+  return data[data.size() / 2].count();
+}
+
+// wall time of one run of this program with the given arguments
+std::chrono::duration<double> run_child(const char* self, const char* work) {
+  char* argv[] = { const_cast<char*>(self), const_cast<char*>("child"),
+                   const_cast<char*>(work), nullptr };
+  auto start = std::chrono::high_resolution_clock::now();
+  pid_t pid;
+  if (posix_spawn(&pid, self, nullptr, nullptr, argv, environ) != 0) {
+    std::cerr << "can't run " << self << "\n";
+    exit(1);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  auto end = std::chrono::high_resolution_clock::now();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::cerr << "child failed\n";
+    exit(1);
+  }
+  return end - start;
+}
+
+int child(const char* work) {
+  if (strcmp(work, "launch") != 0)
+    return 0;
+  hc::array_view<int, 1> out(64);
+  hc::parallel_for_each(hc::extent<1>(64), [=](hc::index<1>& idx) __HC__ {
+    out[idx] = idx[0];
+  });
+  return !(out[63] == 63);
+}
+
+int main(int argc, char* argv[]) {
+
+  if (argc > 2 && strcmp(argv[1], "child") == 0)
+    return child(argv[2]);
+
+  int run_count = RUN_COUNT;
+  if(argc > 1)
+    run_count = std::stoi(argv[1]);
+
+  const char* runtime = getenv("HCC_RUNTIME");
+  std::cout << "Runtime:                       " << (runtime ? runtime : "default") << "\n";
+  std::cout << "Runs per test:                 " << run_count << "\n";
+
+  const char* modes[] = { "ON", "BACKGROUND", "OFF" };
+  const char* works[] = { "none", "launch" };
+  for (const char* mode : modes) {
+    setenv("HCC_LAZYINIT", mode, 1);
+    for (const char* work : works) {
+      std::vector<std::chrono::duration<double>> elapsed;
+      for (int i = 0; i < run_count; ++i)
+        elapsed.push_back(run_child(argv[0], work));
+      std::string name = std::string(mode) + " " + work;
+      std::cout << std::setw(32) << std::left << (name + " median (ms):")
+                << std::setprecision(8) << median(elapsed) * 1000.0 << "\n";
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,103 @@
+// RUN: %hc -cpu %s -o %t.out
+// RUN: HCC_RUNTIME=CPU %t.out 10
+
+// benchmark for handing read-only host data to a unified accelerator
+//
+// The CPU accelerators of the CPU runtime are unified: they share the host
+// allocation of an array_view<const T> instead of allocating a buffer of
+// their own and copying the data into it. Each iteration wraps the host data
+// in a new array_view and reads it in a kernel. For comparison, the staged
+// version copies the same data into an array on the accelerator first, which
+// is what the handoff costs when the data is not shared.
+//
+// hcc -cpu `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// HCC_RUNTIME=CPU ./bench 100
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define VEC_SIZE (1 << 22)
+
+#define DISPATCH_COUNT 100
+
+template <typename T>
+T median(std::vector<std::chrono::duration<T>> data) {
+  std::sort(data.begin(), data.end());
+  return data[data.size() / 2].count();
+}
+
+template <typename T>
+T average(const std::vector<std::chrono::duration<T>> &data) {
+  T avg_duration = 0;
+
+  for(auto &i : data)
+    avg_duration += i.count();
+
+  return avg_duration/data.size();
+}
+
+template <typename Launch>
+void measure(const std::string &name, int dispatch_count, Launch launch) {
+  std::vector<std::chrono::duration<double>> elapsed;
+  elapsed.reserve(dispatch_count);
+
+  hc::coherence_stats before = hc::get_coherence_stats();
+  for(int i = 0; i < dispatch_count; ++i) {
+    auto start = std::chrono::high_resolution_clock::now();
+    launch().wait();
+    auto end = std::chrono::high_resolution_clock::now();
+    elapsed.push_back(end - start);
+  }
+  hc::coherence_stats after = hc::get_coherence_stats();
+
+  std::cout << std::setw(32) << std::left << (name + " mean (us):")
+            << std::setprecision(8) << average(elapsed)*1000000.0 << "\n";
+  std::cout << std::setw(32) << std::left << (name + " median (us):")
+            << std::setprecision(8) << median(elapsed)*1000000.0 << "\n";
+  std::cout << std::setw(32) << std::left << (name + " copied (KiB):")
+            << (after.bytes_copied - before.bytes_copied) / 1024 / dispatch_count << "\n";
+  std::cout << std::setw(32) << std::left << (name + " shared (KiB):")
+            << (after.bytes_aliased - before.bytes_aliased) / 1024 / dispatch_count << "\n";
+}
+
+int main(int argc, char* argv[]) {
+
+  int dispatch_count = DISPATCH_COUNT;
+  if(argc > 1)
+    dispatch_count = std::stoi(argv[1]);
+
+  hc::accelerator_view av = hc::accelerator().get_default_view();
+
+  std::vector<float> host(VEC_SIZE);
+  for (int i = 0; i < VEC_SIZE; ++i)
+    host[i] = i;
+  hc::array_view<float, 1> sum(1);
+
+  std::cout << "Iterations per test:           " << dispatch_count << "\n";
+  std::cout << "Bytes per handoff:             " << VEC_SIZE * sizeof(float) << "\n";
+
+  measure("shared", dispatch_count, [&]() {
+    hc::array_view<const float, 1> in(VEC_SIZE, host);
+    return hc::parallel_for_each(av, hc::extent<1>(1), [=](hc::index<1>& idx) __HC__ {
+      sum[0] = in[0] + in[VEC_SIZE - 1];
+    });
+  });
+
+  measure("staged", dispatch_count, [&]() {
+    hc::array<float, 1> in(VEC_SIZE, host.begin(), host.end(), av);
+    hc::completion_future fut = hc::parallel_for_each(av, hc::extent<1>(1), [=, &in](hc::index<1>& idx) __HC__ {
+      sum[0] = in[0] + in[VEC_SIZE - 1];
+    });
+    // in goes away on return
+    fut.wait();
+    return fut;
+  });
+
+  return !(sum[0] == VEC_SIZE - 1);
+}
@@ -0,0 +1,120 @@
+// RUN: %hc -cpu %s -o %t.out
+// RUN: HCC_RUNTIME=CPU HCC_CPU_NUM_THREADS=1 %t.out 10
+
+// benchmark for vectorized element-wise kernels on the CPU runtime
+//
+// The CPU runtime runs the innermost row of a parallel_for_each in a loop the
+// loop vectorizer can turn into SIMD code. This runs saxpy on 4M floats as a
+// kernel and, for reference, as a plain host loop with vectorization enabled
+// and disabled. With a single worker thread the kernel should be close to the
+// vectorized host loop, several times faster than the scalar one.
+//
+// hcc -cpu `hcc-config --cxxflags --ldflags` bench.cpp -o bench
+// HCC_RUNTIME=CPU HCC_CPU_NUM_THREADS=1 ./bench 100
+//
+// make remarks prints the loops the vectorizer transformed.
+
+#include "hc.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define VEC_SIZE (1 << 22)
+
+#define DISPATCH_COUNT 100
+
+template <typename T>
+T median(std::vector<std::chrono::duration<T>> data) {
+  std::sort(data.begin(), data.end());
+  return data[data.size() / 2].count();
+}
+
+template <typename Launch>
+double measure(const std::string &name, int dispatch_count, Launch launch) {
+  std::vector<std::chrono::duration<double>> elapsed;
+  elapsed.reserve(dispatch_count);
+
+  for(int i = 0; i < dispatch_count; ++i) {
+    auto start = std::chrono::high_resolution_clock::now();
+    launch();
+    auto end = std::chrono::high_resolution_clock::now();
+    elapsed.push_back(end - start);
+  }
+
+  double ns = median(elapsed) * 1000000000.0 / VEC_SIZE;
+  std::cout << std::setw(32) << std::left << (name + " median (ns/elem):")
+            << std::setprecision(4) << ns << "\n";
+  return ns;
+}
+
+__attribute__((noinline))
+void saxpy_scalar(float a, const float* x, float* y, int n) {
+#pragma clang loop vectorize(disable) interleave(disable)
+  for (int i = 0; i < n; ++i)
+    y[i] = a * x[i] + y[i];
+}
+
+__attribute__((noinline))
+void saxpy_simd(float a, const float* x, float* y, int n) {
+#pragma clang loop vectorize(enable) interleave(enable)
+  for (int i = 0; i < n; ++i)
+    y[i] = a * x[i] + y[i];
+}
+
+int main(int argc, char* argv[]) {
+
+  int dispatch_count = DISPATCH_COUNT;
+  if(argc > 1)
+    dispatch_count = std::stoi(argv[1]);
+
+  hc::accelerator_view av = hc::accelerator().get_default_view();
+
+  const float a = 2.0f;
+  std::vector<float> x(VEC_SIZE, 1.0f);
+  std::vector<float> y(VEC_SIZE, 0.0f);
+  hc::array_view<const float, 1> xv(VEC_SIZE, x);
+  hc::array_view<float, 1> yv(VEC_SIZE, y);
+
+  // launch once to initialize everything and move the data first
+  hc::parallel_for_each(av, yv.get_extent(), [=](hc::index<1>& idx) __HC__ {
+    yv[idx] = a * xv[idx] + yv[idx];
+  }).wait();
+
+  std::cout << "Iterations per test:           " << dispatch_count << "\n";
+
+  double kernel = measure("pfe saxpy", dispatch_count, [&]() {
+    hc::parallel_for_each(av, yv.get_extent(), [=](hc::index<1>& idx) __HC__ {
+      yv[idx] = a * xv[idx] + yv[idx];
+    }).wait();
+  });
+
+  std::vector<float> hy(VEC_SIZE, 0.0f);
+  double scalar = measure("host scalar saxpy", dispatch_count, [&]() {
+    saxpy_scalar(a, x.data(), hy.data(), VEC_SIZE);
+  });
+  double simd = measure("host simd saxpy", dispatch_count, [&]() {
+    saxpy_simd(a, x.data(), hy.data(), VEC_SIZE);
+  });
+
+  std::cout << std::setw(32) << std::left << "pfe speedup over scalar:"
+            << std::setprecision(4) << scalar / kernel << "\n";
+  std::cout << std::setw(32) << std::left << "simd speedup over scalar:"
+            << std::setprecision(4) << scalar / simd << "\n";
+
+  // every launch added a to each element
+  yv.synchronize();
+  bool ret = true;
+  float expected = a * (dispatch_count + 1);
+  for (int i = 0; i < VEC_SIZE; ++i) {
+    if (y[i] != expected) {
+      ret = false;
+      break;
+    }
+  }
+
+  return !(ret == true);
+}